@@ -0,0 +1,101 @@
+#!/usr/bin/env python2
+# Copyright (c) 2017 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the address and spent indexes follow blocks as they are
+# connected and disconnected.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, assert_raises, \
+    initialize_chain_clean, start_nodes
+
+from decimal import Decimal
+
+class AddressIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(1, self.options.tmpdir, extra_args=[['-addressindex', '-spentindex']])
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+
+        addr = node.getnewaddress()
+        addr2 = node.getnewaddress()
+
+        print "Connect a block crediting the address"
+        txid = node.sendtoaddress(addr, 10)
+        creditblock = node.generate(1)[0]
+        height = node.getblockcount()
+        tx = node.decoderawtransaction(node.gettransaction(txid)['hex'])
+        vout = [out['n'] for out in tx['vout'] if out['scriptPubKey']['addresses'] == [addr]][0]
+        prevout = tx['vin'][0]
+
+        def check_credited():
+            assert_equal(node.getaddressbalance({"addresses": [addr]}),
+                         {"balance": Decimal('10'), "received": Decimal('10')})
+            utxos = node.getaddressutxos({"addresses": [addr]})
+            assert_equal(len(utxos), 1)
+            assert_equal(utxos[0]['txid'], txid)
+            assert_equal(utxos[0]['outputIndex'], vout)
+            assert_equal(utxos[0]['amount'], Decimal('10'))
+            assert_equal(utxos[0]['height'], height)
+            spent = node.getspentinfo({"txid": prevout['txid'], "index": prevout['vout']})
+            assert_equal(spent, {"txid": txid, "index": 0, "height": height})
+        check_credited()
+        assert_raises(JSONRPCException, node.getspentinfo, {"txid": txid, "index": vout})
+
+        print "Connect a block spending the output"
+        rawtx = node.createrawtransaction([{"txid": txid, "vout": vout}], {addr2: Decimal('9.9999')})
+        spendtxid = node.sendrawtransaction(node.signrawtransaction(rawtx)['hex'])
+        spendblock = node.generate(1)[0]
+
+        def check_spent():
+            assert_equal(node.getaddressbalance({"addresses": [addr]}),
+                         {"balance": Decimal('0'), "received": Decimal('10')})
+            assert_equal(node.getaddressutxos({"addresses": [addr]}), [])
+            assert_equal(node.getaddressbalance({"addresses": [addr2]}),
+                         {"balance": Decimal('9.9999'), "received": Decimal('9.9999')})
+            deltas = node.getaddressdeltas({"addresses": [addr]})
+            assert_equal([(d['txid'], d['height'], d['amount']) for d in deltas],
+                         [(txid, height, Decimal('10')), (spendtxid, height + 1, Decimal('-10'))])
+            spent = node.getspentinfo({"txid": txid, "index": vout})
+            assert_equal(spent, {"txid": spendtxid, "index": 0, "height": height + 1})
+        check_spent()
+
+        print "Disconnect the spending block"
+        node.invalidateblock(spendblock)
+        check_credited()
+        assert_equal(node.getaddressbalance({"addresses": [addr2]}),
+                     {"balance": Decimal('0'), "received": Decimal('0')})
+        assert_equal(node.getaddressutxos({"addresses": [addr2]}), [])
+        assert_equal(node.getaddressdeltas({"addresses": [addr]}),
+                     [{"address": addr, "txid": txid, "index": vout, "blockindex": 1,
+                       "height": height, "amount": Decimal('10')}])
+        assert_raises(JSONRPCException, node.getspentinfo, {"txid": txid, "index": vout})
+
+        print "Disconnect the crediting block"
+        node.invalidateblock(creditblock)
+        assert_equal(node.getaddressbalance({"addresses": [addr]}),
+                     {"balance": Decimal('0'), "received": Decimal('0')})
+        assert_equal(node.getaddressutxos({"addresses": [addr]}), [])
+        assert_equal(node.getaddressdeltas({"addresses": [addr]}), [])
+        assert_raises(JSONRPCException, node.getspentinfo,
+                      {"txid": prevout['txid'], "index": prevout['vout']})
+
+        print "Reconnect both blocks"
+        node.reconsiderblock(creditblock)
+        assert_equal(node.getbestblockhash(), spendblock)
+        check_spent()
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
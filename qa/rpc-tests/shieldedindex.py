@@ -0,0 +1,130 @@
+#!/usr/bin/env python2
+# Copyright (c) 2017 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the shielded index follows blocks with JoinSplits as they are
+# connected and disconnected.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, assert_raises, \
+    initialize_chain_clean, start_nodes
+
+import time
+from decimal import Decimal
+
+class ShieldedIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(1, self.options.tmpdir, extra_args=[['-shieldedindex']])
+        self.is_network_split = False
+
+    # Returns txid if operation was a success or None
+    def wait_and_assert_operationid_status(self, myopid, in_status='success', in_errormsg=None):
+        print('waiting for async operation {}'.format(myopid))
+        opids = []
+        opids.append(myopid)
+        timeout = 300
+        status = None
+        errormsg = None
+        txid = None
+        for x in xrange(1, timeout):
+            results = self.nodes[0].z_getoperationresult(opids)
+            if len(results)==0:
+                time.sleep(1)
+            else:
+                status = results[0]["status"]
+                if status == "failed":
+                    errormsg = results[0]['error']['message']
+                elif status == "success":
+                    txid = results[0]['result']['txid']
+                break
+        print('...returned status: {}'.format(status))
+        assert_equal(in_status, status)
+        if errormsg is not None:
+            assert(in_errormsg is not None)
+            assert_equal(in_errormsg in errormsg, True)
+            print('...returned error: {}'.format(errormsg))
+        return txid
+
+    # Mine a block with the result of a z_sendmany, and return the
+    # transaction's JoinSplits and the block's hash
+    def send_and_mine(self, fromaddr, toaddr, amount):
+        node = self.nodes[0]
+        recipients = [{"address": toaddr, "amount": amount}]
+        txid = self.wait_and_assert_operationid_status(node.z_sendmany(fromaddr, recipients))
+        blockhash = node.generate(1)[0]
+        tx = node.decoderawtransaction(node.gettransaction(txid)['hex'])
+        assert_equal(len(tx['vjoinsplit']), 1)
+        return txid, tx['vjoinsplit'], blockhash
+
+    def check_indexed(self, txid, joinsplits, blockhash, firstposition):
+        node = self.nodes[0]
+        block = node.getblock(blockhash)
+        # The anchor is the root of the tree before the block's commitments
+        anchor = node.getblock(block['previousblockhash'])['anchor']
+        position = firstposition
+        for js, joinsplit in enumerate(joinsplits):
+            for n, nf in enumerate(joinsplit['nullifiers']):
+                assert_equal(node.getnullifierinfo(nf), {
+                    "txid": txid, "jsindex": js, "index": n,
+                    "height": block['height'], "blockhash": blockhash})
+            for n, cm in enumerate(joinsplit['commitments']):
+                assert_equal(node.getcommitmentinfo(cm), {
+                    "txid": txid, "jsindex": js, "index": n,
+                    "height": block['height'], "position": position,
+                    "blockhash": blockhash, "anchor": anchor})
+                position += 1
+
+    def check_not_indexed(self, joinsplits):
+        node = self.nodes[0]
+        for joinsplit in joinsplits:
+            for nf in joinsplit['nullifiers']:
+                assert_raises(JSONRPCException, node.getnullifierinfo, nf)
+            for cm in joinsplit['commitments']:
+                assert_raises(JSONRPCException, node.getcommitmentinfo, cm)
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+
+        mytaddr = node.getnewaddress()
+        myzaddr = node.z_getnewaddress()
+        myzaddr2 = node.z_getnewaddress()
+
+        print "Connect a block shielding coinbase funds"
+        assert_equal(node.getblockchaininfo()['commitments'], 0)
+        txid1, joinsplits1, block1 = self.send_and_mine(mytaddr, myzaddr, Decimal('10.0') - Decimal('0.0001'))
+        self.check_indexed(txid1, joinsplits1, block1, 0)
+
+        print "Connect a block spending the note"
+        # Positions continue from the commitments of the earlier block
+        ncommitments = node.getblockchaininfo()['commitments']
+        assert_equal(ncommitments, len(joinsplits1[0]['commitments']))
+        txid2, joinsplits2, block2 = self.send_and_mine(myzaddr, myzaddr2, Decimal('5.0'))
+        self.check_indexed(txid2, joinsplits2, block2, ncommitments)
+
+        print "Disconnect the spending block"
+        node.invalidateblock(block2)
+        self.check_not_indexed(joinsplits2)
+        self.check_indexed(txid1, joinsplits1, block1, 0)
+
+        print "Disconnect the shielding block"
+        node.invalidateblock(block1)
+        self.check_not_indexed(joinsplits1)
+
+        print "Reconnect both blocks"
+        node.reconsiderblock(block1)
+        assert_equal(node.getbestblockhash(), block2)
+        self.check_indexed(txid1, joinsplits1, block1, 0)
+        self.check_indexed(txid2, joinsplits2, block2, ncommitments)
+
+if __name__ == '__main__':
+    ShieldedIndexTest().main()
@@ -187,6 +187,9 @@ case "$1" in
             verifyequihash)
                 zcash_rpc zcbenchmark verifyequihash 1000
                 ;;
+            verifyequihashreference)
+                zcash_rpc zcbenchmark verifyequihashreference 1000
+                ;;
             validatelargetx)
                 zcash_rpc zcbenchmark validatelargetx 5
                 ;;
@@ -206,9 +209,27 @@ case "$1" in
             loadwallet)
                 zcash_rpc zcbenchmark loadwallet 10 
                 ;;
+            flushwallet)
+                zcash_rpc zcbenchmark flushwallet 10 "${@:3}"
+                ;;
             listunspent)
                 zcash_rpc zcbenchmark listunspent 10
                 ;;
+            sha256)
+                zcash_rpc zcbenchmark sha256 10 "${@:3}"
+                ;;
+            sha256d64)
+                zcash_rpc zcbenchmark sha256d64 10 "${@:3}"
+                ;;
+            merkleappend)
+                zcash_rpc zcbenchmark merkleappend 10 "${@:3}"
+                ;;
+            merkleroot)
+                zcash_rpc zcbenchmark merkleroot 10 "${@:3}"
+                ;;
+            witnessupdate)
+                zcash_rpc zcbenchmark witnessupdate 10 "${@:3}"
+                ;;
             *)
                 zcashd_stop
                 echo "Bad arguments to time."
@@ -237,6 +258,9 @@ case "$1" in
             verifyequihash)
                 zcash_rpc zcbenchmark verifyequihash 1
                 ;;
+            verifyequihashreference)
+                zcash_rpc zcbenchmark verifyequihashreference 1
+                ;;
             validatelargetx)
                 zcash_rpc zcbenchmark validatelargetx 1
                 ;;
@@ -256,9 +280,27 @@ case "$1" in
             loadwallet)
                 # The initial load is sufficient for measurement
                 ;;
+            flushwallet)
+                zcash_rpc zcbenchmark flushwallet 1 "${@:3}"
+                ;;
             listunspent)
                 zcash_rpc zcbenchmark listunspent 1
                 ;;
+            sha256)
+                zcash_rpc zcbenchmark sha256 1 "${@:3}"
+                ;;
+            sha256d64)
+                zcash_rpc zcbenchmark sha256d64 1 "${@:3}"
+                ;;
+            merkleappend)
+                zcash_rpc zcbenchmark merkleappend 1 "${@:3}"
+                ;;
+            merkleroot)
+                zcash_rpc zcbenchmark merkleroot 1 "${@:3}"
+                ;;
+            witnessupdate)
+                zcash_rpc zcbenchmark witnessupdate 1 "${@:3}"
+                ;;
             *)
                 zcashd_massif_stop
                 echo "Bad arguments to memory."
@@ -288,6 +330,9 @@ case "$1" in
             verifyequihash)
                 zcash_rpc zcbenchmark verifyequihash 1
                 ;;
+            verifyequihashreference)
+                zcash_rpc zcbenchmark verifyequihashreference 1
+                ;;
             trydecryptnotes)
                 zcash_rpc zcbenchmark trydecryptnotes 1 "${@:3}"
                 ;;
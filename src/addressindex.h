@@ -0,0 +1,191 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string.h>
+
+/** The kinds of transparent address kept in the address index (-addressindex) */
+enum AddressIndexType
+{
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_P2PKH = 1,
+    ADDRESS_INDEX_P2SH = 2,
+};
+
+/** The address a scriptPubKey pays to, if it is a P2PKH or P2SH script. */
+inline AddressIndexType GetAddressIndexType(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        memcpy(hashBytes.begin(), &script[2], 20);
+        return ADDRESS_INDEX_P2SH;
+    }
+    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        memcpy(hashBytes.begin(), &script[3], 20);
+        return ADDRESS_INDEX_P2PKH;
+    }
+    return ADDRESS_INDEX_NONE;
+}
+
+/**
+ * An output paid to an address, or a spend of one, in the address index.
+ * Heights and transaction positions are stored big-endian, so that the
+ * records of an address are ordered as in the chain.
+ */
+struct CAddressIndexKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() : type(ADDRESS_INDEX_NONE), blockHeight(0), txindex(0), index(0), spending(false) {}
+    CAddressIndexKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn,
+                     const uint256& txhashIn, unsigned int indexIn, bool spendingIn) :
+        type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn), txindex(txindexIn),
+        txhash(txhashIn), index(indexIn), spending(spendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 66;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+        spending = ser_readdata8(s);
+    }
+};
+
+/** The prefix of the address index keys of an address, to seek to its records. */
+struct CAddressIndexIteratorKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn) : type(typeIn), hashBytes(hashBytesIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 21;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+};
+
+/** The prefix of the address index keys of an address from a height on. */
+struct CAddressIndexIteratorHeightKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+
+    CAddressIndexIteratorHeightKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn) :
+        type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 25;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+    }
+};
+
+/** An unspent output paid to an address, in the address unspent index. */
+struct CAddressUnspentKey
+{
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() : type(ADDRESS_INDEX_NONE), index(0) {}
+    CAddressUnspentKey(unsigned int typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 57;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+};
+
+/** The value and script of an unspent output, and the height it was created at. Null values are erased. */
+struct CAddressUnspentValue
+{
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    CAddressUnspentValue() { SetNull(); }
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) :
+        satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    void SetNull() {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return satoshis == -1;
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
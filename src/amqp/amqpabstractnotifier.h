@@ -6,6 +6,7 @@
 #define ZCASH_AMQP_AMQPABSTRACTNOTIFIER_H
 
 #include "amqpconfig.h"
+#include "validationinterface.h"
 
 class CBlockIndex;
 class AMQPAbstractNotifier;
@@ -15,7 +16,9 @@ typedef AMQPAbstractNotifier* (*AMQPNotifierFactory)();
 class AMQPAbstractNotifier
 {
 public:
-    AMQPAbstractNotifier() { }
+    static const int DEFAULT_AMQP_SNDHWM = 1000;
+
+    AMQPAbstractNotifier() : outbound_message_high_water_mark(DEFAULT_AMQP_SNDHWM) { }
     virtual ~AMQPAbstractNotifier();
 
     template <typename T>
@@ -28,16 +31,24 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    /** Number of messages queued for a slow subscriber before further ones are dropped. */
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(const int sndhwm) {
+        if (sndhwm >= 0) {
+            outbound_message_high_water_mark = sndhwm;
+        }
+    }
 
     virtual bool Initialize() = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CSerializedBlockRef &block);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
 protected:
     std::string type;
     std::string address;
+    int outbound_message_high_water_mark; // aka SNDHWM
 };
 
 #endif // ZCASH_AMQP_AMQPABSTRACTNOTIFIER_H
@@ -50,6 +50,13 @@ AMQPNotificationInterface* AMQPNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = AMQPAbstractNotifier::Create<AMQPPublishRawBlockNotifier>;
     factories["pubrawtx"] = AMQPAbstractNotifier::Create<AMQPPublishRawTransactionNotifier>;
 
+    // A single high water mark applies to every notifier, as they may share a connection.
+    int outbound_message_high_water_mark = AMQPAbstractNotifier::DEFAULT_AMQP_SNDHWM;
+    std::map<std::string, std::string>::const_iterator hwm = args.find("-amqppubhwm");
+    if (hwm != args.end()) {
+        outbound_message_high_water_mark = atoi(hwm->second);
+    }
+
     for (std::map<std::string, AMQPNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i) {
         std::map<std::string, std::string>::const_iterator j = args.find("-amqp" + i->first);
         if (j!=args.end()) {
@@ -58,6 +65,7 @@ AMQPNotificationInterface* AMQPNotificationInterface::CreateWithArguments(const
             AMQPAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetOutboundMessageHighWaterMark(outbound_message_high_water_mark);
             notifiers.push_back(notifier);
         }
     }
@@ -109,11 +117,11 @@ void AMQPNotificationInterface::Shutdown()
     }
 }
 
-void AMQPNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void AMQPNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex, const CSerializedBlockRef &block)
 {
     for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ) {
         AMQPAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex)) {
+        if (notifier->NotifyBlock(pindex, block)) {
             i++;
         } else {
             notifier->Shutdown();
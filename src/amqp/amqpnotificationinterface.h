@@ -25,7 +25,9 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void UpdatedBlockTip(const CBlockIndex *pindex, const CSerializedBlockRef &block);
+    // Publishing doesn't need to hold up validation.
+    bool NotifyAsynchronously() const { return true; }
 
 private:
     AMQPNotificationInterface();
@@ -45,7 +45,7 @@ bool AMQPAbstractPublishNotifier::Initialize()
 
     if (i == mapPublishNotifiers.end()) {
         try {
-            handler_ = std::make_shared<AMQPSender>(address);
+            handler_ = std::make_shared<AMQPSender>(address, outbound_message_high_water_mark);
             thread_ = std::make_shared<std::thread>(&AMQPAbstractPublishNotifier::SpawnProtonContainer, this);
         }
         catch (std::exception &e) {
@@ -104,7 +104,10 @@ bool AMQPAbstractPublishNotifier::SendMessage(const char *command, const void* d
         message.subject(std::string(command));
         proton::message::property_map & props = message.properties();
         props.put("x-opt-sequence-number", sequence_);
-        handler_->publish(message);
+        if (!handler_->publish(message)) {
+            // Receivers see the gap in the sequence numbers.
+            LogPrint("amqp", "amqp: Dropped %s message, outbound queue is full\n", command);
+        }
 
     } catch (proton::error_condition &e) {
         LogPrint("amqp", "amqp: error : %s\n", e.what());
@@ -128,7 +131,7 @@ bool AMQPAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CSerializedBlockRef &block)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("amqp", "amqp: Publish hashblock %s\n", hash.GetHex());
@@ -148,23 +151,16 @@ bool AMQPPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool AMQPPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CSerializedBlockRef &block)
 {
     LogPrint("amqp", "amqp: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("amqp", "amqp: Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+    if (!block) {
+        LogPrint("amqp", "amqp: Block wasn't available to publish\n");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, block->data(), block->size());
 }
 
 bool AMQPPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
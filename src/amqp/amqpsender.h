@@ -15,6 +15,7 @@
 class AMQPSender : public proton::messaging_handler {
   private:
     std::deque<proton::message> messages_; 
+    size_t high_water_mark_;                    // most messages to queue while the remote end has no credit
     proton::url url_;
     proton::connection conn_;
     proton::sender sender_;
@@ -23,7 +24,7 @@ class AMQPSender : public proton::messaging_handler {
 
   public:
 
-    AMQPSender(const std::string& url) : url_(url) {}
+    AMQPSender(const std::string& url, size_t high_water_mark) : high_water_mark_(high_water_mark), url_(url) {}
 
     // Callback to initialize the container when run() is invoked
     void on_container_start(proton::container& c) override {
@@ -38,16 +39,22 @@ class AMQPSender : public proton::messaging_handler {
         dispatch();
     }
 
-    // Publish message by adding to queue and trying to dispatch it
-    void publish(const proton::message &m) {
-        add_message(m);
+    // Publish message by adding to queue and trying to dispatch it.
+    // Returns false if the message was dropped because the queue is full.
+    bool publish(const proton::message &m) {
+        bool queued = add_message(m);
         dispatch();
+        return queued;
     }
 
-    // Add message to queue
-    void add_message(const proton::message &m) {
+    // Add message to queue, unless it is already at the high water mark
+    bool add_message(const proton::message &m) {
         std::lock_guard<std::mutex> guard(lock_);
+        if (messages_.size() >= high_water_mark_) {
+            return false;
+        }
         messages_.push_back(m);
+        return true;
     }
 
     // Send messages in queue
@@ -24,20 +24,30 @@ std::map<OperationStatus, std::string> OperationStatusMap = {
     {OperationStatus::SUCCESS, "success"}
 };
 
+std::map<OperationPriority, std::string> OperationPriorityMap = {
+    {OperationPriority::LOW, "low"},
+    {OperationPriority::NORMAL, "normal"},
+    {OperationPriority::HIGH, "high"}
+};
+
 /**
  * Every operation instance should have a globally unique id
  */
-AsyncRPCOperation::AsyncRPCOperation() : error_code_(0), error_message_() {
+AsyncRPCOperation::AsyncRPCOperation() : error_code_(0), error_message_(),
+        priority_(OperationPriority::NORMAL), cancel_requested_(false), proving_time_(0) {
     // Set a unique reference for each operation
     boost::uuids::uuid uuid = uuidgen();
     id_ = "opid-" + boost::uuids::to_string(uuid);
     creation_time_ = (int64_t)time(NULL);
+    queued_time_ = std::chrono::system_clock::now();
     set_state(OperationStatus::READY);
 }
 
 AsyncRPCOperation::AsyncRPCOperation(const AsyncRPCOperation& o) :
         id_(o.id_), creation_time_(o.creation_time_), state_(o.state_.load()),
-        start_time_(o.start_time_), end_time_(o.end_time_),
+        priority_(o.priority_.load()), cancel_requested_(o.cancel_requested_.load()),
+        queued_time_(o.queued_time_), start_time_(o.start_time_), end_time_(o.end_time_),
+        proving_time_(o.proving_time_),
         error_code_(o.error_code_), error_message_(o.error_message_),
         result_(o.result_)
 {
@@ -47,8 +57,12 @@ AsyncRPCOperation& AsyncRPCOperation::operator=( const AsyncRPCOperation& other
     this->id_ = other.id_;
     this->creation_time_ = other.creation_time_;
     this->state_.store(other.state_.load());
+    this->priority_.store(other.priority_.load());
+    this->cancel_requested_.store(other.cancel_requested_.load());
+    this->queued_time_ = other.queued_time_;
     this->start_time_ = other.start_time_;
     this->end_time_ = other.end_time_;
+    this->proving_time_ = other.proving_time_;
     this->error_code_ = other.error_code_;
     this->error_message_ = other.error_message_;
     this->result_ = other.result_;
@@ -60,14 +74,24 @@ AsyncRPCOperation::~AsyncRPCOperation() {
 }
 
 /**
- * Override this cancel() method if you can interrupt main() when executing.
+ * Cancel an operation which has not started yet.  An executing operation is
+ * only asked to stop; it is up to main() to poll isCancelRequested().
  */
 void AsyncRPCOperation::cancel() {
+    cancel_requested_.store(true);
     if (isReady()) {
         set_state(OperationStatus::CANCELLED);
     }
 }
 
+/**
+ * Record when the operation entered the queue, to report time spent waiting.
+ */
+void AsyncRPCOperation::mark_queued() {
+    std::lock_guard<std::mutex> guard(lock_);
+    queued_time_ = std::chrono::system_clock::now();
+}
+
 /**
  * Start timing the execution run of the code you're interested in
  */
@@ -84,6 +108,14 @@ void AsyncRPCOperation::stop_execution_clock() {
     end_time_ = std::chrono::system_clock::now();
 }
 
+/**
+ * Add to the time spent generating proofs
+ */
+void AsyncRPCOperation::add_proving_time(std::chrono::duration<double> elapsed) {
+    std::lock_guard<std::mutex> guard(lock_);
+    proving_time_ += elapsed;
+}
+
 /**
  * Implement this virtual method in any subclass.  This is just an example implementation.
  */
@@ -155,6 +187,18 @@ UniValue AsyncRPCOperation::getStatus() const {
     obj.push_back(Pair("id", this->id_));
     obj.push_back(Pair("status", OperationStatusMap[status]));
     obj.push_back(Pair("creation_time", this->creation_time_));
+    obj.push_back(Pair("priority", OperationPriorityMap[this->getPriority()]));
+    if (status != OperationStatus::READY) {
+        std::lock_guard<std::mutex> guard(lock_);
+        // Operations cancelled while queued never started executing
+        if (start_time_ >= queued_time_) {
+            std::chrono::duration<double> queued_seconds = start_time_ - queued_time_;
+            obj.push_back(Pair("queued_secs", queued_seconds.count()));
+        }
+        if (proving_time_.count() > 0) {
+            obj.push_back(Pair("proving_secs", proving_time_.count()));
+        }
+    }
     // TODO: Issue #1354: There may be other useful metadata to return to the user.
     UniValue err = this->getError();
     if (!err.isNull()) {
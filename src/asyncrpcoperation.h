@@ -37,6 +37,16 @@ typedef enum class operationStateEnum {
     SUCCESS
 } OperationStatus;
 
+// Operations of a higher priority are taken off the queue, and handed a
+// proving slot, before any waiting operation of a lower priority.
+typedef enum class operationPriorityEnum {
+    LOW = 0,
+    NORMAL,
+    HIGH
+} OperationPriority;
+
+#define ASYNC_RPC_OPERATION_NUM_PRIORITIES 3
+
 class AsyncRPCOperation {
 public:
     AsyncRPCOperation();
@@ -45,7 +55,9 @@ public:
     // You must implement this method in your subclass.
     virtual void main();
 
-    // Override this method if you can interrupt execution of main() in your subclass.
+    // Cancels the operation if it has not started yet.  If it is executing,
+    // a cancellation request is recorded instead; subclasses should poll
+    // isCancelRequested() at safe points (e.g. between JoinSplits) and stop.
     void cancel();
     
     // Getters and setters
@@ -62,6 +74,18 @@ public:
         return creation_time_;
     }
 
+    OperationPriority getPriority() const {
+        return priority_.load();
+    }
+
+    // Only meaningful before the operation is added to a queue.
+    void setPriority(OperationPriority priority) {
+        priority_.store(priority);
+    }
+
+    // Called by the queue when the operation is enqueued.
+    void mark_queued();
+
     // Override this method to add data to the default status object.
     virtual UniValue getStatus() const;
 
@@ -85,6 +109,10 @@ public:
         return OperationStatus::CANCELLED == getState();
     }
 
+    bool isCancelRequested() const {
+        return cancel_requested_.load() || isCancelled();
+    }
+
     bool isExecuting() const {
         return OperationStatus::EXECUTING == getState();
     }
@@ -114,11 +142,17 @@ protected:
     int error_code_;
     std::string error_message_;
     std::atomic<OperationStatus> state_;
-    std::chrono::time_point<std::chrono::system_clock> start_time_, end_time_;  
+    std::atomic<OperationPriority> priority_;
+    std::atomic<bool> cancel_requested_;
+    std::chrono::time_point<std::chrono::system_clock> queued_time_, start_time_, end_time_;
+    std::chrono::duration<double> proving_time_;
 
     void start_execution_clock();
     void stop_execution_clock();
 
+    // Accumulate time spent generating proofs, reported in getStatus().
+    void add_proving_time(std::chrono::duration<double> elapsed);
+
     void set_state(OperationStatus state) {
         this->state_.store(state);
     }
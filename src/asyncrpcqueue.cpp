@@ -4,6 +4,8 @@
 
 #include "asyncrpcqueue.h"
 
+#include <cassert>
+
 static std::atomic<size_t> workerCounter(0);
 
 /**
@@ -15,7 +17,11 @@ shared_ptr<AsyncRPCQueue> AsyncRPCQueue::sharedInstance() {
     return q;
 }
 
-AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false) {
+AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false), next_sequence_(0),
+        max_proving_(0), active_proving_(0) {
+    for (size_t i = 0; i < ASYNC_RPC_OPERATION_NUM_PRIORITIES; i++) {
+        waiting_proving_[i] = 0;
+    }
 }
 
 AsyncRPCQueue::~AsyncRPCQueue() {
@@ -49,8 +55,8 @@ void AsyncRPCQueue::run(size_t workerId) {
                 break;
             }
 
-            // Get operation id
-            key = operation_id_queue_.front();
+            // Get operation id of the highest priority, oldest operation
+            key = operation_id_queue_.top().id;
             operation_id_queue_.pop();
 
             // Search operation map
@@ -90,8 +96,9 @@ void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOp
     }
 
     AsyncRPCOperationId id = ptrOperation->getId();
+    ptrOperation->mark_queued();
     operation_map_.emplace(id, ptrOperation);
-    operation_id_queue_.push(id);
+    operation_id_queue_.push(AsyncRPCQueueEntry{ptrOperation->getPriority(), next_sequence_++, id});
     this->condition_.notify_one();
 }
 
@@ -199,6 +206,57 @@ std::vector<AsyncRPCOperationId> AsyncRPCQueue::getAllOperationIds() const {
     return v;
 }
 
+/**
+ * Set the maximum number of operations which may generate proofs at the same time.
+ */
+void AsyncRPCQueue::setMaxProvingOperations(size_t n) {
+    std::lock_guard<std::mutex> guard(proving_lock_);
+    max_proving_ = n;
+    proving_condition_.notify_all();
+}
+
+size_t AsyncRPCQueue::getMaxProvingOperations() const {
+    std::lock_guard<std::mutex> guard(proving_lock_);
+    return max_proving_;
+}
+
+size_t AsyncRPCQueue::getActiveProvingOperations() const {
+    std::lock_guard<std::mutex> guard(proving_lock_);
+    return active_proving_;
+}
+
+/**
+ * Block until a proving slot is available.  A waiting operation of a higher
+ * priority is always handed the next free slot first.
+ */
+void AsyncRPCQueue::acquireProvingSlot(OperationPriority priority) {
+    size_t p = static_cast<size_t>(priority);
+    assert(p < ASYNC_RPC_OPERATION_NUM_PRIORITIES);
+
+    std::unique_lock<std::mutex> guard(proving_lock_);
+    waiting_proving_[p]++;
+    proving_condition_.wait(guard, [this, p]() {
+        if (max_proving_ > 0 && active_proving_ >= max_proving_) {
+            return false;
+        }
+        for (size_t i = p + 1; i < ASYNC_RPC_OPERATION_NUM_PRIORITIES; i++) {
+            if (waiting_proving_[i] > 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+    waiting_proving_[p]--;
+    active_proving_++;
+}
+
+void AsyncRPCQueue::releaseProvingSlot() {
+    std::lock_guard<std::mutex> guard(proving_lock_);
+    assert(active_proving_ > 0);
+    active_proving_--;
+    proving_condition_.notify_all();
+}
+
 /**
  * Calling thread will close and wait for worker threads to join.
  */
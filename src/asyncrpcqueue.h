@@ -19,8 +19,28 @@
 #include <memory>
 
 
+// Approximate resident memory of the loaded proving key, and of each proof
+// being generated on top of it, used to derive the default proving limit.
+static const uint64_t ASYNC_RPC_PROVING_KEY_MEMORY = 1024ULL * 1024 * 1024;
+static const uint64_t ASYNC_RPC_PROVING_MEMORY = 1536ULL * 1024 * 1024;
+
 typedef std::unordered_map<AsyncRPCOperationId, std::shared_ptr<AsyncRPCOperation> > AsyncRPCOperationMap; 
 
+// Entry in the queue of pending operations.  Higher priorities are served
+// first, operations of equal priority in the order they were added.
+struct AsyncRPCQueueEntry {
+    OperationPriority priority;
+    uint64_t sequence;
+    AsyncRPCOperationId id;
+
+    bool operator<(const AsyncRPCQueueEntry& other) const {
+        if (priority != other.priority) {
+            return priority < other.priority;
+        }
+        return sequence > other.sequence;
+    }
+};
+
 
 class AsyncRPCQueue {
 public:
@@ -50,6 +70,14 @@ public:
     void addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation);
     std::vector<AsyncRPCOperationId> getAllOperationIds() const;
 
+    // Proving slots bound how many operations generate JoinSplit proofs at
+    // once, independently of the number of workers.  Zero means no limit.
+    void setMaxProvingOperations(size_t n);
+    size_t getMaxProvingOperations() const;
+    size_t getActiveProvingOperations() const;
+    void acquireProvingSlot(OperationPriority priority); // blocks until a slot is free
+    void releaseProvingSlot();
+
 private:
     // addWorker() will spawn a new thread on run())
     void run(size_t workerId);
@@ -61,8 +89,34 @@ private:
     std::atomic<bool> closed_;
     std::atomic<bool> finish_;
     AsyncRPCOperationMap operation_map_;
-    std::queue <AsyncRPCOperationId> operation_id_queue_;
+    std::priority_queue <AsyncRPCQueueEntry> operation_id_queue_;
+    uint64_t next_sequence_;
     std::vector<std::thread> workers_;
+
+    mutable std::mutex proving_lock_;
+    std::condition_variable proving_condition_;
+    size_t max_proving_;
+    size_t active_proving_;
+    size_t waiting_proving_[ASYNC_RPC_OPERATION_NUM_PRIORITIES];
+};
+
+/**
+ * RAII holder of a proving slot on the shared queue.
+ */
+class AsyncRPCProvingSlot {
+public:
+    AsyncRPCProvingSlot(OperationPriority priority) : queue_(AsyncRPCQueue::sharedInstance()) {
+        queue_->acquireProvingSlot(priority);
+    }
+    ~AsyncRPCProvingSlot() {
+        queue_->releaseProvingSlot();
+    }
+
+private:
+    std::shared_ptr<AsyncRPCQueue> queue_;
+
+    AsyncRPCProvingSlot(const AsyncRPCProvingSlot&) = delete;
+    AsyncRPCProvingSlot& operator=(const AsyncRPCProvingSlot&) = delete;
 };
 
 #endif
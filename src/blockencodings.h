@@ -0,0 +1,208 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+class CTxMemPool;
+
+/** Version of the compact block encoding, as sent in "sendcmpct" */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+
+/** A "getblocktxn" request for the transactions of a block that a compact block didn't resolve */
+class BlockTransactionsRequest {
+public:
+    uint256 blockhash;
+    //! Ascending transaction positions in the block; differentially encoded on the wire
+    std::vector<uint16_t> indexes;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        unsigned int nSize = 32 + GetSizeOfCompactSize(indexes.size());
+        for (size_t i = 0; i < indexes.size(); i++)
+            nSize += GetSizeOfCompactSize(indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1)));
+        return nSize;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        blockhash.Serialize(s, nType, nVersion);
+        WriteCompactSize(s, indexes.size());
+        for (size_t i = 0; i < indexes.size(); i++)
+            WriteCompactSize(s, indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1)));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        blockhash.Unserialize(s, nType, nVersion);
+        uint64_t nCount = ReadCompactSize(s);
+        indexes.clear();
+        uint64_t nOffset = 0;
+        while (indexes.size() < nCount) {
+            // Grow in steps, so that a bogus count can't make us allocate much
+            size_t nStart = indexes.size();
+            indexes.resize(std::min(nCount, (uint64_t)nStart + 1000));
+            for (size_t i = nStart; i < indexes.size(); i++) {
+                uint64_t nIndex = ReadCompactSize(s) + nOffset;
+                if (nIndex > std::numeric_limits<uint16_t>::max())
+                    throw std::ios_base::failure("getblocktxn index overflowed 16 bits");
+                indexes[i] = nIndex;
+                nOffset = nIndex + 1;
+            }
+        }
+    }
+};
+
+/** A "blocktxn" response, with the transactions asked for in a getblocktxn request */
+class BlockTransactions {
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    BlockTransactions(const BlockTransactionsRequest& req) :
+        blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent in full in a compact block, usually the coinbase */
+struct PrefilledTransaction {
+    //! Position in the block, relative to the previous prefilled transaction
+    //! (the number of transactions skipped since it)
+    uint16_t index;
+    CTransaction tx;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return GetSizeOfCompactSize(index) + ::GetSerializeSize(tx, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        WriteCompactSize(s, index);
+        ::Serialize(s, tx, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        uint64_t nIndex = ReadCompactSize(s);
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("prefilled transaction index overflowed 16 bits");
+        index = nIndex;
+        ::Unserialize(s, tx, nType, nVersion);
+    }
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //! Invalid object, peer is sending bogus crap
+    READ_STATUS_FAILED, //! Failed to process object, e.g. a short ID collision
+} ReadStatus;
+
+/**
+ * A "cmpctblock" message: a block header with the transactions replaced by
+ * 6-byte short IDs, which the receiver resolves against its mempool. The IDs
+ * are SipHash-2-4 of the txids, keyed by the header and a per-message nonce
+ * so that collisions can't be precomputed.
+ */
+class CBlockHeaderAndShortTxIDs {
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() : shorttxidk0(0), shorttxidk1(0), nonce(0) {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return ::GetSerializeSize(header, nType, nVersion) + 8 +
+               GetSizeOfCompactSize(shorttxids.size()) + SHORTTXIDS_LENGTH * shorttxids.size() +
+               ::GetSerializeSize(prefilledtxn, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ::Serialize(s, header, nType, nVersion);
+        ser_writedata64(s, nonce);
+        WriteCompactSize(s, shorttxids.size());
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            ser_writedata32(s, (uint32_t)(shorttxids[i] & 0xffffffff));
+            ser_writedata16(s, (uint16_t)((shorttxids[i] >> 32) & 0xffff));
+        }
+        ::Serialize(s, prefilledtxn, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        ::Unserialize(s, header, nType, nVersion);
+        nonce = ser_readdata64(s);
+        uint64_t nCount = ReadCompactSize(s);
+        shorttxids.clear();
+        while (shorttxids.size() < nCount) {
+            size_t nStart = shorttxids.size();
+            shorttxids.resize(std::min(nCount, (uint64_t)nStart + 1000));
+            for (size_t i = nStart; i < shorttxids.size(); i++) {
+                uint32_t lsb = ser_readdata32(s);
+                uint16_t msb = ser_readdata16(s);
+                shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+            }
+        }
+        ::Unserialize(s, prefilledtxn, nType, nVersion);
+        FillShortTxIDSelector();
+    }
+};
+
+/** A block being rebuilt from a compact block, the mempool and a blocktxn response */
+class PartiallyDownloadedBlock {
+protected:
+    std::vector<std::shared_ptr<const CTransaction> > txn_available;
+    size_t prefilled_count;
+    size_t mempool_count;
+    CTxMemPool* pool;
+public:
+    CBlockHeader header;
+
+    PartiallyDownloadedBlock(CTxMemPool* poolIn) : prefilled_count(0), mempool_count(0), pool(poolIn) {}
+
+    //! Take the prefilled transactions, and whatever the mempool has of the rest
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    bool IsTxAvailable(size_t index) const;
+    //! Assemble the block from the available and the missing transactions, checking it against
+    //! the header's merkle root. This can only be called once.
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing);
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
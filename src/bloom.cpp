@@ -6,6 +6,7 @@
 
 #include "primitives/transaction.h"
 #include "hash.h"
+#include "memusage.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "random.h"
@@ -226,7 +227,11 @@ CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double fpRate)
     nInsertions = 0;
     nBloomSize = nElements * 2;
 
-    reset();
+    // The filters were just allocated empty; only pick a random tweak, as
+    // reset() would also clear them again
+    unsigned int nNewTweak = GetRand(std::numeric_limits<unsigned int>::max());
+    b1.nTweak = nNewTweak;
+    b2.nTweak = nNewTweak;
 }
 
 void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
@@ -270,3 +275,54 @@ void CRollingBloomFilter::reset()
     b2.reset(nNewTweak);
     nInsertions = 0;
 }
+
+//! Bits of filter per key, for a false-positive rate of about 0.2%
+static const unsigned int BLOCKED_BLOOM_BITS_PER_ELEMENT = 16;
+static const unsigned int BLOCKED_BLOOM_HASH_FUNCS = 8;
+//! 64-bit words per block, one cache line
+static const unsigned int BLOCKED_BLOOM_BLOCK_WORDS = 8;
+
+CBlockedBloomFilter::CBlockedBloomFilter(unsigned int nElementsIn)
+{
+    reset(nElementsIn);
+}
+
+void CBlockedBloomFilter::reset(unsigned int nElementsIn)
+{
+    nElements = std::max(nElementsIn, 1u);
+    nBlocks = (nElements * BLOCKED_BLOOM_BITS_PER_ELEMENT + 511) / 512;
+    vData.assign(nBlocks * BLOCKED_BLOOM_BLOCK_WORDS, 0);
+    nInsertions = 0;
+    salt = GetRandHash();
+}
+
+void CBlockedBloomFilter::insert(const uint256& hash)
+{
+    uint64_t h = hash.GetHash(salt);
+    uint64_t* block = &vData[((h >> 32) % nBlocks) * BLOCKED_BLOOM_BLOCK_WORDS];
+    // Double hashing within the block
+    uint32_t a = h & 0xffff, b = ((h >> 16) & 0xffff) | 1;
+    for (unsigned int i = 0; i < BLOCKED_BLOOM_HASH_FUNCS; i++) {
+        uint32_t nBit = (a + i * b) & 511;
+        block[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+    nInsertions++;
+}
+
+bool CBlockedBloomFilter::contains(const uint256& hash) const
+{
+    uint64_t h = hash.GetHash(salt);
+    const uint64_t* block = &vData[((h >> 32) % nBlocks) * BLOCKED_BLOOM_BLOCK_WORDS];
+    uint32_t a = h & 0xffff, b = ((h >> 16) & 0xffff) | 1;
+    for (unsigned int i = 0; i < BLOCKED_BLOOM_HASH_FUNCS; i++) {
+        uint32_t nBit = (a + i * b) & 511;
+        if (!(block[nBit >> 6] & ((uint64_t)1 << (nBit & 63))))
+            return false;
+    }
+    return true;
+}
+
+size_t CBlockedBloomFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vData);
+}
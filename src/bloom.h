@@ -6,12 +6,12 @@
 #define BITCOIN_BLOOM_H
 
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -134,5 +134,39 @@ private:
     CBloomFilter b1, b2;
 };
 
+/**
+ * BlockedBloomFilter is a bloom filter over uint256 keys which keeps all the
+ * bits of a key in one 512-bit block, so that a lookup touches a single cache
+ * line. It answers "definitely not inserted" or "maybe inserted", and is meant
+ * to spare database reads for keys that are absent.
+ *
+ * Keys cannot be removed. Once more keys were inserted than the filter was
+ * sized for its false-positive rate grows, and the owner should reset() it
+ * with a larger size and insert the keys again.
+ */
+class CBlockedBloomFilter
+{
+public:
+    // A random salt is chosen by reset(), so don't create global objects.
+    CBlockedBloomFilter(unsigned int nElements);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    //! Clear the filter and size it for nElements keys
+    void reset(unsigned int nElements);
+
+    //! Whether more keys were inserted than the filter was sized for
+    bool IsFull() const { return nInsertions > nElements; }
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    std::vector<uint64_t> vData;
+    unsigned int nBlocks;
+    unsigned int nElements;
+    unsigned int nInsertions;
+    uint256 salt;
+};
 
 #endif // BITCOIN_BLOOM_H
@@ -151,6 +151,10 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     uint256 nNonce;
+
+    //! Equihash solution. This is only held in memory until the entry has been
+    //! written to the block tree DB, after which it is empty; use
+    //! ReadBlockHeader() to get the full header.
     std::vector<unsigned char> nSolution;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
@@ -218,6 +222,8 @@ public:
         return ret;
     }
 
+    //! Header built from the fields held in memory. nSolution is empty once
+    //! this entry has been written to the block tree DB.
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
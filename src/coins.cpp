@@ -6,6 +6,7 @@
 
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 #include "version.h"
 #include "policy/fees.h"
 
@@ -42,17 +43,72 @@ bool CCoins::Spend(uint32_t nPos)
     Cleanup();
     return true;
 }
+/** Serialize an output with its metadata, as the element of the MuHash set. */
+static CDataStream UtxoCommitmentElement(const uint256 &txid, uint32_t n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << txid << n << nHeight << fCoinBase << out;
+    return ss;
+}
+
+void CUtxoCommitment::AddOutput(const uint256 &txid, uint32_t n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss = UtxoCommitmentElement(txid, n, out, nHeight, fCoinBase);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nTotalAmount += out.nValue;
+}
+
+void CUtxoCommitment::RemoveOutput(const uint256 &txid, uint32_t n, const CTxOut &out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss = UtxoCommitmentElement(txid, n, out, nHeight, fCoinBase);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nTotalAmount -= out.nValue;
+}
+
+void CUtxoCommitment::AddCoins(const uint256 &txid, const CCoins &coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, i, coins.vout[i], coins.nHeight, coins.fCoinBase);
+    }
+    nTransactions++;
+}
+
+void CUtxoCommitment::RemoveCoins(const uint256 &txid, const CCoins &coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, i, coins.vout[i], coins.nHeight, coins.fCoinBase);
+    }
+    nTransactions--;
+}
+
+uint256 CUtxoCommitment::GetHash() const
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
 bool CCoinsView::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const { return false; }
 bool CCoinsView::GetNullifier(const uint256 &nullifier) const { return false; }
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 uint256 CCoinsView::GetBestAnchor() const { return uint256(); };
+bool CCoinsView::GetUtxoCommitment(CUtxoCommitment &commitment) const { return false; }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
                             const uint256 &hashBlock,
                             const uint256 &hashAnchor,
                             CAnchorsMap &mapAnchors,
-                            CNullifiersMap &mapNullifiers) { return false; }
+                            CNullifiersMap &mapNullifiers,
+                            const CUtxoCommitment *pUtxoCommitment) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
 
 
@@ -64,17 +120,19 @@ bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 uint256 CCoinsViewBacked::GetBestAnchor() const { return base->GetBestAnchor(); }
+bool CCoinsViewBacked::GetUtxoCommitment(CUtxoCommitment &commitment) const { return base->GetUtxoCommitment(commitment); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
                                   const uint256 &hashBlock,
                                   const uint256 &hashAnchor,
                                   CAnchorsMap &mapAnchors,
-                                  CNullifiersMap &mapNullifiers) { return base->BatchWrite(mapCoins, hashBlock, hashAnchor, mapAnchors, mapNullifiers); }
+                                  CNullifiersMap &mapNullifiers,
+                                  const CUtxoCommitment *pUtxoCommitment) { return base->BatchWrite(mapCoins, hashBlock, hashAnchor, mapAnchors, mapNullifiers, pUtxoCommitment); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), fHaveUtxoCommitment(false), cachedCoinsUsage(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -135,11 +193,15 @@ bool CCoinsViewCache::GetNullifier(const uint256 &nullifier) const {
     if (it != cacheNullifiers.end())
         return it->second.entered;
 
-    CNullifiersCacheEntry entry;
     bool tmp = base->GetNullifier(nullifier);
-    entry.entered = tmp;
-
-    cacheNullifiers.insert(std::make_pair(nullifier, entry));
+    // Only cache spent nullifiers. Lookups of unspent ones are answered by
+    // the nullifier filter of the database without a read, and caching them
+    // would fill the cache with an entry for every nullifier ever checked.
+    if (tmp) {
+        CNullifiersCacheEntry entry;
+        entry.entered = tmp;
+        cacheNullifiers.insert(std::make_pair(nullifier, entry));
+    }
 
     return tmp;
 }
@@ -263,6 +325,24 @@ uint256 CCoinsViewCache::GetBestAnchor() const {
     return hashAnchor;
 }
 
+bool CCoinsViewCache::GetUtxoCommitment(CUtxoCommitment &commitment) const {
+    if (!fHaveUtxoCommitment) {
+        if (!base->GetUtxoCommitment(utxoCommitment))
+            return false;
+        fHaveUtxoCommitment = true;
+    }
+    commitment = utxoCommitment;
+    return true;
+}
+
+CUtxoCommitment &CCoinsViewCache::ModifyUtxoCommitment() {
+    // A base without a commitment has an empty UTXO set
+    if (!fHaveUtxoCommitment && !base->GetUtxoCommitment(utxoCommitment))
+        utxoCommitment = CUtxoCommitment();
+    fHaveUtxoCommitment = true;
+    return utxoCommitment;
+}
+
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
@@ -271,7 +351,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                                  const uint256 &hashBlockIn,
                                  const uint256 &hashAnchorIn,
                                  CAnchorsMap &mapAnchors,
-                                 CNullifiersMap &mapNullifiers) {
+                                 CNullifiersMap &mapNullifiers,
+                                 const CUtxoCommitment *pUtxoCommitment) {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
@@ -353,13 +434,18 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
         mapNullifiers.erase(itOld);
     }
 
+    if (pUtxoCommitment) {
+        utxoCommitment = *pUtxoCommitment;
+        fHaveUtxoCommitment = true;
+    }
     hashAnchor = hashAnchorIn;
     hashBlock = hashBlockIn;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock, hashAnchor, cacheAnchors, cacheNullifiers);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, hashAnchor, cacheAnchors, cacheNullifiers,
+                                fHaveUtxoCommitment ? &utxoCommitment : NULL);
     cacheCoins.clear();
     cacheAnchors.clear();
     cacheNullifiers.clear();
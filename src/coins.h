@@ -8,6 +8,7 @@
 
 #include "compressor.h"
 #include "core_memusage.h"
+#include "crypto/muhash.h"
 #include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -333,9 +334,49 @@ struct CCoinsStats
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashUtxoSet;
     CAmount nTotalAmount;
+    bool fUtxoCommitmentValid; //! Whether the stored CUtxoCommitment matches the scanned set
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0), fUtxoCommitmentValid(false) {}
+};
+
+/**
+ * Rolling commitment to the unspent transaction output set.
+ *
+ * ConnectBlock() and DisconnectBlock() apply the outputs each block creates
+ * and spends, and the commitment is flushed together with the coins, so the
+ * UTXO set statistics are available without scanning the coin database.
+ */
+class CUtxoCommitment
+{
+public:
+    MuHash3072 muhash;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+
+    CUtxoCommitment() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+
+    void AddOutput(const uint256 &txid, uint32_t n, const CTxOut &out, int nHeight, bool fCoinBase);
+    void RemoveOutput(const uint256 &txid, uint32_t n, const CTxOut &out, int nHeight, bool fCoinBase);
+
+    //! Add or remove all unspent outputs of a transaction
+    void AddCoins(const uint256 &txid, const CCoins &coins);
+    void RemoveCoins(const uint256 &txid, const CCoins &coins);
+
+    //! MuHash of the output set
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(muhash);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+    }
 };
 
 
@@ -362,13 +403,18 @@ public:
     //! Get the current "tip" or the latest anchored tree root in the chain
     virtual uint256 GetBestAnchor() const;
 
+    //! Retrieve the rolling commitment to the unspent transaction output set
+    virtual bool GetUtxoCommitment(CUtxoCommitment &commitment) const;
+
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
+    //! The passed mapCoins can be modified. pUtxoCommitment is NULL if the
+    //! commitment was not changed.
     virtual bool BatchWrite(CCoinsMap &mapCoins,
                             const uint256 &hashBlock,
                             const uint256 &hashAnchor,
                             CAnchorsMap &mapAnchors,
-                            CNullifiersMap &mapNullifiers);
+                            CNullifiersMap &mapNullifiers,
+                            const CUtxoCommitment *pUtxoCommitment);
 
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
@@ -392,12 +438,14 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
+    bool GetUtxoCommitment(CUtxoCommitment &commitment) const;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
                     const uint256 &hashAnchor,
                     CAnchorsMap &mapAnchors,
-                    CNullifiersMap &mapNullifiers);
+                    CNullifiersMap &mapNullifiers,
+                    const CUtxoCommitment *pUtxoCommitment);
     bool GetStats(CCoinsStats &stats) const;
 };
 
@@ -441,6 +489,8 @@ protected:
     mutable uint256 hashAnchor;
     mutable CAnchorsMap cacheAnchors;
     mutable CNullifiersMap cacheNullifiers;
+    mutable CUtxoCommitment utxoCommitment;
+    mutable bool fHaveUtxoCommitment;
 
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
@@ -456,12 +506,20 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
+    bool GetUtxoCommitment(CUtxoCommitment &commitment) const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
                     const uint256 &hashAnchor,
                     CAnchorsMap &mapAnchors,
-                    CNullifiersMap &mapNullifiers);
+                    CNullifiersMap &mapNullifiers,
+                    const CUtxoCommitment *pUtxoCommitment);
+
+    /**
+     * Return a modifiable reference to the UTXO set commitment, fetched from
+     * the base view first. Changes are pushed to the base by Flush().
+     */
+    CUtxoCommitment &ModifyUtxoCommitment();
 
 
     // Adds the tree to mapAnchors and sets the current commitment
@@ -0,0 +1,252 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b.h"
+
+#include "crypto/common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+#include <cpuid.h>
+#define HAVE_BLAKE2B_DISPATCH 1
+#endif
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace blake2b_avx2
+{
+void HashIndices4(unsigned char* out, size_t outlen, const uint64_t* h, uint64_t t,
+                  const unsigned char* block, size_t pos, const uint32_t* indices);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+const unsigned char SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+uint64_t inline RotR(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+/** The BLAKE2b mixing function. */
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = RotR(d ^ a, 32);
+    c = c + d;
+    b = RotR(b ^ c, 24);
+    a = a + b + y;
+    d = RotR(d ^ a, 16);
+    c = c + d;
+    b = RotR(b ^ c, 63);
+}
+
+/** Compress one block into the state, t being the number of bytes hashed so far including this block. */
+void Compress(uint64_t* s, const unsigned char* block, uint64_t t, bool last)
+{
+    uint64_t m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = ReadLE64(block + 8 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = s[i];
+        v[i + 8] = IV[i];
+    }
+    // The high word of the counter is zero for anything we hash.
+    v[12] ^= t;
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (int r = 0; r < 12; r++) {
+        const unsigned char* sg = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[sg[0]], m[sg[1]]);
+        G(v[1], v[5], v[9], v[13], m[sg[2]], m[sg[3]]);
+        G(v[2], v[6], v[10], v[14], m[sg[4]], m[sg[5]]);
+        G(v[3], v[7], v[11], v[15], m[sg[6]], m[sg[7]]);
+        G(v[0], v[5], v[10], v[15], m[sg[8]], m[sg[9]]);
+        G(v[1], v[6], v[11], v[12], m[sg[10]], m[sg[11]]);
+        G(v[2], v[7], v[8], v[13], m[sg[12]], m[sg[13]]);
+        G(v[3], v[4], v[9], v[14], m[sg[14]], m[sg[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        s[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+/** Hash the final block of each of count messages that differ only in the index at pos. */
+void HashIndices(unsigned char* out, size_t outlen, const uint64_t* h, uint64_t t,
+                 const unsigned char* block, size_t pos, const uint32_t* indices, size_t count)
+{
+    unsigned char buf[CBLAKE2bIndexHasher::BLOCK_SIZE];
+    unsigned char hash[CBLAKE2bIndexHasher::MAX_OUTPUT_SIZE];
+    memcpy(buf, block, sizeof(buf));
+    for (size_t i = 0; i < count; i++) {
+        uint64_t s[8];
+        memcpy(s, h, sizeof(s));
+        WriteLE32(buf + pos, indices[i]);
+        Compress(s, buf, t, true);
+        for (int j = 0; j < 8; j++) {
+            WriteLE64(hash + 8 * j, s[j]);
+        }
+        memcpy(out + i * outlen, hash, outlen);
+    }
+}
+
+} // namespace blake2b
+
+typedef void (*HashIndicesMultiType)(unsigned char*, size_t, const uint64_t*, uint64_t, const unsigned char*, size_t, const uint32_t*);
+
+HashIndicesMultiType HashIndices4way = NULL;
+
+/** Check a multi-lane implementation against the scalar one. */
+bool SelfTest(HashIndicesMultiType hash_4way)
+{
+    static const uint32_t indices[4] = {0, 1, 0x12345678, 0xffffffff};
+    unsigned char block[CBLAKE2bIndexHasher::BLOCK_SIZE];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = i * 7;
+    }
+    uint64_t h[8];
+    memcpy(h, blake2b::IV, sizeof(h));
+    h[0] ^= 0x01010000 ^ 50;
+
+    // Both a full and a short final block, and a truncated and a full-width output.
+    for (size_t pos : {12, 124}) {
+        for (size_t outlen : {50, 64}) {
+            unsigned char expected[4 * CBLAKE2bIndexHasher::MAX_OUTPUT_SIZE];
+            unsigned char out[4 * CBLAKE2bIndexHasher::MAX_OUTPUT_SIZE];
+            blake2b::HashIndices(expected, outlen, h, 128 + pos + 4, block, pos, indices, 4);
+            hash_4way(out, outlen, h, 128 + pos + 4, block, pos, indices);
+            if (memcmp(out, expected, 4 * outlen))
+                return false;
+        }
+    }
+    return true;
+}
+
+#if defined(HAVE_BLAKE2B_DISPATCH)
+/** Whether the OS saves the AVX registers on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string BLAKE2bAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(HAVE_BLAKE2B_DISPATCH)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_avx2 = false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = have_avx && ((ebx >> 5) & 1);
+    }
+
+    HashIndicesMultiType hash_4way = NULL;
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        hash_4way = blake2b_avx2::HashIndices4;
+        ret = "avx2(4way)";
+    }
+#endif
+
+    if (hash_4way && !SelfTest(hash_4way)) {
+        return "standard (" + ret + " failed self-test)";
+    }
+
+    HashIndices4way = hash_4way;
+#endif
+    return ret;
+}
+
+////// BLAKE2b of a prefix and an index
+
+CBLAKE2bIndexHasher::CBLAKE2bIndexHasher(size_t outlenIn, const unsigned char personal[PERSONAL_SIZE],
+                                         const unsigned char* prefix, size_t prefixLen) : counter(0), outlen(outlenIn)
+{
+    assert(outlen > 0 && outlen <= MAX_OUTPUT_SIZE);
+
+    // Parameter block: no key, fanout and depth 1, no salt.
+    memcpy(h, blake2b::IV, sizeof(h));
+    h[0] ^= 0x01010000 ^ outlen;
+    h[6] ^= ReadLE64(personal);
+    h[7] ^= ReadLE64(personal + 8);
+
+    // The index always follows, so no block of the prefix is the last one.
+    while (prefixLen >= BLOCK_SIZE) {
+        counter += BLOCK_SIZE;
+        blake2b::Compress(h, prefix, counter, false);
+        prefix += BLOCK_SIZE;
+        prefixLen -= BLOCK_SIZE;
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, prefix, prefixLen);
+    tailLen = prefixLen;
+}
+
+void CBLAKE2bIndexHasher::Hash(unsigned char* output, const uint32_t* indices, size_t count) const
+{
+    uint64_t t = counter + tailLen + sizeof(uint32_t);
+
+    if (tailLen + sizeof(uint32_t) > BLOCK_SIZE) {
+        // The index straddles two blocks.
+        unsigned char buf[2 * BLOCK_SIZE];
+        unsigned char hash[MAX_OUTPUT_SIZE];
+        memcpy(buf, tail, sizeof(buf));
+        for (size_t i = 0; i < count; i++) {
+            uint64_t s[8];
+            memcpy(s, h, sizeof(s));
+            WriteLE32(buf + tailLen, indices[i]);
+            blake2b::Compress(s, buf, counter + BLOCK_SIZE, false);
+            blake2b::Compress(s, buf + BLOCK_SIZE, t, true);
+            for (int j = 0; j < 8; j++) {
+                WriteLE64(hash + 8 * j, s[j]);
+            }
+            memcpy(output + i * outlen, hash, outlen);
+        }
+        return;
+    }
+
+    if (HashIndices4way) {
+        while (count >= 4) {
+            HashIndices4way(output, outlen, h, t, tail, tailLen, indices);
+            output += 4 * outlen;
+            indices += 4;
+            count -= 4;
+        }
+    }
+    blake2b::HashIndices(output, outlen, h, t, tail, tailLen, indices, count);
+}
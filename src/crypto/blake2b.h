@@ -0,0 +1,47 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/**
+ * BLAKE2b (RFC 7693) of a fixed prefix followed by a 32-bit little-endian
+ * index, for many indices. This is how Equihash derives its hash outputs.
+ *
+ * The full blocks of the prefix are compressed once, on construction, and
+ * only the final block is compressed per index. Indices are hashed several
+ * at a time where a multi-lane implementation is available.
+ */
+class CBLAKE2bIndexHasher
+{
+public:
+    static const size_t BLOCK_SIZE = 128;
+    static const size_t MAX_OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    CBLAKE2bIndexHasher(size_t outlen, const unsigned char personal[PERSONAL_SIZE],
+                        const unsigned char* prefix, size_t prefixLen);
+
+    /** Write the hash of prefix || le32(indices[i]) to output + i * outlen, for i < count. */
+    void Hash(unsigned char* output, const uint32_t* indices, size_t count) const;
+
+private:
+    uint64_t h[8];
+    uint64_t counter;
+    //! The rest of the prefix and room for the index, zero padded.
+    unsigned char tail[2 * BLOCK_SIZE];
+    size_t tailLen;
+    size_t outlen;
+};
+
+/** Autodetect the best available BLAKE2b implementation.
+ *  Returns the name of the implementation.
+ */
+std::string BLAKE2bAutoDetect();
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
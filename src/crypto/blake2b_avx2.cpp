@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a translation unit of its own, as it is compiled with -mavx -mavx2.
+
+#ifdef ENABLE_AVX2
+
+#include "crypto/common.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace blake2b_avx2
+{
+namespace
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+const unsigned char SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+inline __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+inline __m256i Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+inline __m256i RotR32(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+inline __m256i RotR24(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                                   3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+}
+inline __m256i RotR16(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                                   2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+}
+inline __m256i RotR63(__m256i x) { return _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x)); }
+
+inline void G(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y)
+{
+    a = Add(Add(a, b), x);
+    d = RotR32(Xor(d, a));
+    c = Add(c, d);
+    b = RotR24(Xor(b, c));
+    a = Add(Add(a, b), y);
+    d = RotR16(Xor(d, a));
+    c = Add(c, d);
+    b = RotR63(Xor(b, c));
+}
+} // namespace
+
+/** Hash the final block of four messages, one per 64-bit lane, that differ only in the index at pos. */
+void HashIndices4(unsigned char* out, size_t outlen, const uint64_t* h, uint64_t t,
+                  const unsigned char* block, size_t pos, const uint32_t* indices)
+{
+    unsigned char buf[4][128];
+    for (int l = 0; l < 4; l++) {
+        memcpy(buf[l], block, 128);
+        WriteLE32(buf[l] + pos, indices[l]);
+    }
+
+    __m256i m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = _mm256_set_epi64x(ReadLE64(buf[3] + 8 * i), ReadLE64(buf[2] + 8 * i),
+                                 ReadLE64(buf[1] + 8 * i), ReadLE64(buf[0] + 8 * i));
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = _mm256_set1_epi64x(h[i]);
+        v[i + 8] = _mm256_set1_epi64x(IV[i]);
+    }
+    v[12] = Xor(v[12], _mm256_set1_epi64x(t));
+    v[14] = Xor(v[14], _mm256_set1_epi64x(-1));
+
+    for (int r = 0; r < 12; r++) {
+        const unsigned char* sg = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[sg[0]], m[sg[1]]);
+        G(v[1], v[5], v[9], v[13], m[sg[2]], m[sg[3]]);
+        G(v[2], v[6], v[10], v[14], m[sg[4]], m[sg[5]]);
+        G(v[3], v[7], v[11], v[15], m[sg[6]], m[sg[7]]);
+        G(v[0], v[5], v[10], v[15], m[sg[8]], m[sg[9]]);
+        G(v[1], v[6], v[11], v[12], m[sg[10]], m[sg[11]]);
+        G(v[2], v[7], v[8], v[13], m[sg[12]], m[sg[13]]);
+        G(v[3], v[4], v[9], v[14], m[sg[14]], m[sg[15]]);
+    }
+
+    uint64_t s[8][4];
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)s[i], Xor(_mm256_set1_epi64x(h[i]), Xor(v[i], v[i + 8])));
+    }
+    unsigned char hash[64];
+    for (int l = 0; l < 4; l++) {
+        for (int i = 0; i < 8; i++) {
+            WriteLE64(hash + 8 * i, s[i][l]);
+        }
+        memcpy(out + l * outlen, hash, outlen);
+    }
+}
+
+} // namespace blake2b_avx2
+
+#endif
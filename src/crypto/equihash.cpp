@@ -17,6 +17,8 @@
 #endif
 
 #include "crypto/equihash.h"
+#include "crypto/blake2b.h"
+#include "crypto/common.h"
 #include "util.h"
 
 #include <algorithm>
@@ -766,6 +768,86 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln)
+{
+    // Leaves are hashed, and the subtrees they complete checked, a batch at a time.
+    const size_t BatchSize = 8;
+    BOOST_STATIC_ASSERT((1 << K) % BatchSize == 0);
+
+    if (soln.size() != SolutionWidth) {
+        LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    unsigned char array[(1 << K)*sizeof(eh_index)];
+    ExpandArray(soln.data(), soln.size(), array, sizeof(array),
+                CollisionBitLength+1, sizeof(eh_index) - ((CollisionBitLength+1)+7)/8);
+    eh_index indices[1 << K];
+    eh_index sorted[1 << K];
+    for (size_t i = 0; i < (1 << K); i++) {
+        indices[i] = sorted[i] = ArrayToEhIndex(array + i*sizeof(eh_index));
+    }
+
+    // Any two equal indices would meet as part of sibling subtrees, so
+    // checking all of them at once is the same as checking each pair of
+    // subtrees. It also means that the first indices of two subtrees are
+    // enough to compare their index lists.
+    std::sort(sorted, sorted + (1 << K));
+    if (std::adjacent_find(sorted, sorted + (1 << K)) != sorted + (1 << K)) {
+        LogPrint("pow", "Invalid solution: duplicate indices\n");
+        return false;
+    }
+
+    unsigned char personalization[CBLAKE2bIndexHasher::PERSONAL_SIZE] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    WriteLE32(personalization+8, N);
+    WriteLE32(personalization+12, K);
+    CBLAKE2bIndexHasher hasher(HashOutput, personalization, input, inputLen);
+
+    // The subtree starting at leaf a is folded into rows[a].
+    unsigned char rows[1 << K][HashLength];
+    for (size_t begin = 0; begin < (1 << K); begin += BatchSize) {
+        const size_t end = begin + BatchSize;
+        uint32_t g[BatchSize];
+        unsigned char hashes[BatchSize*HashOutput];
+        for (size_t i = 0; i < BatchSize; i++) {
+            g[i] = indices[begin+i]/IndicesPerHashOutput;
+        }
+        hasher.Hash(hashes, g, BatchSize);
+        for (size_t i = 0; i < BatchSize; i++) {
+            ExpandArray(hashes + i*HashOutput + (indices[begin+i] % IndicesPerHashOutput)*N/8, N/8,
+                        rows[begin+i], HashLength, CollisionBitLength);
+        }
+
+        for (size_t r = 0; r < K; r++) {
+            const size_t width = 1 << (r+1);
+            for (size_t a = (begin/width)*width; a + width <= end; a += width) {
+                unsigned char* x = rows[a];
+                const unsigned char* y = rows[a + width/2];
+                if (memcmp(x + r*CollisionByteLength, y + r*CollisionByteLength, CollisionByteLength) != 0) {
+                    LogPrint("pow", "Invalid solution: invalid collision length between StepRows\n");
+                    return false;
+                }
+                if (indices[a + width/2] < indices[a]) {
+                    LogPrint("pow", "Invalid solution: Index tree incorrectly ordered\n");
+                    return false;
+                }
+                for (size_t l = (r+1)*CollisionByteLength; l < HashLength; l++) {
+                    x[l] ^= y[l];
+                }
+            }
+        }
+    }
+
+    for (size_t l = K*CollisionByteLength; l < HashLength; l++) {
+        if (rows[0][l] != 0)
+            return false;
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
 #ifdef ENABLE_MINING
@@ -777,6 +859,7 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
@@ -789,6 +872,7 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
@@ -801,6 +885,7 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
@@ -813,3 +898,4 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
@@ -0,0 +1,181 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <string.h>
+
+namespace
+{
+typedef unsigned __int128 double_limb_t;
+
+/** 2^3072 - modulus */
+const uint64_t MAX_PRIME_DIFF = 1103717;
+
+/** Add n * MAX_PRIME_DIFF to a number, folding any overflow past 2^3072 back in. */
+void inline AddPrimeDiff(uint64_t* limbs, uint64_t n)
+{
+    while (n) {
+        double_limb_t c = (double_limb_t)n * MAX_PRIME_DIFF;
+        for (int i = 0; i < Num3072::LIMBS && c; i++) {
+            c += limbs[i];
+            limbs[i] = (uint64_t)c;
+            c >>= 64;
+        }
+        // 2^3072 is congruent to MAX_PRIME_DIFF
+        n = (uint64_t)c;
+    }
+}
+
+/** Hash a byte string to a number. */
+Num3072 ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    for (unsigned char i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; i++) {
+        CSHA512().Write(seed, sizeof(seed)).Write(&i, 1).Finalize(bytes + i * CSHA512::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+
+} // namespace
+
+Num3072::Num3072()
+{
+    SetToOne();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = ReadLE64(data + 8 * i);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++) {
+        limbs[i] = 0;
+    }
+}
+
+/** Whether the number is at least the modulus. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < UINT64_MAX - MAX_PRIME_DIFF + 1)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != UINT64_MAX)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is adding MAX_PRIME_DIFF and dropping 2^3072
+    uint64_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && c; i++) {
+        limbs[i] += c;
+        c = limbs[i] < c;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint64_t tmp[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // Reduce the high half, as hi * 2^3072 is congruent to hi * MAX_PRIME_DIFF
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t t = (double_limb_t)tmp[LIMBS + i] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (uint64_t)t;
+        carry = (uint64_t)(t >> 64);
+    }
+    AddPrimeDiff(limbs, carry);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat's little theorem: a^(p-2) is the inverse of a, where
+    // p - 2 = 2^3072 - MAX_PRIME_DIFF - 2 is all ones but for its lowest limb.
+    const uint64_t nLowLimb = UINT64_MAX - MAX_PRIME_DIFF - 1;
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        uint64_t e = (i == 0) ? nLowLimb : UINT64_MAX;
+        for (int bit = 63; bit >= 0; bit--) {
+            result.Multiply(result);
+            if ((e >> bit) & 1)
+                result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    Num3072 reduced = *this;
+    if (reduced.IsOverflow())
+        reduced.FullReduce();
+    for (int i = 0; i < LIMBS; i++) {
+        WriteLE64(out + 8 * i, reduced.limbs[i]);
+    }
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    Num3072 result = numerator;
+    result.Divide(denominator);
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a translation unit of its own, as it is compiled with -mavx -mavx2.
+
+#ifdef ENABLE_AVX2
+
+#include "crypto/common.h"
+#include "crypto/sha256_multiway.h"
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace sha256_avx2
+{
+namespace
+{
+struct Ops
+{
+    typedef __m256i vec;
+    static const int LANES = 8;
+
+    static inline vec K(uint32_t x) { return _mm256_set1_epi32(x); }
+    static inline vec Add(vec x, vec y) { return _mm256_add_epi32(x, y); }
+    static inline vec Xor(vec x, vec y) { return _mm256_xor_si256(x, y); }
+    static inline vec Or(vec x, vec y) { return _mm256_or_si256(x, y); }
+    static inline vec And(vec x, vec y) { return _mm256_and_si256(x, y); }
+    template<int n> static inline vec ShR(vec x) { return _mm256_srli_epi32(x, n); }
+    template<int n> static inline vec ShL(vec x) { return _mm256_slli_epi32(x, n); }
+
+    /** Load the big-endian word at offset from each of the lanes' 64-byte inputs. */
+    static inline vec Load(const unsigned char* in, int offset)
+    {
+        return _mm256_set_epi32(ReadBE32(in + 448 + offset), ReadBE32(in + 384 + offset), ReadBE32(in + 320 + offset), ReadBE32(in + 256 + offset),
+                                ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+    }
+
+    /** Store each lane as a big-endian word at offset in that lane's 32-byte output. */
+    static inline void Store(unsigned char* out, int offset, vec v)
+    {
+        WriteBE32(out + offset, _mm256_extract_epi32(v, 0));
+        WriteBE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+        WriteBE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+        WriteBE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+        WriteBE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+        WriteBE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+        WriteBE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+        WriteBE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+    }
+};
+} // namespace
+
+void TransformD64_8way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::Multiway<Ops>::D64(out, in);
+}
+
+void TransformCompress64_8way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::Multiway<Ops>::Compress64(out, in);
+}
+
+} // namespace sha256_avx2
+
+#endif
@@ -0,0 +1,170 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+#define BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+
+#include <stdint.h>
+
+/**
+ * SHA-256 over several independent 64-byte inputs at once, one per SIMD lane.
+ *
+ * This is only included by the translation units that are built with the
+ * instruction set flags of a particular vector width. Ops supplies the vector
+ * type, the number of lanes, and the lane-wise operations:
+ * K, Add, Xor, Or, And, ShR<n>, ShL<n>, Load and Store.
+ */
+namespace sha256_multiway
+{
+
+static const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+    0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+};
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+template<typename Ops>
+struct Multiway
+{
+    typedef typename Ops::vec vec;
+
+    static inline vec Ch(vec x, vec y, vec z) { return Ops::Xor(z, Ops::And(x, Ops::Xor(y, z))); }
+    static inline vec Maj(vec x, vec y, vec z) { return Ops::Or(Ops::And(x, y), Ops::And(z, Ops::Or(x, y))); }
+    static inline vec Sigma0(vec x)
+    {
+        return Ops::Xor(Ops::Xor(Ops::Or(Ops::template ShR<2>(x), Ops::template ShL<30>(x)),
+                                 Ops::Or(Ops::template ShR<13>(x), Ops::template ShL<19>(x))),
+                        Ops::Or(Ops::template ShR<22>(x), Ops::template ShL<10>(x)));
+    }
+    static inline vec Sigma1(vec x)
+    {
+        return Ops::Xor(Ops::Xor(Ops::Or(Ops::template ShR<6>(x), Ops::template ShL<26>(x)),
+                                 Ops::Or(Ops::template ShR<11>(x), Ops::template ShL<21>(x))),
+                        Ops::Or(Ops::template ShR<25>(x), Ops::template ShL<7>(x)));
+    }
+    static inline vec sigma0(vec x)
+    {
+        return Ops::Xor(Ops::Xor(Ops::Or(Ops::template ShR<7>(x), Ops::template ShL<25>(x)),
+                                 Ops::Or(Ops::template ShR<18>(x), Ops::template ShL<14>(x))),
+                        Ops::template ShR<3>(x));
+    }
+    static inline vec sigma1(vec x)
+    {
+        return Ops::Xor(Ops::Xor(Ops::Or(Ops::template ShR<17>(x), Ops::template ShL<15>(x)),
+                                 Ops::Or(Ops::template ShR<19>(x), Ops::template ShL<13>(x))),
+                        Ops::template ShR<10>(x));
+    }
+
+    /** One round of SHA-256, with the round constant already added to the message word. */
+    static inline void Round(vec a, vec b, vec c, vec& d, vec e, vec f, vec g, vec& h, vec kw)
+    {
+        vec t1 = Ops::Add(Ops::Add(h, Sigma1(e)), Ops::Add(Ch(e, f, g), kw));
+        vec t2 = Ops::Add(Sigma0(a), Maj(a, b, c));
+        d = Ops::Add(d, t1);
+        h = Ops::Add(t1, t2);
+    }
+
+    /** Transform the state in every lane by one block of message words, which are overwritten. */
+    static void Transform(vec s[8], vec w[16])
+    {
+        vec a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (int i = 0; i < 64; i += 8) {
+            if (i >= 16) {
+                for (int j = 0; j < 8; j++) {
+                    int n = (i + j) & 15;
+                    w[n] = Ops::Add(Ops::Add(w[n], sigma1(w[(n + 14) & 15])),
+                                    Ops::Add(w[(n + 9) & 15], sigma0(w[(n + 1) & 15])));
+                }
+            }
+            const vec* m = w + (i & 15);
+            Round(a, b, c, d, e, f, g, h, Ops::Add(Ops::K(K[i + 0]), m[0]));
+            Round(h, a, b, c, d, e, f, g, Ops::Add(Ops::K(K[i + 1]), m[1]));
+            Round(g, h, a, b, c, d, e, f, Ops::Add(Ops::K(K[i + 2]), m[2]));
+            Round(f, g, h, a, b, c, d, e, Ops::Add(Ops::K(K[i + 3]), m[3]));
+            Round(e, f, g, h, a, b, c, d, Ops::Add(Ops::K(K[i + 4]), m[4]));
+            Round(d, e, f, g, h, a, b, c, Ops::Add(Ops::K(K[i + 5]), m[5]));
+            Round(c, d, e, f, g, h, a, b, Ops::Add(Ops::K(K[i + 6]), m[6]));
+            Round(b, c, d, e, f, g, h, a, Ops::Add(Ops::K(K[i + 7]), m[7]));
+        }
+
+        s[0] = Ops::Add(s[0], a);
+        s[1] = Ops::Add(s[1], b);
+        s[2] = Ops::Add(s[2], c);
+        s[3] = Ops::Add(s[3], d);
+        s[4] = Ops::Add(s[4], e);
+        s[5] = Ops::Add(s[5], f);
+        s[6] = Ops::Add(s[6], g);
+        s[7] = Ops::Add(s[7], h);
+    }
+
+    static inline void Initialize(vec s[8])
+    {
+        for (int i = 0; i < 8; i++) {
+            s[i] = Ops::K(INIT[i]);
+        }
+    }
+
+    /** Compress one 64-byte input per lane from the initial state, without padding. */
+    static void Compress64(unsigned char* out, const unsigned char* in)
+    {
+        vec s[8], w[16];
+        Initialize(s);
+        for (int i = 0; i < 16; i++) {
+            w[i] = Ops::Load(in, 4 * i);
+        }
+        Transform(s, w);
+        for (int i = 0; i < 8; i++) {
+            Ops::Store(out, 4 * i, s[i]);
+        }
+    }
+
+    /** Double-SHA256 of one 64-byte input per lane. */
+    static void D64(unsigned char* out, const unsigned char* in)
+    {
+        vec s[8], t[8], w[16];
+        Initialize(s);
+        for (int i = 0; i < 16; i++) {
+            w[i] = Ops::Load(in, 4 * i);
+        }
+        Transform(s, w);
+
+        // The padding block of a 64-byte message.
+        w[0] = Ops::K(0x80000000ul);
+        for (int i = 1; i < 15; i++) {
+            w[i] = Ops::K(0);
+        }
+        w[15] = Ops::K(512);
+        Transform(s, w);
+
+        // The second hash, of the 32-byte digest and its padding.
+        for (int i = 0; i < 8; i++) {
+            w[i] = s[i];
+        }
+        w[8] = Ops::K(0x80000000ul);
+        for (int i = 9; i < 15; i++) {
+            w[i] = Ops::K(0);
+        }
+        w[15] = Ops::K(256);
+        Initialize(t);
+        Transform(t, w);
+        for (int i = 0; i < 8; i++) {
+            Ops::Store(out, 4 * i, t[i]);
+        }
+    }
+};
+
+} // namespace sha256_multiway
+
+#endif // BITCOIN_CRYPTO_SHA256_MULTIWAY_H
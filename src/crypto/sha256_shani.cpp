@@ -0,0 +1,141 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a translation unit of its own, as it is compiled with -msse4 -msha.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace
+{
+const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+const __m128i K[16] = {
+    _mm_set_epi64x(0xe9b5dba5b5c0fbcfULL, 0x71374491428a2f98ULL),
+    _mm_set_epi64x(0xab1c5ed5923f82a4ULL, 0x59f111f13956c25bULL),
+    _mm_set_epi64x(0x550c7dc3243185beULL, 0x12835b01d807aa98ULL),
+    _mm_set_epi64x(0xc19bf1749bdc06a7ULL, 0x80deb1fe72be5d74ULL),
+    _mm_set_epi64x(0x240ca1cc0fc19dc6ULL, 0xefbe4786e49b69c1ULL),
+    _mm_set_epi64x(0x76f988da5cb0a9dcULL, 0x4a7484aa2de92c6fULL),
+    _mm_set_epi64x(0xbf597fc7b00327c8ULL, 0xa831c66d983e5152ULL),
+    _mm_set_epi64x(0x1429296706ca6351ULL, 0xd5a79147c6e00bf3ULL),
+    _mm_set_epi64x(0x53380d134d2c6dfcULL, 0x2e1b213827b70a85ULL),
+    _mm_set_epi64x(0x92722c8581c2c92eULL, 0x766a0abb650a7354ULL),
+    _mm_set_epi64x(0xc76c51a3c24b8b70ULL, 0xa81a664ba2bfe8a1ULL),
+    _mm_set_epi64x(0x106aa070f40e3585ULL, 0xd6990624d192e819ULL),
+    _mm_set_epi64x(0x34b0bcb52748774cULL, 0x1e376c0819a4c116ULL),
+    _mm_set_epi64x(0x682e6ff35b9cca4fULL, 0x4ed8aa4a391c0cb3ULL),
+    _mm_set_epi64x(0x8cc7020884c87814ULL, 0x78a5636f748f82eeULL),
+    _mm_set_epi64x(0xc67178f2bef9a3f7ULL, 0xa4506ceb90befffaULL)
+};
+
+/** Four rounds, consuming four message words. */
+void inline __attribute__((always_inline)) QuadRound(__m128i& state0, __m128i& state1, __m128i m, __m128i k)
+{
+    const __m128i msg = _mm_add_epi32(m, k);
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** The first half of the message schedule update of m0. */
+void inline __attribute__((always_inline)) ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+/** The second half of the message schedule update of m2. */
+void inline __attribute__((always_inline)) ShiftMessageC(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+void inline __attribute__((always_inline)) ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+void inline __attribute__((always_inline)) Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+void inline __attribute__((always_inline)) Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+} // namespace
+
+namespace sha256_shani
+{
+/** Perform a number of SHA-256 transformations with the SHA extensions. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i m0, m1, m2, m3, s0, s1, so0, so1;
+
+    // Load the state into the ABEF/CDGH order the instructions expect.
+    s0 = _mm_loadu_si128((const __m128i*)s);
+    s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        so0 = s0;
+        so1 = s1;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)chunk), MASK);
+        QuadRound(s0, s1, m0, K[0]);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), MASK);
+        QuadRound(s0, s1, m1, K[1]);
+        ShiftMessageA(m0, m1);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), MASK);
+        QuadRound(s0, s1, m2, K[2]);
+        ShiftMessageA(m1, m2);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), MASK);
+        QuadRound(s0, s1, m3, K[3]);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, K[4]);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, K[5]);
+        ShiftMessageB(m0, m1, m2);
+        QuadRound(s0, s1, m2, K[6]);
+        ShiftMessageB(m1, m2, m3);
+        QuadRound(s0, s1, m3, K[7]);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, K[8]);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, K[9]);
+        ShiftMessageB(m0, m1, m2);
+        QuadRound(s0, s1, m2, K[10]);
+        ShiftMessageB(m1, m2, m3);
+        QuadRound(s0, s1, m3, K[11]);
+        ShiftMessageB(m2, m3, m0);
+        QuadRound(s0, s1, m0, K[12]);
+        ShiftMessageB(m3, m0, m1);
+        QuadRound(s0, s1, m1, K[13]);
+        ShiftMessageC(m0, m1, m2);
+        QuadRound(s0, s1, m2, K[14]);
+        ShiftMessageC(m1, m2, m3);
+        QuadRound(s0, s1, m3, K[15]);
+
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+#endif
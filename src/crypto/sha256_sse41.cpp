@@ -0,0 +1,61 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a translation unit of its own, as it is compiled with -msse4.1.
+
+#ifdef ENABLE_SSE41
+
+#include "crypto/common.h"
+#include "crypto/sha256_multiway.h"
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace sha256_sse41
+{
+namespace
+{
+struct Ops
+{
+    typedef __m128i vec;
+    static const int LANES = 4;
+
+    static inline vec K(uint32_t x) { return _mm_set1_epi32(x); }
+    static inline vec Add(vec x, vec y) { return _mm_add_epi32(x, y); }
+    static inline vec Xor(vec x, vec y) { return _mm_xor_si128(x, y); }
+    static inline vec Or(vec x, vec y) { return _mm_or_si128(x, y); }
+    static inline vec And(vec x, vec y) { return _mm_and_si128(x, y); }
+    template<int n> static inline vec ShR(vec x) { return _mm_srli_epi32(x, n); }
+    template<int n> static inline vec ShL(vec x) { return _mm_slli_epi32(x, n); }
+
+    /** Load the big-endian word at offset from each of the lanes' 64-byte inputs. */
+    static inline vec Load(const unsigned char* in, int offset)
+    {
+        return _mm_set_epi32(ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+    }
+
+    /** Store each lane as a big-endian word at offset in that lane's 32-byte output. */
+    static inline void Store(unsigned char* out, int offset, vec v)
+    {
+        WriteBE32(out + offset, _mm_extract_epi32(v, 0));
+        WriteBE32(out + 32 + offset, _mm_extract_epi32(v, 1));
+        WriteBE32(out + 64 + offset, _mm_extract_epi32(v, 2));
+        WriteBE32(out + 96 + offset, _mm_extract_epi32(v, 3));
+    }
+};
+} // namespace
+
+void TransformD64_4way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::Multiway<Ops>::D64(out, in);
+}
+
+void TransformCompress64_4way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::Multiway<Ops>::Compress64(out, in);
+}
+
+} // namespace sha256_sse41
+
+#endif
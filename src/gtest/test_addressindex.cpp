@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "addressindex.h"
+#include "clientversion.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+static std::vector<unsigned char> SerializeKey(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+TEST(addressindex_tests, GetAddressIndexType) {
+    uint160 hash(ParseHex("0123456789abcdef0123456789abcdef01234567"));
+    uint160 hashBytes;
+
+    EXPECT_EQ(ADDRESS_INDEX_P2PKH, GetAddressIndexType(GetScriptForDestination(CKeyID(hash)), hashBytes));
+    EXPECT_EQ(hash, hashBytes);
+
+    hashBytes.SetNull();
+    EXPECT_EQ(ADDRESS_INDEX_P2SH, GetAddressIndexType(GetScriptForDestination(CScriptID(hash)), hashBytes));
+    EXPECT_EQ(hash, hashBytes);
+
+    CScript script;
+    script << OP_RETURN;
+    EXPECT_EQ(ADDRESS_INDEX_NONE, GetAddressIndexType(script, hashBytes));
+}
+
+TEST(addressindex_tests, KeysSortInChainOrder) {
+    uint160 hash(ParseHex("0123456789abcdef0123456789abcdef01234567"));
+    uint256 txhash = uint256S("ff");
+
+    CAddressIndexKey key(ADDRESS_INDEX_P2PKH, hash, 255, 1, txhash, 0, false);
+    std::vector<unsigned char> bytes = SerializeKey(key);
+    EXPECT_EQ(key.GetSerializeSize(SER_DISK, CLIENT_VERSION), bytes.size());
+
+    // Later heights, and later transactions in a block, sort after earlier ones.
+    EXPECT_LT(bytes, SerializeKey(CAddressIndexKey(ADDRESS_INDEX_P2PKH, hash, 256, 0, txhash, 0, false)));
+    EXPECT_LT(bytes, SerializeKey(CAddressIndexKey(ADDRESS_INDEX_P2PKH, hash, 255, 2, uint256(), 0, false)));
+
+    // The height prefix used to seek is a prefix of the key.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CAddressIndexIteratorHeightKey(ADDRESS_INDEX_P2PKH, hash, 255);
+    std::vector<unsigned char> prefix(ss.begin(), ss.end());
+    ASSERT_EQ(25, prefix.size());
+    EXPECT_TRUE(std::equal(prefix.begin(), prefix.end(), bytes.begin()));
+
+    CDataStream in(bytes, SER_DISK, CLIENT_VERSION);
+    CAddressIndexKey read;
+    in >> read;
+    EXPECT_EQ(255, read.blockHeight);
+    EXPECT_EQ(1, read.txindex);
+    EXPECT_EQ(txhash, read.txhash);
+}
@@ -5,6 +5,8 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "crypto/blake2b.h"
+#include "crypto/common.h"
 #include "crypto/equihash.h"
 #include "uint256.h"
 
@@ -70,6 +72,40 @@ TEST(equihash_tests, minimal_solution_representation) {
                         ParseHex("000220000a7ffffe004d10014c800ffc00002fffff"));
 }
 
+TEST(equihash_tests, blake2b_index_hasher) {
+    unsigned char personalization[CBLAKE2bIndexHasher::PERSONAL_SIZE] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    WriteLE32(personalization+8, 200);
+    WriteLE32(personalization+12, 9);
+    const uint32_t indices[] = {0, 1, 2, 3, 4, 5, 1048575, 0xffffffff, 12345};
+    const size_t count = sizeof(indices)/sizeof(indices[0]);
+
+    // Prefixes with no, a partial and a whole block left over, one leaving
+    // the index straddling two blocks, and the 140 bytes of a block header.
+    for (size_t len : {0, 32, 105, 125, 128, 140, 256}) {
+        SCOPED_TRACE(len);
+        std::vector<unsigned char> prefix(len);
+        for (size_t i = 0; i < len; i++) {
+            prefix[i] = i * 13 + 1;
+        }
+
+        std::vector<unsigned char> out(count * Equihash<200,9>::HashOutput);
+        CBLAKE2bIndexHasher(Equihash<200,9>::HashOutput, personalization, prefix.data(), len).Hash(out.data(), indices, count);
+
+        for (size_t i = 0; i < count; i++) {
+            eh_HashState state;
+            Eh200_9.InitialiseState(state);
+            crypto_generichash_blake2b_update(&state, prefix.data(), len);
+            unsigned char lei[4];
+            WriteLE32(lei, indices[i]);
+            crypto_generichash_blake2b_update(&state, lei, sizeof(lei));
+            unsigned char expected[Equihash<200,9>::HashOutput];
+            crypto_generichash_blake2b_final(&state, expected, sizeof(expected));
+            EXPECT_EQ(0, memcmp(expected, out.data() + i * Equihash<200,9>::HashOutput, sizeof(expected)));
+        }
+    }
+}
+
 TEST(equihash_tests, is_probably_duplicate) {
     std::shared_ptr<eh_trunc> p1 (new eh_trunc[4] {0, 1, 2, 3}, std::default_delete<eh_trunc[]>());
     std::shared_ptr<eh_trunc> p2 (new eh_trunc[4] {0, 1, 1, 3}, std::default_delete<eh_trunc[]>());
@@ -1,13 +1,17 @@
 #include <gtest/gtest.h>
 #include <gtest/gtest-spi.h>
+#include <sodium.h>
 
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "init.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "script/interpreter.h"
 #include "txmempool.h"
 #include "policy/fees.h"
 #include "util.h"
+#include "zcash/JoinSplit.hpp"
 
 // Fake the input of transaction 5295156213414ed77f6e538e7e8ebe14492156906b9fe995b242477818789364
 // - 532639cc6bebed47c1c69ae36dd498c68a012e74ad12729adbd3dbb56f8f3f4a, 0
@@ -52,7 +56,8 @@ public:
                     const uint256 &hashBlock,
                     const uint256 &hashAnchor,
                     CAnchorsMap &mapAnchors,
-                    CNullifiersMap &mapNullifiers) {
+                    CNullifiersMap &mapNullifiers,
+                    const CUtxoCommitment *pUtxoCommitment) {
         return false;
     }
 
@@ -136,3 +141,128 @@ TEST(Mempool, TxInputLimit) {
     EXPECT_EQ(state4.GetRejectReason(), "bad-txns-version-too-low");
 }
 
+
+TEST(Mempool, PreValidateRejectsContextFreeFailures) {
+    CMutableTransaction mtx;
+    mtx.nVersion = 0;
+    mtx.vin.resize(1);
+
+    // The context-free rules are checked before any chainstate is looked at
+    CValidationState state;
+    CTransaction tx(mtx);
+    EXPECT_FALSE(PreValidateTransaction(tx, state));
+    EXPECT_TRUE(state.IsInvalid());
+    EXPECT_EQ(state.GetRejectReason(), "bad-txns-version-too-low");
+}
+
+// Outputs that any input can spend (0), and that no input can (1)
+class FakeCoinsViewScripts : public FakeCoinsViewDB {
+public:
+    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+        FakeCoinsViewDB::GetCoins(txid, coins);
+        coins.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        coins.vout[1].nValue = 1000;
+        return true;
+    }
+};
+
+static CTransaction GetSpendingTransaction(uint32_t n) {
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000001"), n);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 0;
+    return mtx;
+}
+
+// A transaction that satisfies the context-free rules, with a JoinSplit
+// proof that doesn't verify
+static CTransaction GetTransactionWithInvalidProof() {
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    mtx.vjoinsplit.resize(1);
+    mtx.vjoinsplit[0].nullifiers.at(0) = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+    mtx.vjoinsplit[0].nullifiers.at(1) = uint256S("0000000000000000000000000000000000000000000000000000000000000002");
+    mtx.vjoinsplit[0].proof = libzcash::ZCProof::random_invalid();
+
+    unsigned char joinSplitPrivKey[crypto_sign_SECRETKEYBYTES];
+    crypto_sign_keypair(mtx.joinSplitPubKey.begin(), joinSplitPrivKey);
+    CTransaction signTx(mtx);
+    uint256 dataToBeSigned = SignatureHash(CScript(), signTx, NOT_AN_INPUT, SIGHASH_ALL);
+    assert(crypto_sign_detached(&mtx.joinSplitSig[0], NULL,
+                                dataToBeSigned.begin(), 32,
+                                joinSplitPrivKey) == 0);
+    return mtx;
+}
+
+TEST(Mempool, PreCheckLeavesFailedScriptsToAcceptToMemoryPool) {
+    FakeCoinsViewScripts fakeDB;
+    CCoinsViewCache view(&fakeDB);
+    CCoinsViewCache* pcoinsTipSaved = pcoinsTip;
+    pcoinsTip = &view;
+
+    CTransaction txValid = GetSpendingTransaction(0);
+    CTransaction txInvalid = GetSpendingTransaction(1);
+    std::vector<bool> vProofsVerified;
+
+    std::vector<const CTransaction*> vtx(1, &txValid);
+    EXPECT_TRUE(PreCheckTransactions(vtx, vProofsVerified));
+    EXPECT_EQ(vProofsVerified, std::vector<bool>(1, true));
+
+    // A failed script doesn't count against the proofs
+    vtx[0] = &txInvalid;
+    EXPECT_FALSE(PreCheckTransactions(vtx, vProofsVerified));
+    EXPECT_EQ(vProofsVerified, std::vector<bool>(1, true));
+
+    // and leaves the transaction's state to AcceptToMemoryPool
+    CValidationState state;
+    EXPECT_TRUE(PreValidateTransaction(txInvalid, state));
+    EXPECT_FALSE(state.IsInvalid());
+
+    pcoinsTip = pcoinsTipSaved;
+}
+
+TEST(Mempool, PreCheckRejectsInvalidProofs) {
+    FakeCoinsViewScripts fakeDB;
+    CCoinsViewCache view(&fakeDB);
+    CCoinsViewCache* pcoinsTipSaved = pcoinsTip;
+    pcoinsTip = &view;
+    ZCJoinSplit* pzcashParamsSaved = pzcashParams;
+    pzcashParams = ZCJoinSplit::Generate();
+
+    CTransaction txProof = GetTransactionWithInvalidProof();
+    CTransaction txValid = GetSpendingTransaction(0);
+    CTransaction txInvalid = GetSpendingTransaction(1);
+
+    // Rejected with the state CheckTransaction would set, so that
+    // AcceptToMemoryPool doesn't verify the proofs again
+    CValidationState state;
+    EXPECT_FALSE(PreValidateTransaction(txProof, state));
+    int nDoS = 0;
+    EXPECT_TRUE(state.IsInvalid(nDoS));
+    EXPECT_EQ(nDoS, 100);
+    EXPECT_EQ(state.GetRejectReason(), "bad-txns-joinsplit-verification-failed");
+
+    // In a batch, as for orphans, each transaction has its own proof result,
+    // whatever the scripts of the others
+    std::vector<const CTransaction*> vtx;
+    vtx.push_back(&txInvalid);
+    vtx.push_back(&txProof);
+    vtx.push_back(&txValid);
+    std::vector<bool> vProofsVerified;
+    EXPECT_FALSE(PreCheckTransactions(vtx, vProofsVerified));
+    ASSERT_EQ(vProofsVerified.size(), 3u);
+    EXPECT_TRUE(vProofsVerified[0]);
+    EXPECT_FALSE(vProofsVerified[1]);
+    EXPECT_TRUE(vProofsVerified[2]);
+
+    vtx.erase(vtx.begin());
+    EXPECT_TRUE(PreCheckTransactions(vtx, vProofsVerified));
+    ASSERT_EQ(vProofsVerified.size(), 2u);
+    EXPECT_FALSE(vProofsVerified[0]);
+    EXPECT_TRUE(vProofsVerified[1]);
+
+    delete pzcashParams;
+    pzcashParams = pzcashParamsSaved;
+    pcoinsTip = pcoinsTipSaved;
+}
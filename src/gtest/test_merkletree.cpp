@@ -10,6 +10,7 @@
 #include <iostream>
 
 #include <stdexcept>
+#include <thread>
 
 #include "utilstrencodings.h"
 #include "version.h"
@@ -299,3 +300,164 @@ TEST(merkletree, testZeroElements) {
         ASSERT_TRUE(newTree.root() == oldroot);
     }
 }
+
+TEST(merkletree, cachedRoots) {
+    ZCTestingIncrementalMerkleTree tree;
+    ZCTestingIncrementalMerkleTree copy;
+    std::vector<ZCTestingIncrementalWitness> witnesses;
+
+    for (int i = 0; i < 16; i++) {
+        uint256 leaf;
+        *leaf.begin() = i + 1;
+        uint256 oldroot = tree.root();
+
+        tree.append(leaf);
+        for (auto& witness : witnesses) {
+            witness.append(leaf);
+        }
+        witnesses.push_back(tree.witness());
+
+        // The cached root is dropped on append
+        ASSERT_TRUE(tree.root() != oldroot);
+
+        // A root cached before a copy and a root computed afresh agree
+        copy.append(leaf);
+        ASSERT_TRUE(copy.root() == tree.root());
+        ZCTestingIncrementalMerkleTree copy2 = tree;
+        ASSERT_TRUE(copy2.root() == tree.root());
+
+        for (auto& witness : witnesses) {
+            ASSERT_TRUE(witness.root() == tree.root());
+        }
+
+        // Deserializing over a tree with a cached root drops it
+        CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+        ss << tree;
+        ZCTestingIncrementalMerkleTree other;
+        other.root();
+        ss >> other;
+        ASSERT_TRUE(other.root() == tree.root());
+
+        CDataStream ss2(SER_DISK, PROTOCOL_VERSION);
+        ss2 << witnesses.front();
+        ZCTestingIncrementalWitness otherWitness = witnesses.back();
+        otherWitness.root();
+        ss2 >> otherWitness;
+        ASSERT_TRUE(otherWitness.root() == tree.root());
+    }
+}
+
+TEST(merkletree, cachedRootsShared) {
+    ZCTestingIncrementalMerkleTree tree;
+    for (int i = 0; i < 5; i++) {
+        uint256 leaf;
+        *leaf.begin() = i + 1;
+        tree.append(leaf);
+    }
+    ZCTestingIncrementalWitness witness = tree.witness();
+    ZCTestingIncrementalMerkleTree fresh = tree;
+    uint256 expected = fresh.root();
+
+    // Several threads filling in the cached roots of the same tree and
+    // witness all see the root computed afresh
+    std::vector<std::thread> threads;
+    std::vector<uint256> roots(8), witnessRoots(8);
+    for (size_t i = 0; i < roots.size(); i++) {
+        threads.emplace_back([&, i]() {
+            roots[i] = tree.root();
+            witnessRoots[i] = witness.root();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < roots.size(); i++) {
+        ASSERT_TRUE(roots[i] == expected);
+        ASSERT_TRUE(witnessRoots[i] == expected);
+    }
+}
+
+TEST(merkletree, appendBatch) {
+    for (size_t chunk = 1; chunk <= 7; chunk++) {
+        ZCTestingIncrementalMerkleTree tree;
+        ZCTestingIncrementalMerkleTree batchTree;
+        std::vector<ZCTestingIncrementalWitness> witnesses;
+        std::vector<ZCTestingIncrementalWitness> batchWitnesses;
+
+        for (size_t start = 0; start < 16; start += chunk) {
+            std::vector<libzcash::SHA256Compress> leaves;
+            for (size_t i = start; i < std::min<size_t>(start + chunk, 16); i++) {
+                uint256 leaf;
+                *leaf.begin() = i + 1;
+                leaves.push_back(leaf);
+            }
+
+            libzcash::MerkleSubtrees<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, libzcash::SHA256Compress> subtrees(
+                batchTree.size(), leaves.begin(), leaves.end());
+            for (auto& witness : batchWitnesses) {
+                witness.append_batch(subtrees, subtrees.start());
+            }
+
+            for (size_t i = 0; i < leaves.size(); i++) {
+                tree.append(leaves[i]);
+                for (auto& witness : witnesses) {
+                    witness.append(leaves[i]);
+                }
+            }
+            batchTree.append_batch(leaves.begin(), leaves.end());
+
+            // Witness the last leaf of the run, from a tree built a leaf at a time
+            witnesses.push_back(tree.witness());
+            ZCTestingIncrementalMerkleTree partial = batchTree;
+            batchWitnesses.push_back(partial.witness());
+
+            ASSERT_TRUE(tree == batchTree);
+            ASSERT_TRUE(tree.root() == batchTree.root());
+            for (size_t i = 0; i < witnesses.size(); i++) {
+                ASSERT_TRUE(witnesses[i] == batchWitnesses[i]);
+                ASSERT_TRUE(batchWitnesses[i].root() == tree.root());
+            }
+        }
+
+        // The tree is full, and a batch that doesn't fit leaves it unchanged
+        std::vector<libzcash::SHA256Compress> extra(1);
+        ASSERT_THROW(batchTree.append_batch(extra.begin(), extra.end()), std::runtime_error);
+        ASSERT_TRUE(tree == batchTree);
+    }
+}
+
+TEST(merkletree, appendBatchFromWithinRun) {
+    // A witness taken partway through a run, as for a note in the middle of a
+    // block, catches up on the rest of the run from its own position.
+    for (size_t chunk = 2; chunk <= 7; chunk++) {
+        for (size_t offset = 1; offset < chunk; offset++) {
+            ZCTestingIncrementalMerkleTree tree;
+
+            for (size_t start = 0; start + chunk <= 16; start += chunk) {
+                std::vector<libzcash::SHA256Compress> leaves;
+                for (size_t i = start; i < start + chunk; i++) {
+                    uint256 leaf;
+                    *leaf.begin() = i + 1;
+                    leaves.push_back(leaf);
+                }
+
+                libzcash::MerkleSubtrees<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, libzcash::SHA256Compress> subtrees(
+                    tree.size(), leaves.begin(), leaves.end());
+
+                ZCTestingIncrementalMerkleTree partial = tree;
+                partial.append_batch(leaves.begin(), leaves.begin() + offset);
+                ZCTestingIncrementalWitness witness = partial.witness();
+                ZCTestingIncrementalWitness batchWitness = partial.witness();
+
+                for (size_t i = offset; i < leaves.size(); i++) {
+                    witness.append(leaves[i]);
+                }
+                batchWitness.append_batch(subtrees, subtrees.start() + offset);
+                tree.append_batch(leaves.begin(), leaves.end());
+
+                ASSERT_TRUE(witness == batchWitness);
+                ASSERT_TRUE(batchWitness.root() == tree.root());
+            }
+        }
+    }
+}
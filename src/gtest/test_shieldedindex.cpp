@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "clientversion.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "shieldedindex.h"
+#include "streams.h"
+#include "zcash/IncrementalMerkleTree.hpp"
+
+static CTransaction GetJoinSplitTx(size_t nJoinSplits)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    for (size_t i = 0; i < nJoinSplits; i++) {
+        JSDescription jsdesc;
+        for (size_t n = 0; n < ZC_NUM_JS_INPUTS; n++) {
+            jsdesc.nullifiers[n] = GetRandHash();
+        }
+        for (size_t n = 0; n < ZC_NUM_JS_OUTPUTS; n++) {
+            jsdesc.commitments[n] = GetRandHash();
+        }
+        mtx.vjoinsplit.push_back(jsdesc);
+    }
+    return mtx;
+}
+
+TEST(shieldedindex_tests, ValueSerialization) {
+    uint256 txid = GetRandHash();
+
+    CNullifierIndexValue nf(txid, 1, 2, 300);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << nf;
+    EXPECT_EQ(32 + 4 + 4 + 4, ss.size());
+    CNullifierIndexValue nfRead;
+    ss >> nfRead;
+    EXPECT_EQ(txid, nfRead.txid);
+    EXPECT_EQ(1, nfRead.jsIndex);
+    EXPECT_EQ(2, nfRead.nullifierIndex);
+    EXPECT_EQ(300, nfRead.blockHeight);
+
+    CCommitmentIndexValue cm(txid, 3, 1, 400, (uint64_t)1 << 33);
+    ss << cm;
+    EXPECT_EQ(32 + 4 + 4 + 4 + 8, ss.size());
+    CCommitmentIndexValue cmRead;
+    ss >> cmRead;
+    EXPECT_EQ(txid, cmRead.txid);
+    EXPECT_EQ(3, cmRead.jsIndex);
+    EXPECT_EQ(1, cmRead.commitmentIndex);
+    EXPECT_EQ(400, cmRead.blockHeight);
+    EXPECT_EQ((uint64_t)1 << 33, cmRead.position);
+}
+
+TEST(shieldedindex_tests, CommitmentPositions) {
+    // The tree as of the previous block, whose root is the block's anchor
+    ZCIncrementalMerkleTree tree;
+    for (size_t i = 0; i < 5; i++) {
+        tree.append(GetRandHash());
+    }
+
+    // Entries for two transactions in a block, as ConnectBlock adds them
+    std::vector<CTransaction> vtx = {GetJoinSplitTx(2), GetJoinSplitTx(1)};
+    std::vector<std::pair<uint256, CNullifierIndexValue> > nullifierIndex;
+    std::vector<std::pair<uint256, CCommitmentIndexValue> > commitmentIndex;
+    size_t nCommitments = 0;
+    for (const CTransaction& tx : vtx) {
+        AddShieldedIndexEntries(tx, 10, tree.size() + nCommitments, nullifierIndex, commitmentIndex);
+        for (const JSDescription& jsdesc : tx.vjoinsplit) {
+            nCommitments += jsdesc.commitments.size();
+        }
+    }
+    ASSERT_EQ(3 * ZC_NUM_JS_INPUTS, nullifierIndex.size());
+    ASSERT_EQ(3 * ZC_NUM_JS_OUTPUTS, commitmentIndex.size());
+
+    // Each entry points back at its nullifier and commitment
+    for (const auto& entry : nullifierIndex) {
+        const CTransaction& tx = entry.second.txid == vtx[0].GetHash() ? vtx[0] : vtx[1];
+        ASSERT_EQ(tx.GetHash(), entry.second.txid);
+        EXPECT_EQ(entry.first, tx.vjoinsplit[entry.second.jsIndex].nullifiers[entry.second.nullifierIndex]);
+        EXPECT_EQ(10, entry.second.blockHeight);
+    }
+    for (const auto& entry : commitmentIndex) {
+        const CTransaction& tx = entry.second.txid == vtx[0].GetHash() ? vtx[0] : vtx[1];
+        ASSERT_EQ(tx.GetHash(), entry.second.txid);
+        EXPECT_EQ(entry.first, tx.vjoinsplit[entry.second.jsIndex].commitments[entry.second.commitmentIndex]);
+        EXPECT_EQ(10, entry.second.blockHeight);
+    }
+
+    // Appending the block's commitments to the anchor's tree, in block
+    // order, puts each one at its indexed position
+    ZCIncrementalMerkleTree blockTree = tree;
+    for (const auto& entry : commitmentIndex) {
+        EXPECT_EQ(blockTree.size(), entry.second.position);
+        blockTree.append(entry.first);
+    }
+    EXPECT_EQ(5 + 3 * ZC_NUM_JS_OUTPUTS, commitmentIndex.back().second.position + 1);
+
+    // The anchor's tree and the entries are enough to witness a note
+    const auto& entry = commitmentIndex[ZC_NUM_JS_OUTPUTS + 1];
+    ZCIncrementalMerkleTree witnessTree = tree;
+    for (const auto& other : commitmentIndex) {
+        if (other.second.position > entry.second.position) {
+            break;
+        }
+        witnessTree.append(other.first);
+    }
+    ZCIncrementalWitness witness = witnessTree.witness();
+    for (const auto& other : commitmentIndex) {
+        if (other.second.position > entry.second.position) {
+            witness.append(other.first);
+        }
+    }
+    EXPECT_EQ(blockTree.root(), witness.root());
+    EXPECT_EQ(entry.first, witness.element());
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+TEST(txdb_tests, BlockIndexSnapshotMustMatchDatabase) {
+    // Get temporary and unique path for the snapshot file.
+    boost::filesystem::path pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(pathTemp / "blocks");
+    std::map<std::string, std::string> mapArgsOld = mapArgs;
+    mapArgs["-datadir"] = pathTemp.string();
+    mapArgs["-blockindexsnapshot"] = "1";
+    ClearDatadirCache();
+
+    {
+        CBlockTreeDB db(1 << 20, true);
+        uint256 hashBestChain = GetRandHash();
+        std::vector<const CBlockIndex*> vBlocks;
+
+        // An unchanged database uses the snapshot, but only once
+        ASSERT_TRUE(db.WriteBlockIndexSnapshot(hashBestChain));
+        EXPECT_TRUE(db.LoadBlockIndexSnapshot(hashBestChain));
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+
+        // The coins database has moved to another block
+        ASSERT_TRUE(db.WriteBlockIndexSnapshot(hashBestChain));
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(GetRandHash()));
+        // A rejected snapshot is dropped
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+
+        // A block was stored in the last block file
+        ASSERT_TRUE(db.WriteBlockIndexSnapshot(hashBestChain));
+        CBlockFileInfo info;
+        info.nBlocks = 1;
+        info.nSize = 1000;
+        std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+        vFiles.push_back(std::make_pair(0, &info));
+        ASSERT_TRUE(db.WriteBatchSync(vFiles, 0, vBlocks));
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+
+        // A new block file was started
+        ASSERT_TRUE(db.WriteBlockIndexSnapshot(hashBestChain));
+        ASSERT_TRUE(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 1, vBlocks));
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+
+        // Without -blockindexsnapshot a matching snapshot is dropped too
+        ASSERT_TRUE(db.WriteBlockIndexSnapshot(hashBestChain));
+        mapArgs.erase("-blockindexsnapshot");
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+        mapArgs["-blockindexsnapshot"] = "1";
+        EXPECT_FALSE(db.LoadBlockIndexSnapshot(hashBestChain));
+    }
+
+    mapArgs = mapArgsOld;
+    ClearDatadirCache();
+    boost::filesystem::remove_all(pathTemp);
+}
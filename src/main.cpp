@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -30,6 +31,7 @@
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 
+#include <list>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -62,11 +64,15 @@ bool fExperimentalMode = false;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+bool fShieldedIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = true;
+bool fPublishRawBlocks = false;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -190,6 +196,7 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, the compact block awaiting its missing transactions
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -199,6 +206,18 @@ namespace {
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
+    /** Moving average of the size of the blocks we downloaded, in bytes. Protected by cs_main. */
+    double dAverageBlockDownloadSize = 0;
+
+    /** The peers we asked to announce new blocks as compact blocks, oldest first. Protected by cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** The last block we received that became the tip, as "block" and "cmpctblock" messages, so that
+     *  all the peers it is relayed to share one copy of each. Protected by cs_main. */
+    uint256 hashMostRecentBlock;
+    CSerializedNetMsg msgMostRecentBlock;
+    CSerializedNetMsg msgMostRecentCompactBlock;
+
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -251,8 +270,21 @@ struct CNodeState {
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Number and total size of the blocks we requested from this peer and got.
+    int nBlocksDownloaded;
+    uint64_t nBlockBytesDownloaded;
+    //! Moving average of the rate this peer delivers blocks at, in bytes per second.
+    double dBlockDownloadRate;
+    //! Moving average of the time from requesting a block to receiving it, in microseconds.
+    double dBlockResponseTime;
+    //! When we last received a block we requested from this peer (in microseconds), or 0.
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants new blocks announced as cmpctblock messages rather than invs.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us cmpctblocks if we request them (it sent a matching "sendcmpct").
+    bool fProvidesHeaderAndIDs;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -265,7 +297,14 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlocksDownloaded = 0;
+        nBlockBytesDownloaded = 0;
+        dBlockDownloadRate = 0;
+        dBlockResponseTime = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -324,6 +363,7 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -345,6 +385,51 @@ bool MarkBlockAsReceived(const uint256& hash) {
     return false;
 }
 
+// Requires cs_main.
+// Update the download statistics of a peer with a block it sent us in full, if we requested it from that peer.
+// Requests are pipelined, so a block is only timed from when the peer finished sending the previous one.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, size_t nSize) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    const QueuedBlock& queued = *itInFlight->second.second;
+
+    int64_t nNow = GetTimeMicros();
+    int64_t nTransferTime = std::max<int64_t>(nNow - std::max(queued.nTime, state->nLastBlockReceived), 1000);
+    double dRate = nSize * 1000000.0 / nTransferTime;
+    double dResponseTime = nNow - queued.nTime;
+    if (state->nBlocksDownloaded == 0) {
+        state->dBlockDownloadRate = dRate;
+        state->dBlockResponseTime = dResponseTime;
+    } else {
+        state->dBlockDownloadRate = 0.8 * state->dBlockDownloadRate + 0.2 * dRate;
+        state->dBlockResponseTime = 0.8 * state->dBlockResponseTime + 0.2 * dResponseTime;
+    }
+    state->nBlocksDownloaded++;
+    state->nBlockBytesDownloaded += nSize;
+    state->nLastBlockReceived = nNow;
+    dAverageBlockDownloadSize = dAverageBlockDownloadSize == 0 ? nSize : 0.95 * dAverageBlockDownloadSize + 0.05 * nSize;
+}
+
+// Requires cs_main.
+// The number of blocks to keep requested from a peer: enough for BLOCK_DOWNLOAD_QUEUE_TIME seconds
+// at the rate it delivered blocks so far, so that fast peers are given more of the download.
+int GetMaxBlocksInFlight(const CNodeState* state) {
+    if (state->nBlocksDownloaded == 0 || dAverageBlockDownloadSize == 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    double dBlocks = state->dBlockDownloadRate * BLOCK_DOWNLOAD_QUEUE_TIME / dAverageBlockDownloadSize;
+    return std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, (int)std::min<double>(dBlocks, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+}
+
+// Requires cs_main.
+// Whether a block in flight is late enough, given how fast the peer we requested it from usually is,
+// to request it from another peer.
+bool IsBlockDownloadLate(const QueuedBlock& queued, const CNodeState* state, int64_t nNow) {
+    int64_t nTimeout = std::max<int64_t>(1000000 * BLOCK_REREQUEST_TIMEOUT, 3 * state->dBlockResponseTime);
+    return queued.nTime < nNow - nTimeout;
+}
+
 // Requires cs_main.
 void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
     CNodeState *state = State(nodeid);
@@ -354,7 +439,7 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     int64_t nNow = GetTimeMicros();
-    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams)};
+    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams), std::shared_ptr<PartiallyDownloadedBlock>()};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
     state->nBlocksInFlight++;
@@ -362,6 +447,46 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+// Whether our tip is recent enough to fetch announced blocks directly, rather than
+// leaving them to the parallel download in SendMessages.
+bool CanDirectFetch(const Consensus::Params &consensusParams)
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20;
+}
+
+// Requires cs_main.
+// Ask a peer that just gave us a new tip to announce the next ones as compact blocks,
+// keeping at most three such peers (as BIP 152 suggests).
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(const CNodeState* nodestate, CNode* pfrom)
+{
+    if (!nodestate->fProvidesHeaderAndIDs)
+        return;
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == pfrom->GetId()) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+            return;
+        }
+    }
+    bool fAnnounceUsingCMPCTBLOCK = false;
+    uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
+    if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
+        NodeId nodeid = lNodesAnnouncingHeaderAndIDs.front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeid) {
+                pnode->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+                break;
+            }
+        }
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    fAnnounceUsingCMPCTBLOCK = true;
+    pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -415,8 +540,9 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+ *  at most count entries. pindexWaitingFor is set to the first block that is missing but already in
+ *  flight, from any peer, if one is seen before vBlocks is filled. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex*& pindexWaitingFor) {
     if (count == 0)
         return;
 
@@ -493,6 +619,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -512,6 +639,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nMaxBlocksInFlight = GetMaxBlocksInFlight(state);
+    stats.nBlocksDownloaded = state->nBlocksDownloaded;
+    stats.nBlockBytesDownloaded = state->nBlockBytesDownloaded;
+    stats.dBlockDownloadRate = state->dBlockDownloadRate;
+    stats.dBlockResponseTime = state->dBlockResponseTime / 1000000.0;
     return true;
 }
 
@@ -1053,7 +1185,7 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee)
+                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool fProofsVerified)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1070,7 +1202,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
+    // Proofs verified by PreValidateTransaction are not verified again under cs_main
+    auto verifier = fProofsVerified ? libzcash::ProofVerifier::Disabled() : libzcash::ProofVerifier::Strict();
     if (!CheckTransaction(tx, state, verifier))
         return error("AcceptToMemoryPool: CheckTransaction failed");
 
@@ -1390,6 +1523,84 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+namespace {
+
+/**
+ * Equihash solutions of recently served headers, most recently used first.
+ * Block index entries do not keep their solution in memory once they have
+ * been written to the block tree DB.
+ */
+typedef std::list<std::pair<uint256, std::vector<unsigned char> > > SolutionList;
+CCriticalSection cs_solutionCache;
+SolutionList lruSolutions;
+std::map<uint256, SolutionList::iterator> mapSolutionCache;
+
+bool GetCachedSolution(const uint256& hash, std::vector<unsigned char>& solution)
+{
+    LOCK(cs_solutionCache);
+    std::map<uint256, SolutionList::iterator>::iterator it = mapSolutionCache.find(hash);
+    if (it == mapSolutionCache.end())
+        return false;
+    lruSolutions.splice(lruSolutions.begin(), lruSolutions, it->second);
+    solution = it->second->second;
+    return true;
+}
+
+void CacheSolution(const uint256& hash, const std::vector<unsigned char>& solution)
+{
+    LOCK(cs_solutionCache);
+    std::map<uint256, SolutionList::iterator>::iterator it = mapSolutionCache.find(hash);
+    if (it != mapSolutionCache.end()) {
+        lruSolutions.splice(lruSolutions.begin(), lruSolutions, it->second);
+        return;
+    }
+    lruSolutions.push_front(std::make_pair(hash, solution));
+    mapSolutionCache[hash] = lruSolutions.begin();
+    if (lruSolutions.size() > HEADER_SOLUTION_CACHE_SIZE) {
+        mapSolutionCache.erase(lruSolutions.back().first);
+        lruSolutions.pop_back();
+    }
+}
+
+} // anon namespace
+
+bool ReadBlockHeader(CBlockHeader& header, const CBlockIndex* pindex)
+{
+    header = pindex->GetBlockHeader();
+    if (!header.nSolution.empty())
+        return true;
+
+    uint256 hash = pindex->GetBlockHash();
+    if (GetCachedSolution(hash, header.nSolution))
+        return true;
+
+    CDiskBlockIndex diskindex;
+    if (pblocktree->ReadDiskBlockIndex(hash, diskindex) && !diskindex.nSolution.empty()) {
+        header.nSolution = diskindex.nSolution;
+    } else if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // Read just the header from the start of the block
+        CAutoFile filein(OpenBlockFile(pindex->GetBlockPos(), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockHeader: OpenBlockFile failed for %s", pindex->GetBlockPos().ToString());
+        CBlockHeader diskheader;
+        try {
+            filein >> diskheader;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+        }
+        header.nSolution = diskheader.nSolution;
+    } else {
+        return error("%s: no solution available for %s", __func__, hash.ToString());
+    }
+
+    if (header.GetHash() != hash)
+        return error("ReadBlockHeader(): GetHash() doesn't match index for %s", pindex->ToString());
+
+    CacheSolution(hash, header.nSolution);
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     CAmount nSubsidy = 12.5 * COIN;
@@ -1883,6 +2094,13 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    bool fUpdateIndexes = !pfClean && (fAddressIndex || fSpentIndex);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<uint256, CNullifierIndexValue> > nullifierIndex;
+    std::vector<std::pair<uint256, CCommitmentIndexValue> > commitmentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
@@ -1904,15 +2122,31 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
 
         // remove outputs
+        view.ModifyUtxoCommitment().RemoveCoins(hash, *outs);
         outs->Clear();
         }
 
+        if (fUpdateIndexes && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+                uint160 hashBytes;
+                AddressIndexType addressType = GetAddressIndexType(out.scriptPubKey, hashBytes);
+                if (addressType != ADDRESS_INDEX_NONE) {
+                    addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue()));
+                }
+            }
+        }
+
         // unspend nullifiers
         BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
             BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
                 view.SetNullifier(nf, false);
             }
         }
+        // Only the keys are used, to erase the entries
+        if (!pfClean && fShieldedIndex)
+            AddShieldedIndexEntries(tx, pindex->nHeight, 0, nullifierIndex, commitmentIndex);
 
         // restore inputs
         if (i > 0) { // not coinbases
@@ -1924,10 +2158,33 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
+
+                const CCoins* coins = view.AccessCoins(out.hash);
+                CUtxoCommitment& utxoCommitment = view.ModifyUtxoCommitment();
+                utxoCommitment.AddOutput(out.hash, out.n, undo.txout, coins->nHeight, coins->fCoinBase);
+                if (undo.nHeight != 0)
+                    utxoCommitment.nTransactions++;
+
+                if (fUpdateIndexes) {
+                    uint160 hashBytes;
+                    AddressIndexType addressType = GetAddressIndexType(undo.txout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        // The output is unspent again
+                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), -undo.txout.nValue));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
 
+    if (fUpdateIndexes && !pblocktree->UpdateAddressIndexes(addressIndex, addressUnspentIndex, spentIndex, true))
+        return AbortNode(state, "Failed to write address index");
+    if (!pfClean && fShieldedIndex && !pblocktree->UpdateShieldedIndex(nullifierIndex, commitmentIndex, true))
+        return AbortNode(state, "Failed to write shielded index");
+
     // set the old best anchor back
     view.PopAnchor(blockUndo.old_tree_root);
 
@@ -1974,6 +2231,109 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** A JoinSplit proof or script check of a transaction being pre-validated */
+class CTxPreCheck
+{
+private:
+    CScriptCheck scriptCheck;
+    const CTransaction *ptx;
+    //! The JoinSplit whose proof to verify, or -1 to run scriptCheck
+    int nJoinSplit;
+
+public:
+    CTxPreCheck(): ptx(NULL), nJoinSplit(-1) {}
+    CTxPreCheck(const CTransaction& txIn, int nJoinSplitIn) : ptx(&txIn), nJoinSplit(nJoinSplitIn) {}
+    explicit CTxPreCheck(CScriptCheck& check) : ptx(NULL), nJoinSplit(-1) { scriptCheck.swap(check); }
+
+    bool operator()() {
+        if (nJoinSplit < 0)
+            return scriptCheck();
+        auto verifier = libzcash::ProofVerifier::Strict();
+        return ptx->vjoinsplit[nJoinSplit].Verify(*pzcashParams, verifier, ptx->joinSplitPubKey);
+    }
+
+    void swap(CTxPreCheck& check) {
+        scriptCheck.swap(check.scriptCheck);
+        std::swap(ptx, check.ptx);
+        std::swap(nJoinSplit, check.nJoinSplit);
+    }
+};
+
+static CCheckQueue<CTxPreCheck> txprecheckqueue(128);
+/** Serializes the users of txprecheckqueue, which takes one batch at a time */
+static CCriticalSection cs_txprecheckqueue;
+
+void ThreadTxPreCheck() {
+    RenameThread("zcash-txprech");
+    txprecheckqueue.Thread();
+}
+
+bool PreCheckTransactions(const std::vector<const CTransaction*>& vtx, std::vector<bool>& vProofsVerified)
+{
+    // The queue stops a batch at its first failed check, so each transaction's
+    // proofs are a batch of their own, and the scripts another.
+    vProofsVerified.assign(vtx.size(), true);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vtx[i]->vjoinsplit.empty())
+            continue;
+        std::vector<CTxPreCheck> vChecks;
+        for (unsigned int j = 0; j < vtx[i]->vjoinsplit.size(); j++)
+            vChecks.push_back(CTxPreCheck(*vtx[i], j));
+
+        LOCK(cs_txprecheckqueue);
+        CCheckQueueControl<CTxPreCheck> control(&txprecheckqueue);
+        control.Add(vChecks);
+        vProofsVerified[i] = control.Wait();
+    }
+
+    std::vector<CTxPreCheck> vChecks;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t n = 0; n < vtx.size(); n++) {
+            // A transaction whose proofs failed is rejected without its scripts
+            if (!vProofsVerified[n])
+                continue;
+            const CTransaction* ptx = vtx[n];
+            for (unsigned int i = 0; i < ptx->vin.size(); i++) {
+                const COutPoint &prevout = ptx->vin[i].prevout;
+                const CCoins* coins = view.AccessCoins(prevout.hash);
+                if (!coins || !coins->IsAvailable(prevout.n))
+                    continue;
+                // The check keeps its own copy of the spent scriptPubKey
+                CScriptCheck check(*coins, *ptx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true);
+                vChecks.push_back(CTxPreCheck(check));
+            }
+        }
+    }
+    if (vChecks.empty())
+        return true;
+
+    LOCK(cs_txprecheckqueue);
+    CCheckQueueControl<CTxPreCheck> control(&txprecheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+bool PreValidateTransaction(const CTransaction& tx, CValidationState& state)
+{
+    // The context-free rules are cheap, so they go first
+    auto verifier = libzcash::ProofVerifier::Disabled();
+    if (!CheckTransaction(tx, state, verifier))
+        return error("PreValidateTransaction: CheckTransaction failed");
+    if (tx.IsCoinBase())
+        return false;
+
+    std::vector<const CTransaction*> vtx(1, &tx);
+    std::vector<bool> vProofsVerified;
+    PreCheckTransactions(vtx, vProofsVerified);
+    if (!vProofsVerified[0])
+        return state.DoS(100, error("PreValidateTransaction: joinsplit does not verify"),
+                         REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+    return true;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2105,6 +2465,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<uint256, CNullifierIndexValue> > nullifierIndex;
+    std::vector<std::pair<uint256, CCommitmentIndexValue> > commitmentIndex;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
     // Construct the incremental merkle tree at the current
@@ -2124,6 +2489,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         // match what we asked for.
         assert(tree.root() == old_tree_root);
     }
+    std::vector<libzcash::SHA256Compress> noteCommitments;
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -2162,17 +2528,67 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             control.Add(vChecks);
         }
 
+        if (!fJustCheck && !tx.IsCoinBase()) {
+            // Remove the spent outputs from the UTXO set commitment, while
+            // their coins still carry the height and coinbase flag
+            CUtxoCommitment& utxoCommitment = view.ModifyUtxoCommitment();
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                utxoCommitment.RemoveOutput(txin.prevout.hash, txin.prevout.n, coins->vout[txin.prevout.n], coins->nHeight, coins->fCoinBase);
+            }
+
+            if (fAddressIndex || fSpentIndex) {
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint &prevout = tx.vin[j].prevout;
+                    const CTxOut &out = view.AccessCoins(prevout.hash)->vout[prevout.n];
+                    uint160 hashBytes;
+                    AddressIndexType addressType = GetAddressIndexType(out.scriptPubKey, hashBytes);
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), j, true), -out.nValue));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, out.nValue, addressType, hashBytes)));
+                }
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
-        BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
-            BOOST_FOREACH(const uint256 &note_commitment, joinsplit.commitments) {
-                // Insert the note commitments into our temporary tree.
+        if (!fJustCheck) {
+            CUtxoCommitment& utxoCommitment = view.ModifyUtxoCommitment();
+            if (i > 0) {
+                // Undo data carries the height of exactly the spends that pruned their coins
+                BOOST_FOREACH(const CTxInUndo& undo, blockundo.vtxundo.back().vprevout) {
+                    if (undo.nHeight != 0)
+                        utxoCommitment.nTransactions--;
+                }
+            }
+            utxoCommitment.AddCoins(tx.GetHash(), *view.AccessCoins(tx.GetHash()));
+        }
 
-                tree.append(note_commitment);
+        // Positions continue from the tree as of the previous block
+        if (!fJustCheck && fShieldedIndex)
+            AddShieldedIndexEntries(tx, pindex->nHeight, tree.size() + noteCommitments.size(), nullifierIndex, commitmentIndex);
+        BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
+            // The note commitments are inserted into our temporary tree all
+            // at once below.
+            noteCommitments.insert(noteCommitments.end(), joinsplit.commitments.begin(), joinsplit.commitments.end());
+        }
+
+        if (!fJustCheck && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+                uint160 hashBytes;
+                AddressIndexType addressType = GetAddressIndexType(out.scriptPubKey, hashBytes);
+                if (addressType != ADDRESS_INDEX_NONE) {
+                    addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
+                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, tx.GetHash(), k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+                }
             }
         }
 
@@ -2180,6 +2596,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
+    tree.append_batch(noteCommitments.begin(), noteCommitments.end());
+
     view.PushAnchor(tree);
     if (!fJustCheck) {
         pindex->hashAnchorEnd = tree.root();
@@ -2227,6 +2645,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fAddressIndex || fSpentIndex)
+        if (!pblocktree->UpdateAddressIndexes(addressIndex, addressUnspentIndex, spentIndex, false))
+            return AbortNode(state, "Failed to write address index");
+
+    if (fShieldedIndex)
+        if (!pblocktree->UpdateShieldedIndex(nullifierIndex, commitmentIndex, false))
+            return AbortNode(state, "Failed to write shielded index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2313,15 +2739,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 vFiles.push_back(make_pair(*it, &vinfoBlockFile[*it]));
                 setDirtyFileInfo.erase(it++);
             }
-            std::vector<const CBlockIndex*> vBlocks;
-            vBlocks.reserve(setDirtyBlockIndex.size());
-            for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                vBlocks.push_back(*it);
-                setDirtyBlockIndex.erase(it++);
-            }
+            std::vector<CBlockIndex*> vDirtyBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+            setDirtyBlockIndex.clear();
+            std::vector<const CBlockIndex*> vBlocks(vDirtyBlocks.begin(), vDirtyBlocks.end());
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Files to write to block index database");
             }
+            // The solutions are in the block tree DB now, so stop holding
+            // them in the index; the newest stay in the header cache.
+            BOOST_FOREACH(CBlockIndex* pindex, vDirtyBlocks) {
+                if (!pindex->nSolution.empty()) {
+                    CacheSolution(pindex->GetBlockHash(), pindex->nSolution);
+                    std::vector<unsigned char>().swap(pindex->nSolution);
+                }
+            }
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -2670,6 +3101,26 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     return true;
 }
 
+/**
+ * Serialize the block at pindex once for the listeners that publish it, from
+ * pblock if that is the block, or else from disk.
+ */
+static CSerializedBlockRef SerializeTipForListeners(const CBlockIndex *pindex, const CBlock *pblock) {
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    if (pblock && pblock->GetHash() == pindex->GetBlockHash()) {
+        ss << *pblock;
+    } else {
+        LOCK(cs_main);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            LogPrintf("%s: Can't read block %s from disk\n", __func__, pindex->GetBlockHash().ToString());
+            return CSerializedBlockRef();
+        }
+        ss << block;
+    }
+    return std::make_shared<const std::vector<unsigned char> >(ss.begin(), ss.end());
+}
+
 /**
  * Make the best chain active, in multiple steps. The result is either failure
  * or an activated best chain. pblock is either NULL or a pointer to a block
@@ -2709,13 +3160,39 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock) {
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                // Peers that asked for compact block announcements get the block
+                // just received as one instead of an inv.
+                CInv inv(MSG_BLOCK, hashNewTip);
+                LOCK2(cs_main, cs_vNodes);
+                if (pblock && pblock->GetHash() == hashNewTip) {
+                    hashMostRecentBlock = hashNewTip;
+                    msgMostRecentBlock = SerializeNetMessage("block", *pblock);
+                    msgMostRecentCompactBlock = SerializeNetMessage("cmpctblock", CBlockHeaderAndShortTxIDs(*pblock));
+                }
+                BOOST_FOREACH(CNode* pnode, vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    CNodeState *nodestate = State(pnode->GetId());
+                    if (hashMostRecentBlock == hashNewTip && nodestate && nodestate->fPreferHeaderAndIDs) {
+                        {
+                            LOCK(pnode->cs_inventory);
+                            if (pnode->filterInventoryKnown.contains(inv.hash))
+                                continue;
+                        }
+                        pnode->PushSerializedMessage(msgMostRecentCompactBlock);
+                        pnode->AddInventoryKnown(inv);
+                    } else {
+                        pnode->PushInventory(inv);
+                    }
+                }
             }
-            // Notify external listeners about the new tip.
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            // Notify external listeners about the new tip. The block is
+            // usually the one just received, so raw block publishers get it
+            // without going back to disk.
+            CSerializedBlockRef blockNewTip;
+            if (fPublishRawBlocks)
+                blockNewTip = SerializeTipForListeners(pindexNewTip, pblock);
+            GetMainSignals().UpdatedBlockTip(pindexNewTip, blockNewTip);
             uiInterface.NotifyBlockTip(hashNewTip);
         }
     } while(pindexMostWork != chainActive.Tip());
@@ -3034,10 +3511,14 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
-    // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state, verifier))
+    // Check transactions. The JoinSplit proofs of transactions in our mempool
+    // were verified when they were accepted, and the txid commits to them.
+    auto disabledVerifier = libzcash::ProofVerifier::Disabled();
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        bool fVerified = !tx.vjoinsplit.empty() && mempool.exists(tx.GetHash());
+        if (!CheckTransaction(tx, state, fVerified ? disabledVerifier : verifier))
             return error("CheckBlock(): CheckTransaction failed");
+    }
 
     unsigned int nSigOps = 0;
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
@@ -3268,6 +3749,9 @@ static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned
 
 bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp)
 {
+    // Don't get too far ahead of the asynchronous validation listeners.
+    LimitValidationInterfaceQueue();
+
     // Preliminary checks
     auto verifier = libzcash::ProofVerifier::Disabled();
     bool checked = CheckBlock(*pblock, state, verifier);
@@ -3495,10 +3979,18 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+bool WriteBlockIndexSnapshot()
+{
+    LOCK(cs_main);
+    if (!setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty())
+        return error("%s: block index has not been flushed", __func__);
+    return pblocktree->WriteBlockIndexSnapshot(pcoinsTip->GetBestBlock());
+}
+
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(pcoinsTip->GetBestBlock()))
         return false;
 
     boost::this_thread::interruption_point();
@@ -3589,6 +4081,14 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("shieldedindex", fShieldedIndex);
+    LogPrintf("%s: shielded index %s\n", __func__, fShieldedIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -3767,6 +4267,12 @@ bool InitBlockIndex() {
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", false);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fShieldedIndex = GetBoolArg("-shieldedindex", DEFAULT_SHIELDEDINDEX);
+    pblocktree->WriteFlag("shieldedindex", fShieldedIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4198,15 +4704,20 @@ void static ProcessGetData(CNode* pfrom)
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
+        if (pfrom->IsSendBufferFull())
             break;
 
         const CInv &inv = *it;
+        bool fBlock = inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK;
+        // Blocks are large, so they wait for room in the send buffers of all peers together
+        if (fBlock && pfrom->IsSendBufferTotalFull())
+            break;
+
         {
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (fBlock)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -4231,32 +4742,50 @@ void static ProcessGetData(CNode* pfrom)
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    // The new tip, which many peers ask for at once, goes out from one shared copy
+                    if (inv.hash == hashMostRecentBlock && inv.type == MSG_BLOCK)
+                        pfrom->PushSerializedMessage(msgMostRecentBlock);
+                    else if (inv.hash == hashMostRecentBlock && inv.type == MSG_CMPCT_BLOCK)
+                        pfrom->PushSerializedMessage(msgMostRecentCompactBlock);
+                    else
                     {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter)
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_BLOCK)
+                            pfrom->PushMessage("block", block);
+                        else if (inv.type == MSG_CMPCT_BLOCK)
                         {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage("merkleblock", merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                            // A peer asking for an old block won't have a mempool that
+                            // helps with it, so it gets the full block instead.
+                            if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block);
+                                pfrom->PushMessage("cmpctblock", cmpctblock);
+                            } else
+                                pfrom->PushMessage("block", block);
+                        }
+                        else // MSG_FILTERED_BLOCK)
+                        {
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter)
+                            {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage("merkleblock", merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    if (!pfrom->filterInventoryKnown.contains(pair.second))
+                                        pfrom->PushMessage("tx", block.vtx[pair.first]);
+                            }
+                            // else
+                                // no response
                         }
-                        // else
-                            // no response
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -4278,9 +4807,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSerializedNetMsg>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSerializedMessage((*mi).second);
                         pushed = true;
                     }
                 }
@@ -4302,7 +4831,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -4321,6 +4850,125 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/** Process a block a peer sent us, in full or as a compact block we rebuilt. */
+void static ProcessBlockFromPeer(CNode* pfrom, CBlock& block)
+{
+    CValidationState state;
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(state, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", string("block"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+        return;
+    }
+
+    // The peer was first to give us our new tip, so have it announce the next ones
+    // as compact blocks.
+    LOCK(cs_main);
+    if (!IsInitialBlockDownload() && chainActive.Tip()->GetBlockHash() == block.GetHash())
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(State(pfrom->GetId()), pfrom);
+}
+
+/**
+ * Try the orphans that spend the outputs of newly accepted transactions, then
+ * the orphans that spend theirs, and so on. Each generation of orphans is
+ * pre-validated as one batch without cs_main, and cs_main is only taken to
+ * accept them into the mempool.
+ */
+void static ProcessOrphanTransactions(vector<uint256> vWorkQueue)
+{
+    set<NodeId> setMisbehaving;
+    while (!vWorkQueue.empty())
+    {
+        vector<CTransaction> vOrphans;
+        vector<NodeId> vFromPeer;
+        {
+            LOCK(cs_main);
+            set<uint256> setQueued;
+            BOOST_FOREACH(const uint256& hash, vWorkQueue)
+            {
+                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(hash);
+                if (itByPrev == mapOrphanTransactionsByPrev.end())
+                    continue;
+                BOOST_FOREACH(const uint256& orphanHash, itByPrev->second)
+                {
+                    const COrphanTx& orphan = mapOrphanTransactions[orphanHash];
+                    if (setMisbehaving.count(orphan.fromPeer) || !setQueued.insert(orphanHash).second)
+                        continue;
+                    vOrphans.push_back(orphan.tx);
+                    vFromPeer.push_back(orphan.fromPeer);
+                }
+            }
+        }
+        vWorkQueue.clear();
+        if (vOrphans.empty())
+            break;
+
+        // An orphan whose proofs don't verify is rejected as it is, and the
+        // others' proofs aren't verified again by AcceptToMemoryPool
+        vector<const CTransaction*> vpOrphans;
+        BOOST_FOREACH(const CTransaction& orphanTx, vOrphans)
+            vpOrphans.push_back(&orphanTx);
+        vector<bool> vProofsVerified;
+        PreCheckTransactions(vpOrphans, vProofsVerified);
+
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < vOrphans.size(); i++)
+        {
+            const CTransaction& orphanTx = vOrphans[i];
+            uint256 orphanHash = orphanTx.GetHash();
+            NodeId fromPeer = vFromPeer[i];
+            // It may have been accepted or evicted while cs_main was released
+            if (!mapOrphanTransactions.count(orphanHash) || setMisbehaving.count(fromPeer))
+                continue;
+            bool fMissingInputs2 = false;
+            // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+            // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+            // anyone relaying LegitTxX banned)
+            CValidationState stateDummy;
+            if (!vProofsVerified[i])
+                stateDummy.DoS(100, error("ProcessOrphanTransactions: joinsplit does not verify"),
+                               REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+
+            if (vProofsVerified[i] &&
+                AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2, false, true))
+            {
+                LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                RelayTransaction(orphanTx);
+                vWorkQueue.push_back(orphanHash);
+                EraseOrphanTx(orphanHash);
+            }
+            else if (!fMissingInputs2)
+            {
+                int nDos = 0;
+                if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                {
+                    // Punish peer that gave us an invalid orphan tx
+                    Misbehaving(fromPeer, nDos);
+                    setMisbehaving.insert(fromPeer);
+                    LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                }
+                // Has inputs but not accepted to mempool
+                // Probably non-standard or insufficient fee/priority
+                LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                EraseOrphanTx(orphanHash);
+                assert(recentRejects);
+                recentRejects->insert(orphanHash);
+            }
+            mempool.check(pcoinsTip);
+        }
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -4474,6 +5122,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide compact blocks, but don't
+            // want new blocks announced that way unless we ask for it later.
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
     }
 
 
@@ -4584,9 +5240,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     // not a direct successor.
                     pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
-                    if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
+                    if (CanDirectFetch(chainparams.GetConsensus()) &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // Peers that support it send the block as a compact block,
+                        // which we rebuild from our mempool.
+                        vToFetch.push_back(CInv(nodestate->fProvidesHeaderAndIDs ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash));
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -4700,7 +5358,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex))
         {
-            vHeaders.push_back(pindex->GetBlockHeader());
+            CBlockHeader header;
+            if (!ReadBlockHeader(header, pindex))
+                break;
+            vHeaders.push_back(header);
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
@@ -4711,22 +5372,31 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else if (strCommand == "tx")
     {
         vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(inv.hash);
+            mapAlreadyAskedFor.erase(inv);
+            fAlreadyHave = AlreadyHave(inv);
+        }
 
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv);
+        // Verify the proofs and signatures before taking cs_main for the rest
+        bool fProofsVerified = !fAlreadyHave && PreValidateTransaction(tx, state);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
+        {
+        LOCK(cs_main);
+
+        if (!state.IsInvalid() && !AlreadyHave(inv) &&
+            AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, fProofsVerified))
         {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
@@ -4736,60 +5406,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 pfrom->id, pfrom->cleanSubVer,
                 tx.GetHash().ToString(),
                 mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
         }
         // TODO: currently, prohibit joinsplits from entering mapOrphans
         else if (fMissingInputs && tx.vjoinsplit.size() == 0)
@@ -4835,6 +5451,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (nDoS > 0)
                 Misbehaving(pfrom->GetId(), nDoS);
         }
+        }
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTransactions(vWorkQueue);
     }
 
 
@@ -4894,6 +5514,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        size_t nSize = vRecv.size();
         CBlock block;
         vRecv >> block;
 
@@ -4902,23 +5523,229 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         pfrom->AddInventoryKnown(inv);
 
+        {
+            LOCK(cs_main);
+            // Only blocks sent in full are timed. Most of a block rebuilt from
+            // a compact block came from our mempool, not over the wire.
+            UpdateBlockDownloadStats(pfrom->GetId(), inv.hash, nSize);
+        }
+
+        ProcessBlockFromPeer(pfrom, block);
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+        LOCK(cs_main);
+
+        if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+            // Doesn't connect (or is genesis), so ask for the headers leading to it instead
+            if (!IsInitialBlockDownload())
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+            return true;
+        }
+
+        CBlockIndex *pindex = NULL;
         CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(state, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+        if (!AcceptBlockHeader(cmpctblock.header, state, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header received in cmpctblock");
             }
         }
 
+        uint256 hash = pindex->GetBlockHash();
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+        UpdateBlockAvailability(pfrom->GetId(), hash);
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator blockInFlightIt = mapBlocksInFlight.find(hash);
+        bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+        if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+            return true;
+
+        if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                pindex->nTx != 0) { // We had this block at some point, but pruned it
+            if (fAlreadyInFlight) {
+                // We requested this block for some reason, but our mempool will
+                // probably be useless, so we just grab the block via normal getdata
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                pfrom->PushMessage("getdata", vInv);
+            }
+            return true;
+        }
+
+        // If we're not close to tip yet, give up and let parallel block fetch work its magic
+        if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+            return true;
+
+        CNodeState *nodestate = State(pfrom->GetId());
+
+        // Only rebuild blocks close to our tip, where the mempool is of use
+        if (pindex->nHeight <= chainActive.Height() + 2) {
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+                    (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+                if (!fAlreadyInFlight) {
+                    MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+                    blockInFlightIt = mapBlocksInFlight.find(hash);
+                } else if (blockInFlightIt->second.second->partialBlock) {
+                    // We are already waiting for the transactions of this block
+                    return true;
+                }
+
+                std::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+                ReadStatus status = partialBlock->InitData(cmpctblock);
+                if (status == READ_STATUS_INVALID) {
+                    MarkBlockAsReceived(hash); // Reset in-flight state in case of whitelist
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("peer=%d sent us an invalid compact block", pfrom->id);
+                } else if (status == READ_STATUS_FAILED) {
+                    // Short ID collision; the block is in flight already, so just request it in full
+                    vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    pfrom->PushMessage("getdata", vInv);
+                    return true;
+                }
+
+                BlockTransactionsRequest req;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock->IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty()) {
+                    // The mempool had every transaction
+                    status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+                    if (status == READ_STATUS_OK) {
+                        fBlockReconstructed = true;
+                    } else {
+                        vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                        pfrom->PushMessage("getdata", vInv);
+                    }
+                } else {
+                    req.blockhash = hash;
+                    blockInFlightIt->second.second->partialBlock = partialBlock;
+                    pfrom->PushMessage("getblocktxn", req);
+                }
+            } else {
+                // The block is in flight from another peer, or this one has too
+                // many blocks in flight. Use it only if the mempool has it all.
+                PartiallyDownloadedBlock tempBlock(&mempool);
+                if (tempBlock.InitData(cmpctblock) == READ_STATUS_OK) {
+                    bool fComplete = true;
+                    for (size_t i = 0; i < cmpctblock.BlockTxCount() && fComplete; i++)
+                        fComplete = tempBlock.IsTxAvailable(i);
+                    if (fComplete && tempBlock.FillBlock(block, std::vector<CTransaction>()) == READ_STATUS_OK)
+                        fBlockReconstructed = true;
+                }
+            }
+        } else if (fAlreadyInFlight) {
+            // We requested this block, but it's far into the future, so our
+            // mempool will probably be useless; request the block normally
+            vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+            pfrom->PushMessage("getdata", vInv);
+            return true;
+        }
+        } // Don't hold cs_main when we call into ProcessNewBlock
+
+        if (fBlockReconstructed)
+            ProcessBlockFromPeer(pfrom, block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer=%d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Answer requests for older blocks with the full block, so that a
+            // peer can't make us read from disk much more than it downloads.
+            LogPrint("net", "peer=%d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer=%d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+        LOCK(cs_main);
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+        if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                it->second.first != pfrom->GetId()) {
+            LogPrint("net", "peer=%d sent us block transactions for block we weren't expecting\n", pfrom->id);
+            return true;
+        }
+
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock = it->second.second->partialBlock;
+        it->second.second->partialBlock.reset();
+        ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+            Misbehaving(pfrom->GetId(), 100);
+            return error("peer=%d sent us invalid compact block/non-matching block transactions", pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Might have been a short ID collision; fall back to the full block
+            vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+            pfrom->PushMessage("getdata", vInv);
+        } else {
+            fBlockReconstructed = true;
+        }
+        } // Don't hold cs_main when we call into ProcessNewBlock
+
+        if (fBlockReconstructed)
+            ProcessBlockFromPeer(pfrom, block);
     }
 
 
@@ -5192,7 +6019,7 @@ bool ProcessMessages(CNode* pfrom)
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
+        if (pfrom->IsSendBufferFull())
             break;
 
         // get next message
@@ -5416,54 +6243,6 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             GetMainSignals().Broadcast(nTimeBestReceived);
         }
 
-        //
-        // Message: inventory
-        //
-        vector<CInv> vInv;
-        vector<CInv> vInvWait;
-        {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
-            {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
-                {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
-
-                    if (fTrickleWait)
-                    {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
-                }
-
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
-                {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
-                }
-            }
-            pto->vInventoryToSend = vInvWait;
-        }
-        if (!vInv.empty())
-            pto->PushMessage("inv", vInv);
-
         // Detect whether we're stalling
         int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -5500,10 +6279,29 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nMaxBlocksInFlight = GetMaxBlocksInFlight(&state);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nMaxBlocksInFlight) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex *pindexWaitingFor = NULL;
+            unsigned int nCount = nMaxBlocksInFlight - state.nBlocksInFlight;
+            FindNextBlocksToDownload(pto->GetId(), nCount, vToDownload, staller, pindexWaitingFor);
+            // If the first block we're waiting for is late from a slower peer, request it from this one
+            // as well, before it holds back the download window.
+            if (pindexWaitingFor && state.nBlocksDownloaded > 0) {
+                map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindexWaitingFor->GetBlockHash());
+                CNodeState *stateHolder = State(itInFlight->second.first);
+                const QueuedBlock& queued = *itInFlight->second.second;
+                if (itInFlight->second.first != pto->GetId() && !queued.partialBlock &&
+                        state.dBlockDownloadRate > stateHolder->dBlockDownloadRate &&
+                        IsBlockDownloadLate(queued, stateHolder, nNow)) {
+                    LogPrint("net", "Re-requesting late block %s (%d) from peer=%d, was peer=%d\n", pindexWaitingFor->GetBlockHash().ToString(),
+                        pindexWaitingFor->nHeight, pto->id, itInFlight->second.first);
+                    if (vToDownload.size() == nCount)
+                        vToDownload.pop_back();
+                    vToDownload.insert(vToDownload.begin(), pindexWaitingFor);
+                }
+            }
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
@@ -74,13 +74,33 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
+/** Default for -shieldedindex */
+static const bool DEFAULT_SHIELDEDINDEX = false;
+/** Number of blocks that can be requested at any given time from a single peer, until its download rate is known. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the number of blocks requested from a peer once it is scheduled by its measured download rate. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
+/** Seconds of downloading, at a peer's measured rate, that we keep requested from it. */
+static const unsigned int BLOCK_DOWNLOAD_QUEUE_TIME = 2;
+/** Seconds after which a block holding back the download window is requested from a faster peer instead,
+ *  if it is also later than three times the peer's average response time. */
+static const unsigned int BLOCK_REREQUEST_TIMEOUT = 2;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers when requested. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to getblocktxn requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
+/** Number of Equihash solutions of recently served headers to keep in memory. */
+static const unsigned int HEADER_SOLUTION_CACHE_SIZE = 4 * MAX_HEADERS_RESULTS;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
@@ -121,9 +141,14 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fShieldedIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** True if a raw block notifier is configured, so new tips are serialized for it. */
+extern bool fPublishRawBlocks;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedProtectionEnabled;
@@ -202,6 +227,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the transaction pre-check thread */
+void ThreadTxPreCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -249,7 +276,28 @@ void PruneAndFlush();
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool fProofsVerified=false);
+/**
+ * Check what can be checked of a transaction without holding cs_main, on the
+ * transaction pre-check threads: its context-free rules, its JoinSplit proofs,
+ * and the signatures of whichever of its inputs are in a snapshot of the
+ * chainstate and mempool. Valid signatures go into the signature cache, so
+ * AcceptToMemoryPool repeats the script checks cheaply.
+ * Returns true if the proofs verified, which can then be passed on to
+ * AcceptToMemoryPool. On false, the transaction is invalid if state is, and
+ * AcceptToMemoryPool is left to decide otherwise. Failed script checks are
+ * always left to AcceptToMemoryPool, which knows which rules they broke.
+ */
+bool PreValidateTransaction(const CTransaction& tx, CValidationState& state);
+
+/**
+ * Verify the JoinSplit proofs of transactions, and the signatures of their inputs
+ * that are in the chainstate or mempool, in parallel and without cs_main, which is
+ * only held to copy the spent outputs. Inputs that are missing or spent are left to
+ * AcceptToMemoryPool. Sets vProofsVerified to whether the proofs of each transaction
+ * verified, and returns whether the script checks of those whose proofs did passed.
+ */
+bool PreCheckTransactions(const std::vector<const CTransaction*>& vtx, std::vector<bool>& vProofsVerified);
 
 
 struct CNodeStateStats {
@@ -257,6 +305,11 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nMaxBlocksInFlight;
+    int nBlocksDownloaded;
+    uint64_t nBlockBytesDownloaded;
+    double dBlockDownloadRate;
+    double dBlockResponseTime;
 };
 
 struct CDiskTxPos : public CDiskBlockPos
@@ -398,6 +451,10 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Write a snapshot of the flushed block index, to be loaded on the next start */
+bool WriteBlockIndexSnapshot();
+/** Rebuild the full header of a block index entry, reading its Equihash solution on demand */
+bool ReadBlockHeader(CBlockHeader& header, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -405,7 +462,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
+ *  of problems. Note that in any case, coins may be modified. The address, spent and
+ *  shielded indexes are only updated when pfClean isn't provided, as it is by the checks on a
+ *  throwaway view at startup. */
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
@@ -23,6 +23,8 @@
 #include <fcntl.h>
 #endif
 
+#include <math.h>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -75,7 +77,10 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+// Defined before the CNetCleanup instance, so that it outlives the nodes
+static CRecvBufferPool recvBufferPool;
+static std::atomic<size_t> nTotalSendQueueSize(0);
+map<CInv, CSerializedNetMsg> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -612,31 +617,54 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
     return true;
 }
 
-int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
+void CNode::ReceivedMsgData(unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
-
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
+    CNetMessage& msg = vRecvMsg.back();
+    assert(msg.in_data && msg.nDataPos + nBytes <= msg.hdr.nMessageSize);
+    msg.nDataPos += nBytes;
+    if (msg.complete()) {
+        msg.nTime = GetTimeMicros();
+        messageHandlerCondition.notify_one();
+    }
+}
 
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
+{
+    // Parse the header where it was received, unless it arrives in parts
+    const char *pchHeader = pch;
+    unsigned int nCopy = CMessageHeader::HEADER_SIZE;
+    if (nHdrPos > 0 || nBytes < CMessageHeader::HEADER_SIZE) {
+        nCopy = std::min(CMessageHeader::HEADER_SIZE - nHdrPos, nBytes);
+        memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+        nHdrPos += nCopy;
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
-    }
-    catch (const std::exception&) {
-        return -1;
+        // if header incomplete, exit
+        if (nHdrPos < CMessageHeader::HEADER_SIZE)
+            return nCopy;
+        pchHeader = hdrbuf;
     }
 
+    memcpy(hdr.pchMessageStart, pchHeader, MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, pchHeader + MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32((const unsigned char*)pchHeader + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    hdr.nChecksum = ReadLE32((const unsigned char*)pchHeader + CMessageHeader::CHECKSUM_OFFSET);
+
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
             return -1;
 
+    // Take a kept buffer for the whole body if there is one. Otherwise the body is allocated
+    // as its data arrives, so that a declared size alone doesn't hold memory.
+    // Oversized messages are rejected by the caller, without allocating for them.
+    if (hdr.nMessageSize <= MAX_PROTOCOL_MESSAGE_LENGTH) {
+        CSerializeData vch;
+        GetRecvBufferPool().Get(vch, hdr.nMessageSize);
+        if (vch.capacity() >= hdr.nMessageSize) {
+            vRecv.swap(vch);
+            vRecv.resize(hdr.nMessageSize);
+        }
+    }
+
     // switch state to reading message data
     in_data = true;
 
@@ -648,17 +676,63 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
+    GrowDataBuffer(nDataPos + nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+// Make room for at least nSize bytes of the body, RECV_BUFFER_GROWTH_SIZE more at a time, up to its declared size.
+void CNetMessage::GrowDataBuffer(unsigned int nSize)
+{
+    if (nSize <= vRecv.size())
+        return;
+    size_t nNewSize = std::min<size_t>(hdr.nMessageSize, std::max<size_t>(nSize, vRecv.size() + RECV_BUFFER_GROWTH_SIZE));
+    // Reserve exactly, rather than let resize() overshoot the message size
+    vRecv.reserve(nNewSize);
+    vRecv.resize(nNewSize);
+}
+
+void CRecvBufferPool::Get(CSerializeData& vch, size_t nSize)
+{
+    if (nSize < MIN_POOLED_RECV_BUFFER_SIZE)
+        return;
+    LOCK(cs);
+    std::multimap<size_t, CSerializeData>::iterator it = mapBuffers.lower_bound(nSize);
+    if (it == mapBuffers.end())
+        return;
+    vch.swap(it->second);
+    nTotalSize -= it->first;
+    mapBuffers.erase(it);
+}
+
+void CRecvBufferPool::Release(CSerializeData& vch)
+{
+    size_t nCapacity = vch.capacity();
+    if (nCapacity >= MIN_POOLED_RECV_BUFFER_SIZE) {
+        LOCK(cs);
+        if (nTotalSize + nCapacity <= MAX_RECV_BUFFER_POOL_SIZE) {
+            vch.clear();
+            mapBuffers.insert(std::make_pair(nCapacity, CSerializeData()))->second.swap(vch);
+            nTotalSize += nCapacity;
+            return;
+        }
+    }
+    CSerializeData().swap(vch);
+}
+
+size_t CRecvBufferPool::GetTotalSize()
+{
+    LOCK(cs);
+    return nTotalSize;
+}
+
+CRecvBufferPool& GetRecvBufferPool()
+{
+    return recvBufferPool;
+}
+
 
 
 
@@ -670,23 +744,47 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializedNetMsg>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        assert((*it)->data.size() > pnode->nSendOffset);
+#ifdef WIN32
+        size_t nToSend = (*it)->data.size() - pnode->nSendOffset;
+        int nBytes = send(pnode->hSocket, &(*it)->data[pnode->nSendOffset], nToSend, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Hand as many queued messages as possible to the kernel in one call
+        struct iovec iov[64];
+        size_t nIov = 0;
+        size_t nToSend = 0;
+        for (std::deque<CSerializedNetMsg>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < 64; itIov++, nIov++) {
+            size_t nOffset = (itIov == it) ? pnode->nSendOffset : 0;
+            iov[nIov].iov_base = (void*)&(*itIov)->data[nOffset];
+            iov[nIov].iov_len = (*itIov)->data.size() - nOffset;
+            nToSend += iov[nIov].iov_len;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            size_t nSent = nBytes;
+            while (nSent > 0) {
+                size_t nRemaining = (*it)->data.size() - pnode->nSendOffset;
+                if (nSent < nRemaining) {
+                    pnode->nSendOffset += nSent;
+                    break;
+                }
+                nSent -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            if ((size_t)nBytes < nToSend) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -704,11 +802,11 @@ void SocketSendData(CNode *pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    pnode->DequeueMessages(it);
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
 static list<CNode*> vNodesDisconnected;
@@ -1128,10 +1226,17 @@ void ThreadSocketHandler()
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // The rest of a message body is received straight into its buffer; headers and
+                        // small messages go through pchBuf, several at a time.
+                        unsigned int nDataSize = 0;
+                        char *pchData = pnode->GetRecvDataBuffer(nDataSize);
+                        int nBytes = pchData ? recv(pnode->hSocket, pchData, nDataSize, MSG_DONTWAIT)
+                                             : recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            if (pchData)
+                                pnode->ReceivedMsgData(nBytes);
+                            else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
@@ -1528,9 +1633,15 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize())
+                    if (!pnode->IsSendBufferFull())
                     {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
+                        if (!pnode->vRecvGetData.empty())
+                        {
+                            // Unless it waits for room to serve a block
+                            if (!pnode->IsSendBufferTotalFull())
+                                fSleep = false;
+                        }
+                        else if (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())
                         {
                             fSleep = false;
                         }
@@ -1542,8 +1653,12 @@ void ThreadMessageHandler()
             // Send messages
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend) {
+                    // Inventory is announced here rather than in SendMessages, which
+                    // needs cs_main for everything else it sends.
+                    pnode->SendInventory();
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                }
             }
             boost::this_thread::interruption_point();
         }
@@ -1842,8 +1957,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved, and
+        // so that the peers asking for it share one copy
+        mapRelay.insert(std::make_pair(inv, SerializeNetMessage(inv.GetCommand(), ss)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2023,11 +2139,17 @@ bool CAddrDB::Read(CAddrMan& addr)
 
 unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
+size_t SendBufferTotalSize() { return 1000*GetArg("-maxsendbuffertotal", 50*1000); }
+size_t GetTotalSendQueueSize() { return nTotalSendQueueSize; }
+
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds) {
+    return nNow + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
+}
 
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn) :
     ssSend(SER_NETWORK, INIT_PROTO_VERSION),
     addrKnown(5000, 0.001),
-    setInventoryKnown(SendBufferSize() / 1000)
+    filterInventoryKnown(INVENTORY_KNOWN_FILTER_SIZE, 0.000001)
 {
     nServices = 0;
     hSocket = hSocketIn;
@@ -2063,6 +2185,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nPingUsecTime = 0;
     fPingQueued = false;
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
+    nNextInvSend = 0;
 
     {
         LOCK(cs_nLastNodeId);
@@ -2084,6 +2207,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
 CNode::~CNode()
 {
     CloseSocket(hSocket);
+    DequeueMessages(vSendMsg.end());
 
     if (pfilter)
         delete pfilter;
@@ -2091,6 +2215,48 @@ CNode::~CNode()
     GetNodeSignals().FinalizeNode(GetId());
 }
 
+void CNode::SendInventory()
+{
+    // Don't send anything until we get its version message
+    if (nVersion == 0 || fDisconnect)
+        return;
+
+    int64_t nNow = GetTimeMicros();
+    bool fSendTxs = fWhitelisted;
+    if (nNextInvSend < nNow) {
+        fSendTxs = true;
+        nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !fInbound);
+    }
+
+    vector<CInv> vInv;
+    {
+        LOCK(cs_inventory);
+        vInv.reserve(vInventoryToSend.size() + (fSendTxs ? setInventoryTxToSend.size() : 0));
+        BOOST_FOREACH(const CInv& inv, vInventoryToSend) {
+            if (!filterInventoryKnown.contains(inv.hash)) {
+                filterInventoryKnown.insert(inv.hash);
+                vInv.push_back(inv);
+            }
+        }
+        vInventoryToSend.clear();
+        if (fSendTxs) {
+            BOOST_FOREACH(const uint256& hash, setInventoryTxToSend) {
+                if (!filterInventoryKnown.contains(hash)) {
+                    filterInventoryKnown.insert(hash);
+                    vInv.push_back(CInv(MSG_TX, hash));
+                }
+            }
+            setInventoryTxToSend.clear();
+        }
+    }
+
+    // Keep inv messages small enough to be processed promptly
+    for (size_t i = 0; i < vInv.size(); i += 1000) {
+        vector<CInv> vBatch(vInv.begin() + i, vInv.begin() + std::min(vInv.size(), i + 1000));
+        PushMessage("inv", vBatch);
+    }
+}
+
 void CNode::AskFor(const CInv& inv)
 {
     if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
@@ -2125,11 +2291,34 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+void BeginNetMessage(CDataStream& ss, const char* pszCommand)
+{
+    assert(ss.size() == 0);
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+}
+
+CSerializedNetMsg EndNetMessage(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    std::shared_ptr<CSerializedNetMsgData> msg(new CSerializedNetMsgData());
+    ss.GetAndClear(msg->data);
+    return msg;
+}
+
 void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend)
 {
     ENTER_CRITICAL_SECTION(cs_vSend);
-    assert(ssSend.size() == 0);
-    ssSend << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+    BeginNetMessage(ssSend, pszCommand);
     LogPrint("net", "sending: %s ", SanitizeString(pszCommand));
 }
 
@@ -2161,26 +2350,47 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
 
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    LogPrint("net", "(%d bytes) peer=%d\n", ssSend.size() - CMessageHeader::HEADER_SIZE, id);
+    QueueMessage(EndNetMessage(ssSend));
 
-    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+void CNode::PushSerializedMessage(const CSerializedNetMsg& msg)
+{
+    LOCK(cs_vSend);
+    LogPrint("net", "sending shared message (%d bytes) peer=%d\n", msg->data.size() - CMessageHeader::HEADER_SIZE, id);
+    QueueMessage(msg);
+}
+
+void CNode::QueueMessage(const CSerializedNetMsg& msg)
+{
+    // A peer that doesn't read what we send can't make us queue without bound: past the point where
+    // we stop responding to it, there is room for one more message of the largest size, and little else.
+    if (nSendSize + msg->data.size() > 2 * SendBufferSize() + MAX_PROTOCOL_MESSAGE_LENGTH) {
+        if (!fDisconnect)
+            LogPrintf("Send queue of peer=%d is full, disconnecting\n", id);
+        fDisconnect = true;
+        return;
+    }
+
+    vSendMsg.push_back(msg);
+    nSendSize += msg->data.size();
+    if (msg->nQueued++ == 0)
+        nTotalSendQueueSize += msg->data.size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
+}
 
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+void CNode::DequeueMessages(std::deque<CSerializedNetMsg>::iterator it)
+{
+    for (std::deque<CSerializedNetMsg>::iterator itDone = vSendMsg.begin(); itDone != it; itDone++) {
+        nSendSize -= (*itDone)->data.size();
+        if (--(*itDone)->nQueued == 0)
+            nTotalSendQueueSize -= (*itDone)->data.size();
+    }
+    vSendMsg.erase(vSendMsg.begin(), it);
 }
@@ -10,7 +10,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -19,7 +18,10 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
+#include <map>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -45,6 +47,12 @@ static const int PING_INTERVAL = 2 * 60;
 static const int TIMEOUT_INTERVAL = 20 * 60;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** Average delay between batches of transaction announcements to an inbound peer, in seconds.
+ *  Outbound peers get them twice as often. */
+static const unsigned int INVENTORY_BROADCAST_INTERVAL = 2;
+/** The number of recent inventory hashes remembered per peer, so as not to announce them back. It covers
+ *  minutes of relay at a busy transaction rate; the filter costs about 70 KB per peer at a 1e-6 fp rate. */
+static const unsigned int INVENTORY_KNOWN_FILTER_SIZE = 5000;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 2 MiB is currently acceptable). */
@@ -55,11 +63,55 @@ static const bool DEFAULT_LISTEN = true;
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
+/** Receive buffers smaller than this are not kept for reuse; the allocator serves small messages well enough. */
+static const size_t MIN_POOLED_RECV_BUFFER_SIZE = 64 * 1024;
+/** Message bodies that can't take a kept buffer are allocated this much at a time as they arrive. */
+static const size_t RECV_BUFFER_GROWTH_SIZE = 256 * 1024;
+/** The maximum total size of the receive buffers kept for reuse. */
+static const size_t MAX_RECV_BUFFER_POOL_SIZE = 32 * 1024 * 1024;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
+/** The total size of the send queues of all peers, at which we stop serving blocks to those of them that
+ *  still have data queued (-maxsendbuffertotal). */
+size_t SendBufferTotalSize();
+/** The total size of the messages in the send queues of all peers, counting each message once. */
+size_t GetTotalSendQueueSize();
+/** Return a time (in microseconds) that is an exponentially distributed delay, averaging
+ *  average_interval_seconds, after nNow. */
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds);
+
+/**
+ * A serialized message, header included, as queued for sending. It is immutable, so that a message
+ * going to many peers, like a new block, is serialized and kept in memory only once.
+ */
+struct CSerializedNetMsgData
+{
+    CSerializeData data;
+    //! The number of send queues it is in, so that it's counted once in GetTotalSendQueueSize
+    mutable std::atomic<int> nQueued;
+
+    CSerializedNetMsgData() : nQueued(0) {}
+};
+typedef std::shared_ptr<const CSerializedNetMsgData> CSerializedNetMsg;
+
+/** Start a message in the empty ss, with the header for pszCommand. */
+void BeginNetMessage(CDataStream& ss, const char* pszCommand);
+/** Set the size and checksum in the header of the message in ss, and take the message out of ss. */
+CSerializedNetMsg EndNetMessage(CDataStream& ss);
+
+/** Serialize a message once, to push it to any number of peers with CNode::PushSerializedMessage.
+ *  Only for payloads whose encoding doesn't depend on the peer's protocol version. */
+template<typename T>
+CSerializedNetMsg SerializeNetMessage(const char* pszCommand, const T& payload)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    BeginNetMessage(ss, pszCommand);
+    ss << payload;
+    return EndNetMessage(ss);
+}
 
 void AddOneShot(const std::string& strDest);
 void AddressCurrentlyConnected(const CService& addr);
@@ -143,7 +195,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSerializedNetMsg> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -187,27 +239,58 @@ public:
 
 
 
+/**
+ * Buffers of received messages, kept for reuse once the messages are processed, so that
+ * peers sending blocks at once don't each need a new allocation for every one of them.
+ */
+class CRecvBufferPool
+{
+private:
+    CCriticalSection cs;
+    //! Empty buffers, by capacity
+    std::multimap<size_t, CSerializeData> mapBuffers;
+    size_t nTotalSize;
+
+public:
+    CRecvBufferPool() : nTotalSize(0) {}
+
+    //! Give the empty vch the smallest kept buffer that holds at least nSize bytes, if there is one.
+    void Get(CSerializeData& vch, size_t nSize);
+    //! Keep the buffer of vch if it's worth it. vch is left empty either way.
+    void Release(CSerializeData& vch);
+    //! Total capacity of the kept buffers.
+    size_t GetTotalSize();
+};
+
+CRecvBufferPool& GetRecvBufferPool();
+
 class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header, if it arrives in parts
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CDataStream vRecv;              // received message data, allocated as it arrives unless a kept buffer fits it
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    ~CNetMessage()
+    {
+        CSerializeData vch;
+        vRecv.swap(vch);
+        GetRecvBufferPool().Release(vch);
+    }
+
     bool complete() const
     {
         if (!in_data)
@@ -217,12 +300,21 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+    void GrowDataBuffer(unsigned int nSize);
+
+    // The allocated rest of the message body, to receive into directly, once the header is read
+    char* GetDataBuffer(unsigned int& nSize)
+    {
+        if (nDataPos == vRecv.size())
+            GrowDataBuffer(nDataPos + 1);
+        nSize = vRecv.size() - nDataPos;
+        return &vRecv[nDataPos];
+    }
 };
 
 
@@ -240,7 +332,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsg> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -306,9 +398,15 @@ public:
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
+    // Transactions to announce, in the next batch. Kept sorted by hash, so that the order of
+    // an announcement doesn't tell in which order we learned of its transactions.
+    std::set<uint256> setInventoryTxToSend;
+    // Other inventory to announce, right away.
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
+    // When the next batch of transactions is announced (in microseconds). Only used by the message handler thread.
+    int64_t nNextInvSend;
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
 
@@ -361,6 +459,19 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
 
+    // The body of the message being received, if its header is read, so that the rest can be
+    // received straight into it; follow up with ReceivedMsgData.
+    // requires LOCK(cs_vRecvMsg)
+    char* GetRecvDataBuffer(unsigned int& nSize)
+    {
+        if (fDisconnect || vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+            return NULL;
+        return vRecvMsg.back().GetDataBuffer(nSize);
+    }
+
+    // requires LOCK(cs_vRecvMsg)
+    void ReceivedMsgData(unsigned int nBytes);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -406,19 +517,27 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
+    // Queue inventory to announce. What the peer already knows is filtered out when it is sent
+    // (in SendInventory), so that relaying to every peer stays cheap.
     void PushInventory(const CInv& inv)
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (inv.type == MSG_TX)
+                setInventoryTxToSend.insert(inv.hash);
+            else
                 vInventoryToSend.push_back(inv);
         }
     }
 
+    // Announce the queued inventory the peer doesn't know of yet: transactions in batches, on a
+    // timer, and everything else at once. Requires cs_vSend.
+    void SendInventory();
+
     void AskFor(const CInv& inv);
 
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
@@ -430,6 +549,27 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // Queue a message serialized with SerializeNetMessage, sharing it with the other peers it goes to.
+    void PushSerializedMessage(const CSerializedNetMsg& msg);
+
+    // Requires cs_vSend.
+    void QueueMessage(const CSerializedNetMsg& msg);
+    // Take the first messages, up to it, out of the send queue. Requires cs_vSend.
+    void DequeueMessages(std::deque<CSerializedNetMsg>::iterator it);
+
+    bool IsSendBufferFull() const
+    {
+        return nSendSize >= SendBufferSize();
+    }
+
+    // Whether to hold off on serving blocks to this peer: the send buffers of all peers together
+    // (-maxsendbuffertotal) are full and this one still has data queued. A peer whose queue is
+    // empty is always served, so peers that stop reading can't hold up the others.
+    bool IsSendBufferTotalFull() const
+    {
+        return nSendSize > 0 && GetTotalSendQueueSize() >= SendBufferTotalSize();
+    }
+
     void PushVersion();
 
 
@@ -86,10 +86,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
-
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
     // I||V
@@ -97,9 +93,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << I;
     ss << pblock->nNonce;
 
-    // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
     #ifdef ENABLE_RUST
     // Ensure that our Rust interactions are working in production builds. This is
     // temporary and should be removed.
@@ -108,9 +101,8 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     }
     #endif // ENABLE_RUST
 
-    bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
-    if (!isValid)
+    // H(I||V||...
+    if (!EhIsValidSolutionForInput(n, k, (unsigned char*)&ss[0], ss.size(), pblock->nSolution))
         return error("CheckEquihashSolution(): invalid solution");
 
     return true;
@@ -9,6 +9,18 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
+
+static_assert(sizeof(uint256) == 32, "a pair of adjacent uint256s must be one 64-byte SHA256D64 input");
+
+/** The number of nodes in the merkle tree of nLeaves transactions. */
+static size_t MerkleTreeSize(size_t nLeaves)
+{
+    size_t nTotal = nLeaves;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2)
+        nTotal += (nSize + 1) / 2;
+    return nTotal;
+}
 
 uint256 CBlockHeader::GetHash() const
 {
@@ -53,22 +65,25 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
        root.
     */
     vMerkleTree.clear();
-    vMerkleTree.reserve(vtx.size() * 2 + 16); // Safe upper bound for the number of total nodes.
+    vMerkleTree.reserve(MerkleTreeSize(vtx.size()));
     for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
         vMerkleTree.push_back(it->GetHash());
-    int j = 0;
+    size_t j = 0;
     bool mutated = false;
-    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    for (size_t nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The levels are stored one after the other, so every pair of siblings
+        // is already a contiguous 64-byte input: hash the whole level at once.
+        size_t nPairs = nSize / 2;
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nPairs);
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree[j+nSize+nPairs] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -78,6 +93,30 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
+uint256 CBlock::UpdateCoinbaseMerkleRoot() const
+{
+    if (vtx.empty() || vMerkleTree.size() != MerkleTreeSize(vtx.size()))
+        return BuildMerkleTree();
+    // vtx is a public member, so any other transaction may have been replaced
+    // since the tree was built; the cached hashes make checking the leaves cheap.
+    for (size_t i = 1; i < vtx.size(); i++) {
+        if (vMerkleTree[i] != vtx[i].GetHash())
+            return BuildMerkleTree();
+    }
+
+    // Only the path from the coinbase to the root changes; its siblings are
+    // always the second node of each level.
+    vMerkleTree[0] = vtx[0].GetHash();
+    size_t j = 0;
+    for (size_t nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        vMerkleTree[j+nSize] = Hash(BEGIN(vMerkleTree[j]), END(vMerkleTree[j]),
+                                    BEGIN(vMerkleTree[j+1]), END(vMerkleTree[j+1]));
+        j += nSize;
+    }
+    return vMerkleTree.back();
+}
+
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
 {
     if (vMerkleTree.empty())
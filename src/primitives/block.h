@@ -133,6 +133,12 @@ public:
     // merkle root).
     uint256 BuildMerkleTree(bool* mutated = NULL) const;
 
+    // Update the in-memory merkle tree after only the coinbase transaction has
+    // changed, rehashing just the coinbase's path, and return the merkle root.
+    // Builds the whole tree if it hasn't been built for the current vtx, i.e.
+    // if the size or any other transaction's hash differs from the tree.
+    uint256 UpdateCoinbaseMerkleRoot() const;
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
     std::string ToString() const;
@@ -152,8 +152,14 @@ static bool rest_headers(HTTPRequest* req,
     }
 
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-    BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-        ssHeader << pindex->GetBlockHeader();
+    {
+        LOCK(cs_main);
+        BOOST_FOREACH(const CBlockIndex *pindex, headers) {
+            CBlockHeader header;
+            if (!ReadBlockHeader(header, pindex))
+                return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, pindex->GetBlockHash().GetHex() + " header not available");
+            ssHeader << header;
+        }
     }
 
     switch (rf) {
@@ -172,8 +178,11 @@ static bool rest_headers(HTTPRequest* req,
     }
     case RF_JSON: {
         UniValue jsonHeaders(UniValue::VARR);
-        BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-            jsonHeaders.push_back(blockheaderToJSON(pindex));
+        {
+            LOCK(cs_main);
+            BOOST_FOREACH(const CBlockIndex *pindex, headers) {
+                jsonHeaders.push_back(blockheaderToJSON(pindex));
+            }
         }
         string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
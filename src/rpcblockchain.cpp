@@ -79,6 +79,10 @@ double GetNetworkDifficulty(const CBlockIndex* blockindex)
 
 UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 {
+    CBlockHeader header;
+    if (!ReadBlockHeader(header, blockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block header from disk");
+
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
@@ -90,8 +94,8 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("version", blockindex->nVersion));
     result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
-    result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    result.push_back(Pair("nonce", header.nNonce.GetHex()));
+    result.push_back(Pair("solution", HexStr(header.nSolution)));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
@@ -359,8 +363,11 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
     if (!fVerbose)
     {
+        CBlockHeader header;
+        if (!ReadBlockHeader(header, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block header from disk");
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
@@ -463,39 +470,71 @@ UniValue getblock(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( verify )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are kept up to date as blocks are connected, unless verify is set.\n"
+            "\nArguments:\n"
+            "1. verify      (boolean, optional, default=false) Scan the whole output set and check the statistics against it.\n"
+            "               Note this may take some time.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"hash_utxoset\": \"hash\",      (string) The MuHash of the unspent outputs\n"
+            "  \"total_amount\": x.xxx,         (numeric) The total amount\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, only with verify\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, only with verify\n"
+            "  \"verified\": true|false         (boolean) Whether the scan matched the statistics, only with verify\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "true")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    bool fVerify = false;
+    if (params.size() > 0)
+        fVerify = params[0].get_bool();
+
+    if (fVerify) {
+        CCoinsStats stats;
+        FlushStateToDisk();
+        if (pcoinsTip->GetStats(stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("hash_utxoset", stats.hashUtxoSet.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("verified", stats.fUtxoCommitmentValid));
+        }
+        return ret;
+    }
+
+    CUtxoCommitment commitment;
+    uint256 hashBlock;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        if (!pcoinsTip->GetUtxoCommitment(commitment))
+            return ret;
+        hashBlock = pcoinsTip->GetBestBlock();
+        nHeight = mapBlockIndex.find(hashBlock)->second->nHeight;
     }
+    ret.push_back(Pair("height", (int64_t)nHeight));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)commitment.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)commitment.nTransactionOutputs));
+    ret.push_back(Pair("hash_utxoset", commitment.GetHash().GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
     return ret;
 }
 
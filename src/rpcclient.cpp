@@ -79,6 +79,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "signrawtransaction", 2 },
     { "sendrawtransaction", 1 },
     { "fundrawtransaction", 1 },
+    { "gettxoutsetinfo", 0 },
     { "gettxout", 1 },
     { "gettxout", 2 },
     { "gettxoutproof", 0 },
@@ -96,6 +97,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "prioritisetransaction", 2 },
     { "setban", 2 },
     { "setban", 3 },
+    { "getaddressbalance", 0 },
+    { "getaddressdeltas", 0 },
+    { "getaddressutxos", 0 },
+    { "getspentinfo", 0 },
     { "zcrawjoinsplit", 1 },
     { "zcrawjoinsplit", 2 },
     { "zcrawjoinsplit", 3 },
@@ -109,6 +114,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "z_sendmany", 1},
     { "z_sendmany", 2},
     { "z_sendmany", 3},
+    { "z_sendmanybatch", 0},
+    { "z_sendmanybatch", 1},
+    { "z_sendmanybatch", 2},
     { "z_shieldcoinbase", 2},
     { "z_getoperationstatus", 0},
     { "z_getoperationresult", 0},
@@ -11,6 +11,7 @@
 #include "netbase.h"
 #include "rpcserver.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -459,3 +460,356 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
 
     return NullUniValue;
 }
+
+static bool GetAddressIndexKey(const CBitcoinAddress& address, uint160& hashBytes, int& type)
+{
+    CTxDestination dest = address.Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_INDEX_P2PKH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_INDEX_P2SH;
+        return true;
+    }
+    return false;
+}
+
+static std::string GetAddressIndexString(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_INDEX_P2SH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/** The addresses of a request, given either as a single address or as {"addresses": [...]} */
+static std::vector<std::pair<uint160, int> > GetAddressesFromParams(const UniValue& params)
+{
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<UniValue> values;
+    if (params[0].isStr()) {
+        values.push_back(params[0]);
+    } else if (params[0].isObject()) {
+        UniValue addresses = find_value(params[0].get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        values = addresses.getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    std::vector<std::pair<uint160, int> > addresses;
+    BOOST_FOREACH(const UniValue& value, values) {
+        if (!value.isStr())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        uint160 hashBytes;
+        int type = 0;
+        if (!GetAddressIndexKey(CBitcoinAddress(value.get_str()), hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + value.get_str());
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+    return addresses;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance {\"addresses\": [\"taddr\", ...]}\n"
+            "\nReturns the balance of transparent addresses, from the address index (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [\n"
+            "    \"taddr\"  (string) A P2PKH or P2SH address\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,   (numeric) The current balance in " + CURRENCY_UNIT + "\n"
+            "  \"received\": n,  (numeric) The total amount received in " + CURRENCY_UNIT + ", including change\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}")
+        );
+
+    std::vector<std::pair<uint160, int> > addresses = GetAddressesFromParams(params);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!pblocktree->ReadAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator delta = addressIndex.begin(); delta != addressIndex.end(); delta++) {
+            if (delta->second > 0)
+                received += delta->second;
+            balance += delta->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(balance)));
+    result.push_back(Pair("received", ValueFromAmount(received)));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos {\"addresses\": [\"taddr\", ...]}\n"
+            "\nReturns the unspent outputs of transparent addresses, from the address index (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [\n"
+            "    \"taddr\"  (string) A P2PKH or P2SH address\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"taddr\",  (string) The address\n"
+            "    \"txid\": \"hash\",      (string) The transaction id\n"
+            "    \"outputIndex\": n,    (numeric) The index of the output\n"
+            "    \"script\": \"hex\",     (string) The script, hex encoded\n"
+            "    \"amount\": n,         (numeric) The value of the output in " + CURRENCY_UNIT + "\n"
+            "    \"height\": n          (numeric) The height of the block containing the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}")
+        );
+
+    std::vector<std::pair<uint160, int> > addresses = GetAddressesFromParams(params);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!pblocktree->ReadAddressUnspentIndex(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+    }
+    std::stable_sort(unspentOutputs.begin(), unspentOutputs.end(),
+        [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+            return a.second.blockHeight < b.second.blockHeight;
+        });
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", GetAddressIndexString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("amount", ValueFromAmount(it->second.satoshis)));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas {\"addresses\": [\"taddr\", ...], \"start\": n, \"end\": n}\n"
+            "\nReturns every change to the balance of transparent addresses, from the address index (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [\n"
+            "    \"taddr\"  (string) A P2PKH or P2SH address\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"start\": n,  (numeric, optional) The first block height to include\n"
+            "  \"end\": n     (numeric, optional) The last block height to include\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"taddr\",  (string) The address\n"
+            "    \"txid\": \"hash\",      (string) The transaction id\n"
+            "    \"index\": n,          (numeric) The index of the input or output in the transaction\n"
+            "    \"blockindex\": n,     (numeric) The index of the transaction in the block\n"
+            "    \"height\": n,         (numeric) The height of the block\n"
+            "    \"amount\": n          (numeric) The change in balance in " + CURRENCY_UNIT + ", negative for spends\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}'")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}")
+        );
+
+    std::vector<std::pair<uint160, int> > addresses = GetAddressesFromParams(params);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].isObject()) {
+        UniValue start = find_value(params[0].get_obj(), "start");
+        UniValue end = find_value(params[0].get_obj(), "end");
+        if (!start.isNull())
+            nStart = start.get_int();
+        if (!end.isNull())
+            nEnd = end.get_int();
+        if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!pblocktree->ReadAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        std::string address = GetAddressIndexString(it->first, it->second);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator delta = addressIndex.begin(); delta != addressIndex.end(); delta++) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("address", address));
+            entry.push_back(Pair("txid", delta->first.txhash.GetHex()));
+            entry.push_back(Pair("index", (int)delta->first.index));
+            entry.push_back(Pair("blockindex", (int)delta->first.txindex));
+            entry.push_back(Pair("height", delta->first.blockHeight));
+            entry.push_back(Pair("amount", ValueFromAmount(delta->second)));
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the input that spent a transparent output, from the spent index (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\": \"hash\",  (string) The id of the transaction with the output\n"
+            "  \"index\": n       (numeric) The index of the output\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",  (string) The id of the spending transaction\n"
+            "  \"index\": n,      (numeric) The index of the spending input\n"
+            "  \"height\": n      (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled, restart with -spentindex -reindex");
+
+    uint256 txid = ParseHashO(params[0].get_obj(), "txid");
+    UniValue index = find_value(params[0].get_obj(), "index");
+    if (!index.isNum() || index.get_int() < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(CSpentIndexKey(txid, index.get_int()), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
+UniValue getnullifierinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getnullifierinfo \"nullifier\"\n"
+            "\nReturns the JoinSplit that revealed a nullifier, from the shielded index (requires -shieldedindex).\n"
+            "\nArguments:\n"
+            "1. \"nullifier\"  (string, required) The nullifier, hex encoded\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",   (string) The id of the transaction\n"
+            "  \"jsindex\": n,     (numeric) The index of the JoinSplit in the transaction\n"
+            "  \"index\": n,       (numeric) The index of the nullifier in the JoinSplit\n"
+            "  \"height\": n,      (numeric) The height of the block containing the transaction\n"
+            "  \"blockhash\": \"hash\"  (string) The hash of the block containing the transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnullifierinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\"")
+            + HelpExampleRpc("getnullifierinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\"")
+        );
+
+    if (!fShieldedIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Shielded index not enabled, restart with -shieldedindex -reindex");
+
+    uint256 nf = ParseHashV(params[0], "nullifier");
+    CNullifierIndexValue value;
+    if (!pblocktree->ReadNullifierIndex(nf, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Nullifier not found in the shielded index");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("jsindex", (int)value.jsIndex));
+    result.push_back(Pair("index", (int)value.nullifierIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    {
+        LOCK(cs_main);
+        if (value.blockHeight <= chainActive.Height())
+            result.push_back(Pair("blockhash", chainActive[value.blockHeight]->GetBlockHash().GetHex()));
+    }
+    return result;
+}
+
+UniValue getcommitmentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getcommitmentinfo \"commitment\"\n"
+            "\nReturns the JoinSplit output that created a note commitment, and its position in the note\n"
+            "commitment tree, from the shielded index (requires -shieldedindex).\n"
+            "\nArguments:\n"
+            "1. \"commitment\"  (string, required) The note commitment, hex encoded\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",     (string) The id of the transaction\n"
+            "  \"jsindex\": n,       (numeric) The index of the JoinSplit in the transaction\n"
+            "  \"index\": n,         (numeric) The index of the commitment in the JoinSplit\n"
+            "  \"height\": n,        (numeric) The height of the block containing the transaction\n"
+            "  \"position\": n,      (numeric) The position of the commitment in the note commitment tree\n"
+            "  \"blockhash\": \"hash\",  (string) The hash of the block containing the transaction\n"
+            "  \"anchor\": \"hash\"      (string) The root of the tree before the block's commitments were appended\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcommitmentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\"")
+            + HelpExampleRpc("getcommitmentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\"")
+        );
+
+    if (!fShieldedIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Shielded index not enabled, restart with -shieldedindex -reindex");
+
+    uint256 cm = ParseHashV(params[0], "commitment");
+    CCommitmentIndexValue value;
+    if (!pblocktree->ReadCommitmentIndex(cm, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Commitment not found in the shielded index");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("jsindex", (int)value.jsIndex));
+    result.push_back(Pair("index", (int)value.commitmentIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    result.push_back(Pair("position", (uint64_t)value.position));
+    {
+        LOCK(cs_main);
+        if (value.blockHeight <= chainActive.Height()) {
+            CBlockIndex* pindex = chainActive[value.blockHeight];
+            result.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+            result.push_back(Pair("anchor", pindex->hashAnchor.GetHex()));
+        }
+    }
+    return result;
+}
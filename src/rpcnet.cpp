@@ -105,7 +105,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"maxinflight\": n,          (numeric) The number of blocks we currently allow in flight from this peer\n"
+            "    \"blocksdownloaded\": n,     (numeric) The number of requested blocks this peer sent us\n"
+            "    \"blockbytesdownloaded\": n, (numeric) The total size of those blocks\n"
+            "    \"blockdownloadrate\": n,    (numeric) Average rate this peer sends blocks at, in bytes per second\n"
+            "    \"blockresponsetime\": n,    (numeric) Average time in seconds from requesting a block to receiving it\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -155,6 +160,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("maxinflight", statestats.nMaxBlocksInFlight));
+            obj.push_back(Pair("blocksdownloaded", statestats.nBlocksDownloaded));
+            obj.push_back(Pair("blockbytesdownloaded", statestats.nBlockBytesDownloaded));
+            obj.push_back(Pair("blockdownloadrate", statestats.dBlockDownloadRate));
+            obj.push_back(Pair("blockresponsetime", statestats.dBlockResponseTime));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -328,6 +328,16 @@ static const CRPCCommand vRPCCommands[] =
     { "util",               "estimatepriority",       &estimatepriority,       true  },
     { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
 
+    /* Address and spent indexes */
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true  },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           true  },
+
+    /* Shielded index */
+    { "shieldedindex",      "getcommitmentinfo",      &getcommitmentinfo,      true  },
+    { "shieldedindex",      "getnullifierinfo",       &getnullifierinfo,       true  },
+
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        true  },
     { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
@@ -386,6 +396,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "z_getbalance",           &z_getbalance,           false },
     { "wallet",             "z_gettotalbalance",      &z_gettotalbalance,      false },
     { "wallet",             "z_sendmany",             &z_sendmany,             false },
+    { "wallet",             "z_sendmanybatch",        &z_sendmanybatch,        false },
     { "wallet",             "z_shieldcoinbase",       &z_shieldcoinbase,       false },
     { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true  },
     { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true  },
@@ -419,26 +430,51 @@ const CRPCCommand *CRPCTable::operator[](const std::string &name) const
     return (*it).second;
 }
 
+/**
+ * Number of concurrent JoinSplit proofs the physical memory can hold, leaving
+ * room for the proving key itself, which is shared by all of them.
+ */
+static int DefaultAsyncProvingLimit()
+{
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && pageSize > 0) {
+        uint64_t nPhysical = (uint64_t)pages * (uint64_t)pageSize;
+        if (nPhysical > ASYNC_RPC_PROVING_KEY_MEMORY) {
+            return std::max<uint64_t>(1, (nPhysical - ASYNC_RPC_PROVING_KEY_MEMORY) / ASYNC_RPC_PROVING_MEMORY);
+        }
+    }
+#endif
+    return 1;
+}
+
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
     fRPCRunning = true;
     g_rpcSignals.Started();
 
-    // Launch one async rpc worker.  The ability to launch multiple workers is not recommended at present and thus the option is disabled.
-    getAsyncRPCQueue()->addWorker();
-/*
-    int n = GetArg("-rpcasyncthreads", 1);
-    if (n<1) {
+    int nProving = GetArg("-rpcasyncprovinglimit", 0);
+    if (nProving < 0) {
+        LogPrintf("ERROR: Invalid value %d for -rpcasyncprovinglimit.  Must not be negative.\n", nProving);
+        return false;
+    }
+    if (nProving == 0) {
+        nProving = DefaultAsyncProvingLimit();
+    }
+    getAsyncRPCQueue()->setMaxProvingOperations(nProving);
+
+    // Launch async rpc workers
+    int n = GetArg("-rpcasyncthreads", DEFAULT_RPC_ASYNC_THREADS);
+    if (n < 1) {
         LogPrintf("ERROR: Invalid value %d for -rpcasyncthreads.  Must be at least 1.\n", n);
-        strerr = strprintf(_("An error occurred while setting up the Async RPC threads, invalid parameter value of %d (must be at least 1)."), n);
-        uiInterface.ThreadSafeMessageBox(strerr, "", CClientUIInterface::MSG_ERROR);
-        StartShutdown();
-        return;
+        return false;
     }
+    LogPrint("rpc", "Starting %d async RPC workers, at most %d generating proofs at once\n", n, nProving);
+
     for (int i = 0; i < n; i++)
         getAsyncRPCQueue()->addWorker();
-*/
     return true;
 }
 
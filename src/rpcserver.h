@@ -23,6 +23,11 @@
 class AsyncRPCQueue;
 class CRPCCommand;
 
+/** Async RPC operations run one at a time by default: spendable notes aren't
+ *  locked while a proof is generated, so concurrent operations could select
+ *  the same notes, and each pauses and resumes mining on its own. */
+static const int DEFAULT_RPC_ASYNC_THREADS = 1;
+
 namespace RPCServer
 {
     void OnStarted(boost::function<void ()> slot);
@@ -287,11 +292,18 @@ extern UniValue z_listreceivedbyaddress(const UniValue& params, bool fHelp); //
 extern UniValue z_getbalance(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_gettotalbalance(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_sendmany(const UniValue& params, bool fHelp); // in rpcwallet.cpp
+extern UniValue z_sendmanybatch(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_shieldcoinbase(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_getoperationstatus(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_getoperationresult(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_listoperationids(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_validateaddress(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getaddressdeltas(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getspentinfo(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getcommitmentinfo(const UniValue& params, bool fHelp); // in rpcmisc.cpp
+extern UniValue getnullifierinfo(const UniValue& params, bool fHelp); // in rpcmisc.cpp
 
 bool StartRPC();
 void InterruptRPC();
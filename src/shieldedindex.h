@@ -0,0 +1,94 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SHIELDEDINDEX_H
+#define BITCOIN_SHIELDEDINDEX_H
+
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/** The JoinSplit that revealed a nullifier, in the shielded index (-shieldedindex) */
+struct CNullifierIndexValue
+{
+    uint256 txid;
+    unsigned int jsIndex;
+    unsigned int nullifierIndex;
+    int blockHeight;
+
+    CNullifierIndexValue() : jsIndex(0), nullifierIndex(0), blockHeight(0) {}
+    CNullifierIndexValue(const uint256& txidIn, unsigned int jsIndexIn, unsigned int nullifierIndexIn, int blockHeightIn) :
+        txid(txidIn), jsIndex(jsIndexIn), nullifierIndex(nullifierIndexIn), blockHeight(blockHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(jsIndex);
+        READWRITE(nullifierIndex);
+        READWRITE(blockHeight);
+    }
+};
+
+/**
+ * The JoinSplit output that created a note commitment, and the commitment's
+ * position in the note commitment tree. A witness for the note can be built
+ * from the tree as it was before the commitment's block and that block's
+ * commitments, without scanning the chain for it.
+ */
+struct CCommitmentIndexValue
+{
+    uint256 txid;
+    unsigned int jsIndex;
+    unsigned int commitmentIndex;
+    int blockHeight;
+    uint64_t position;
+
+    CCommitmentIndexValue() : jsIndex(0), commitmentIndex(0), blockHeight(0), position(0) {}
+    CCommitmentIndexValue(const uint256& txidIn, unsigned int jsIndexIn, unsigned int commitmentIndexIn,
+                          int blockHeightIn, uint64_t positionIn) :
+        txid(txidIn), jsIndex(jsIndexIn), commitmentIndex(commitmentIndexIn),
+        blockHeight(blockHeightIn), position(positionIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(jsIndex);
+        READWRITE(commitmentIndex);
+        READWRITE(blockHeight);
+        READWRITE(position);
+    }
+};
+
+/**
+ * Append the shielded index entries of a transaction's JoinSplits. nPosition
+ * is the position of the transaction's first note commitment in the tree: the
+ * size of the tree as of the previous block, plus the commitments of the
+ * earlier transactions in the block.
+ */
+inline void AddShieldedIndexEntries(const CTransaction& tx, int nHeight, uint64_t nPosition,
+                                    std::vector<std::pair<uint256, CNullifierIndexValue> >& nullifierIndex,
+                                    std::vector<std::pair<uint256, CCommitmentIndexValue> >& commitmentIndex)
+{
+    for (unsigned int js = 0; js < tx.vjoinsplit.size(); js++) {
+        const JSDescription& joinsplit = tx.vjoinsplit[js];
+        for (unsigned int n = 0; n < joinsplit.nullifiers.size(); n++) {
+            nullifierIndex.push_back(std::make_pair(joinsplit.nullifiers[n],
+                CNullifierIndexValue(tx.GetHash(), js, n, nHeight)));
+        }
+        for (unsigned int n = 0; n < joinsplit.commitments.size(); n++) {
+            commitmentIndex.push_back(std::make_pair(joinsplit.commitments[n],
+                CCommitmentIndexValue(tx.GetHash(), js, n, nHeight, nPosition++)));
+        }
+    }
+}
+
+#endif // BITCOIN_SHIELDEDINDEX_H
@@ -537,4 +537,43 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blocked_bloom)
+{
+    CBlockedBloomFilter filter(10000);
+
+    std::vector<uint256> data;
+    for (int i = 0; i < 10000; i++) {
+        data.push_back(GetRandHash());
+        filter.insert(data.back());
+    }
+    BOOST_CHECK(!filter.IsFull());
+
+    // No false negatives:
+    for (size_t i = 0; i < data.size(); i++) {
+        BOOST_CHECK(filter.contains(data[i]));
+    }
+
+    // The false positive rate of a full filter is about 0.2%, so we should
+    // get about 200 hits testing 100,000 random keys:
+    unsigned int nHits = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (filter.contains(GetRandHash()))
+            ++nHits;
+    }
+    BOOST_TEST_MESSAGE("BlockedBloomFilter got " << nHits << " false positives (~200 expected)");
+    BOOST_CHECK(nHits < 500);
+
+    filter.insert(GetRandHash());
+    BOOST_CHECK(filter.IsFull());
+
+    filter.reset(20000);
+    BOOST_CHECK(!filter.IsFull());
+    nHits = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (filter.contains(data[i]))
+            ++nHits;
+    }
+    BOOST_CHECK_EQUAL(nHits, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
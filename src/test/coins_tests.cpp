@@ -28,12 +28,19 @@ class CCoinsViewTest : public CCoinsView
     std::map<uint256, CCoins> map_;
     std::map<uint256, ZCIncrementalMerkleTree> mapAnchors_;
     std::map<uint256, bool> mapNullifiers_;
+    CUtxoCommitment utxoCommitment_;
 
 public:
     CCoinsViewTest() {
         hashBestAnchor_ = ZCIncrementalMerkleTree::empty_root();
     }
 
+    bool GetUtxoCommitment(CUtxoCommitment& commitment) const
+    {
+        commitment = utxoCommitment_;
+        return true;
+    }
+
     bool GetAnchorAt(const uint256& rt, ZCIncrementalMerkleTree &tree) const {
         if (rt == ZCIncrementalMerkleTree::empty_root()) {
             ZCIncrementalMerkleTree new_tree;
@@ -91,7 +98,8 @@ public:
                     const uint256& hashBlock,
                     const uint256& hashAnchor,
                     CAnchorsMap& mapAnchors,
-                    CNullifiersMap& mapNullifiers)
+                    CNullifiersMap& mapNullifiers,
+                    const CUtxoCommitment* pUtxoCommitment)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -123,6 +131,8 @@ public:
         mapCoins.clear();
         mapAnchors.clear();
         mapNullifiers.clear();
+        if (pUtxoCommitment)
+            utxoCommitment_ = *pUtxoCommitment;
         hashBestBlock_ = hashBlock;
         hashBestAnchor_ = hashAnchor;
         return true;
@@ -463,6 +473,62 @@ BOOST_AUTO_TEST_CASE(anchors_flush_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(utxo_commitment_test)
+{
+    CCoinsViewTest base;
+
+    CMutableTransaction mtx;
+    mtx.vout.resize(3);
+    mtx.vout[0].nValue = 5;
+    mtx.vout[1].nValue = 7;
+    mtx.vout[2].nValue = 11;
+    mtx.vout[2].scriptPubKey << OP_RETURN;
+    CTransaction tx(mtx);
+    CCoins coins(tx, 100);
+
+    uint256 hashEmpty = CUtxoCommitment().GetHash();
+    uint256 hashOne;
+    {
+        CCoinsViewCacheTest cache(&base);
+        CCoinsViewCacheTest cache2(&cache);
+        cache2.ModifyUtxoCommitment().AddCoins(tx.GetHash(), coins);
+        cache2.Flush();
+
+        // Nothing reaches the base until the parent cache is flushed too
+        CUtxoCommitment commitment;
+        BOOST_CHECK(base.GetUtxoCommitment(commitment));
+        BOOST_CHECK(commitment.GetHash() == hashEmpty);
+        cache.Flush();
+
+        BOOST_CHECK(base.GetUtxoCommitment(commitment));
+        // The unspendable output is not part of the set
+        BOOST_CHECK_EQUAL(commitment.nTransactions, 1);
+        BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, 2);
+        BOOST_CHECK_EQUAL(commitment.nTotalAmount, 12);
+        hashOne = commitment.GetHash();
+        BOOST_CHECK(hashOne != hashEmpty);
+    }
+
+    {
+        // Spending the outputs one by one brings back the empty set
+        CCoinsViewCacheTest cache(&base);
+        CUtxoCommitment& commitment = cache.ModifyUtxoCommitment();
+        BOOST_CHECK(commitment.GetHash() == hashOne);
+        commitment.RemoveOutput(tx.GetHash(), 1, tx.vout[1], 100, false);
+        commitment.RemoveOutput(tx.GetHash(), 0, tx.vout[0], 100, false);
+        commitment.nTransactions--;
+        BOOST_CHECK_EQUAL(commitment.nTransactions, 0);
+        BOOST_CHECK_EQUAL(commitment.nTransactionOutputs, 0);
+        BOOST_CHECK_EQUAL(commitment.nTotalAmount, 0);
+        BOOST_CHECK(commitment.GetHash() == hashEmpty);
+
+        // The height is part of each element
+        commitment.AddOutput(tx.GetHash(), 0, tx.vout[0], 101, false);
+        commitment.AddOutput(tx.GetHash(), 1, tx.vout[1], 100, false);
+        BOOST_CHECK(commitment.GetHash() != hashOne);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(chained_joinsplits)
 {
     CCoinsViewTest base;
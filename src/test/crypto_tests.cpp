@@ -8,7 +8,10 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
+#include "hash.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 
@@ -131,6 +134,30 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Cover the multi-lane paths, and the single blocks left over after them.
+    for (int i = 0; i <= 33; i++) {
+        std::vector<unsigned char> in(64 * i);
+        for (size_t j = 0; j < in.size(); j++) {
+            in[j] = insecure_rand() & 0xff;
+        }
+
+        std::vector<unsigned char> out1(32 * i), out2(32 * i);
+        for (int j = 0; j < i; j++) {
+            CHash256().Write(in.data() + 64 * j, 64).Finalize(out1.data() + 32 * j);
+        }
+        SHA256D64(out2.data(), in.data(), i);
+        BOOST_CHECK(out1 == out2);
+
+        for (int j = 0; j < i; j++) {
+            CSHA256().Write(in.data() + 64 * j, 64).FinalizeNoPadding(out1.data() + 32 * j);
+        }
+        SHA256Compress64(out2.data(), in.data(), i);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -248,4 +275,58 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+static uint256 MuHashFinalize(const MuHash3072& muhash)
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests) {
+    std::vector<uint256> elements;
+    for (int i = 0; i < 8; i++) {
+        elements.push_back(GetRandHash());
+    }
+
+    // The hash of a set doesn't depend on the order of insertion
+    MuHash3072 forward, backward;
+    for (size_t i = 0; i < elements.size(); i++) {
+        forward.Insert(elements[i].begin(), 32);
+        backward.Insert(elements[elements.size() - 1 - i].begin(), 32);
+    }
+    BOOST_CHECK(MuHashFinalize(forward) == MuHashFinalize(backward));
+
+    // Removing an element gives the hash of the smaller set
+    MuHash3072 smaller;
+    for (size_t i = 1; i < elements.size(); i++) {
+        smaller.Insert(elements[i].begin(), 32);
+    }
+    MuHash3072 removed = forward;
+    removed.Remove(elements[0].begin(), 32);
+    BOOST_CHECK(MuHashFinalize(removed) == MuHashFinalize(smaller));
+    BOOST_CHECK(MuHashFinalize(removed) != MuHashFinalize(forward));
+
+    // Combining disjoint sets, and dividing a subset back out
+    MuHash3072 single;
+    single.Insert(elements[0].begin(), 32);
+    MuHash3072 combined = smaller;
+    combined *= single;
+    BOOST_CHECK(MuHashFinalize(combined) == MuHashFinalize(forward));
+    combined /= smaller;
+    BOOST_CHECK(MuHashFinalize(combined) == MuHashFinalize(single));
+
+    // Removing everything gives the hash of the empty set
+    for (size_t i = 1; i < elements.size(); i++) {
+        removed.Remove(elements[i].begin(), 32);
+    }
+    BOOST_CHECK(MuHashFinalize(removed) == MuHashFinalize(MuHash3072()));
+
+    // The state survives serialization without being normalized
+    CDataStream ss(SER_DISK, 0);
+    ss << forward;
+    MuHash3072 read;
+    ss >> read;
+    BOOST_CHECK(MuHashFinalize(read) == MuHashFinalize(forward));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
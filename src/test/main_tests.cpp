@@ -101,4 +101,24 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     BOOST_CHECK(Test());
 }
 
+BOOST_AUTO_TEST_CASE(read_block_header_test)
+{
+    LOCK(cs_main);
+    // The genesis block index has been written to the block tree DB, so it
+    // no longer holds its solution
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex != NULL);
+    BOOST_CHECK(pindex->nSolution.empty());
+
+    CBlockHeader header;
+    BOOST_CHECK(ReadBlockHeader(header, pindex));
+    BOOST_CHECK(header.GetHash() == Params().GenesisBlock().GetHash());
+    BOOST_CHECK(header.nSolution == Params().GenesisBlock().nSolution);
+
+    // Served again from the header cache
+    CBlockHeader header2;
+    BOOST_CHECK(ReadBlockHeader(header2, pindex));
+    BOOST_CHECK(header2.GetHash() == header.GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
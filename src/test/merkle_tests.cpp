@@ -0,0 +1,107 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** The merkle root, built one pair at a time. */
+static uint256 NaiveMerkleRoot(std::vector<uint256> level, bool& mutated)
+{
+    mutated = false;
+    if (level.empty())
+        return uint256();
+    while (level.size() > 1) {
+        std::vector<uint256> next;
+        for (size_t i = 0; i < level.size(); i += 2) {
+            size_t i2 = std::min(i + 1, level.size() - 1);
+            if (i2 == i + 1 && i2 + 1 == level.size() && level[i] == level[i2])
+                mutated = true;
+            next.push_back(Hash(BEGIN(level[i]), END(level[i]), BEGIN(level[i2]), END(level[i2])));
+        }
+        level.swap(next);
+    }
+    return level[0];
+}
+
+static CBlock BlockWithTransactions(size_t nTx)
+{
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+BOOST_FIXTURE_TEST_SUITE(merkle_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(merkle_build_matches_pairwise)
+{
+    for (size_t nTx = 0; nTx <= 40; nTx++) {
+        CBlock block = BlockWithTransactions(nTx);
+        std::vector<uint256> leaves;
+        for (size_t i = 0; i < nTx; i++)
+            leaves.push_back(block.vtx[i].GetHash());
+
+        bool mutated, expectMutated;
+        BOOST_CHECK(block.BuildMerkleTree(&mutated) == NaiveMerkleRoot(leaves, expectMutated));
+        BOOST_CHECK(!mutated && !expectMutated);
+
+        // Every branch leads from its transaction to the root.
+        for (size_t i = 0; i < nTx; i++) {
+            BOOST_CHECK(CBlock::CheckMerkleBranch(leaves[i], block.GetMerkleBranch(i), i) == block.vMerkleTree.back());
+        }
+
+        // Duplicating the last transactions of an even level is still detected.
+        if (nTx >= 2) {
+            block.vtx.push_back(block.vtx.back());
+            leaves.push_back(leaves.back());
+            uint256 root = block.BuildMerkleTree(&mutated);
+            BOOST_CHECK(root == NaiveMerkleRoot(leaves, expectMutated));
+            BOOST_CHECK_EQUAL(mutated, expectMutated);
+            if (nTx % 2)
+                BOOST_CHECK(mutated);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merkle_update_coinbase)
+{
+    for (size_t nTx = 1; nTx <= 20; nTx++) {
+        CBlock block = BlockWithTransactions(nTx);
+
+        // Without a tree for the current transactions, the whole tree is built.
+        BOOST_CHECK(block.UpdateCoinbaseMerkleRoot() == block.BuildMerkleTree());
+
+        for (uint32_t n = 1; n <= 3; n++) {
+            CMutableTransaction coinbase(block.vtx[0]);
+            coinbase.nLockTime = 1000 + n;
+            block.vtx[0] = coinbase;
+
+            uint256 root = block.UpdateCoinbaseMerkleRoot();
+            std::vector<uint256> tree = block.vMerkleTree;
+            BOOST_CHECK(root == block.BuildMerkleTree());
+            BOOST_CHECK(tree == block.vMerkleTree);
+        }
+
+        // Replacing any other transaction falls back to a full rebuild.
+        if (nTx > 1) {
+            CMutableTransaction tx(block.vtx[nTx - 1]);
+            tx.nLockTime = 2000;
+            block.vtx[nTx - 1] = tx;
+
+            uint256 root = block.UpdateCoinbaseMerkleRoot();
+            BOOST_CHECK(root == block.BuildMerkleTree());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,6 +17,7 @@
 #include "asyncrpcqueue.h"
 #include "asyncrpcoperation.h"
 #include "wallet/asyncrpcoperation_sendmany.h"
+#include "wallet/asyncrpcoperation_sendmanybatch.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 
 #include "rpcprotocol.h"
@@ -774,6 +775,173 @@ BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_parallel_cancel)
     BOOST_CHECK(ids.size()==0);
 }
 
+// The OrderOperation records the order in which operations were started
+std::mutex gOrderLock;
+std::vector<AsyncRPCOperationId> gOrder;
+
+class OrderOperation : public AsyncRPCOperation {
+public:
+    OrderOperation() {}
+    virtual ~OrderOperation() {}
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        {
+            std::lock_guard<std::mutex> guard(gOrderLock);
+            gOrder.push_back(getId());
+        }
+        set_state(OperationStatus::SUCCESS);
+    }
+};
+
+// This tests that higher priority operations are started first
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_priority)
+{
+    gOrder.clear();
+
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    std::shared_ptr<AsyncRPCOperation> low1(new OrderOperation());
+    std::shared_ptr<AsyncRPCOperation> low2(new OrderOperation());
+    std::shared_ptr<AsyncRPCOperation> normal(new OrderOperation());
+    std::shared_ptr<AsyncRPCOperation> high(new OrderOperation());
+    low1->setPriority(OperationPriority::LOW);
+    low2->setPriority(OperationPriority::LOW);
+    high->setPriority(OperationPriority::HIGH);
+    BOOST_CHECK(normal->getPriority() == OperationPriority::NORMAL);
+
+    q->addOperation(low1);
+    q->addOperation(normal);
+    q->addOperation(low2);
+    q->addOperation(high);
+    BOOST_CHECK(q->getOperationCount() == 4);
+
+    q->addWorker();
+    q->finishAndWait();
+
+    std::vector<AsyncRPCOperationId> expected = {high->getId(), normal->getId(), low1->getId(), low2->getId()};
+    BOOST_CHECK(gOrder == expected);
+}
+
+class CancellableOperation : public AsyncRPCOperation {
+public:
+    std::atomic<int> steps;
+    CancellableOperation() : steps(0) {}
+    virtual ~CancellableOperation() {}
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        start_execution_clock();
+        while (!isCancelRequested() && steps < 100) {
+            steps++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        stop_execution_clock();
+        set_state(isCancelRequested() ? OperationStatus::CANCELLED : OperationStatus::SUCCESS);
+    }
+};
+
+// This tests that executing operations are asked to stop by cancel()
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_cooperative_cancel)
+{
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    std::shared_ptr<CancellableOperation> op(new CancellableOperation());
+    q->addOperation(op);
+    q->addWorker();
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    BOOST_CHECK_EQUAL(op->isExecuting(), true);
+    BOOST_CHECK_EQUAL(op->isCancelRequested(), false);
+    op->cancel();
+    BOOST_CHECK_EQUAL(op->isCancelRequested(), true);
+    q->finishAndWait();
+    BOOST_CHECK_EQUAL(op->isCancelled(), true);
+    BOOST_CHECK(op->steps < 100);
+
+    UniValue status = op->getStatus();
+    BOOST_CHECK_EQUAL(find_value(status, "priority").get_str(), "normal");
+    BOOST_CHECK(find_value(status, "queued_secs").isNum());
+}
+
+// This tests that proving slots are limited and handed out by priority
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_proving_slots)
+{
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    q->setMaxProvingOperations(1);
+    BOOST_CHECK_EQUAL(q->getMaxProvingOperations(), 1);
+
+    q->acquireProvingSlot(OperationPriority::NORMAL);
+    BOOST_CHECK_EQUAL(q->getActiveProvingOperations(), 1);
+
+    std::vector<std::string> order;
+    std::mutex orderLock;
+    std::thread low([&]() {
+        q->acquireProvingSlot(OperationPriority::LOW);
+        { std::lock_guard<std::mutex> guard(orderLock); order.push_back("low"); }
+        q->releaseProvingSlot();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::thread high([&]() {
+        q->acquireProvingSlot(OperationPriority::HIGH);
+        { std::lock_guard<std::mutex> guard(orderLock); order.push_back("high"); }
+        q->releaseProvingSlot();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Both are blocked behind the slot held by this thread
+    BOOST_CHECK_EQUAL(q->getActiveProvingOperations(), 1);
+    BOOST_CHECK(order.empty());
+
+    q->releaseProvingSlot();
+    low.join();
+    high.join();
+
+    std::vector<std::string> expected = {"high", "low"};
+    BOOST_CHECK(order == expected);
+    BOOST_CHECK_EQUAL(q->getActiveProvingOperations(), 0);
+}
+
+// The OverlapOperation records how many operations ran at the same time
+std::atomic<int> gRunning(0);
+std::atomic<int> gMaxRunning(0);
+
+class OverlapOperation : public AsyncRPCOperation {
+public:
+    OverlapOperation() {}
+    virtual ~OverlapOperation() {}
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        int running = ++gRunning;
+        int max = gMaxRunning;
+        while (running > max && !gMaxRunning.compare_exchange_weak(max, running)) {}
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        gRunning--;
+        set_state(OperationStatus::SUCCESS);
+    }
+};
+
+// This tests that with the default number of workers, an operation submitted
+// while another is executing waits for it, so that they can't select the same notes
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_default_workers_serialize)
+{
+    gRunning = 0;
+    gMaxRunning = 0;
+
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    for (int i = 0; i < DEFAULT_RPC_ASYNC_THREADS; i++)
+        q->addWorker();
+
+    std::shared_ptr<AsyncRPCOperation> first(new OverlapOperation());
+    std::shared_ptr<AsyncRPCOperation> second(new OverlapOperation());
+    q->addOperation(first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(first->isExecuting(), true);
+    q->addOperation(second);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(second->isReady(), true);
+
+    q->finishAndWait();
+    BOOST_CHECK_EQUAL(first->isSuccess(), true);
+    BOOST_CHECK_EQUAL(second->isSuccess(), true);
+    BOOST_CHECK_EQUAL(gMaxRunning, 1);
+}
+
 // This tests z_getoperationstatus, z_getoperationresult, z_listoperationids
 BOOST_AUTO_TEST_CASE(rpc_z_getoperations)
 {
@@ -857,7 +1025,7 @@ BOOST_AUTO_TEST_CASE(rpc_z_sendmany_parameters)
 
     BOOST_CHECK_THROW(CallRPC("z_sendmany"), runtime_error);
     BOOST_CHECK_THROW(CallRPC("z_sendmany toofewargs"), runtime_error);
-    BOOST_CHECK_THROW(CallRPC("z_sendmany just too many args here"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_sendmany just too many args given here"), runtime_error);
 
     // bad from address
     BOOST_CHECK_THROW(CallRPC("z_sendmany "
@@ -953,6 +1121,88 @@ BOOST_AUTO_TEST_CASE(rpc_z_sendmany_parameters)
 }
 
 
+BOOST_AUTO_TEST_CASE(rpc_z_sendmanybatch_parameters)
+{
+    SelectParams(CBaseChainParams::TESTNET);
+
+    LOCK(pwalletMain->cs_wallet);
+
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch [] 1 0.0001 normal toomany"), runtime_error);
+
+    // not an array, and empty groups
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch notanarray"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch []"), runtime_error);
+
+    // unknown key in a group
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch "
+            "[{\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\", \"unknown\":1,"
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":50.0}]}]"
+            ), runtime_error);
+
+    // bad from address in the second group
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch "
+            "[{\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":50.0}]},"
+            " {\"fromaddress\":\"INVALIDtmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":50.0}]}]"
+            ), runtime_error);
+
+    // fee amount is bigger than sum of outputs of a group
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch "
+            "[{\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":0.5}]}] "
+            "1 0.50000001"
+            ), runtime_error);
+
+    // invalid priority
+    BOOST_CHECK_THROW(CallRPC("z_sendmanybatch "
+            "[{\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":50.0}]}] "
+            "1 0.0001 urgent"
+            ), runtime_error);
+
+    // Test constructor of AsyncRPCOperation_sendmanybatch
+    try {
+        std::shared_ptr<AsyncRPCOperation> operation(new AsyncRPCOperation_sendmanybatch({}));
+    } catch (const UniValue& objError) {
+        BOOST_CHECK( find_error(objError, "No transactions"));
+    }
+
+    // Groups from the same address are chained, others run in parallel
+    std::vector<SendManyRecipient> recipients = { SendManyRecipient("tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn", 1.0, "") };
+    std::vector<std::shared_ptr<AsyncRPCOperation_sendmany>> operations = {
+        std::shared_ptr<AsyncRPCOperation_sendmany>( new AsyncRPCOperation_sendmany("tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ", recipients, {}, 1) ),
+        std::shared_ptr<AsyncRPCOperation_sendmany>( new AsyncRPCOperation_sendmany("tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn", recipients, {}, 1) ),
+        std::shared_ptr<AsyncRPCOperation_sendmany>( new AsyncRPCOperation_sendmany("tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ", recipients, {}, 1) ),
+    };
+    std::shared_ptr<AsyncRPCOperation_sendmanybatch> batch(new AsyncRPCOperation_sendmanybatch(operations));
+    BOOST_CHECK_EQUAL(batch->getNumberOfChains(), 2);
+    UniValue status = batch->getStatus();
+    BOOST_CHECK_EQUAL(find_value(status, "method").get_str(), "z_sendmanybatch");
+    BOOST_CHECK_EQUAL(find_value(status, "transactions").size(), 3);
+
+    // Groups from the same address are merged into one transaction
+    UniValue retValue;
+    BOOST_CHECK_NO_THROW(retValue = CallRPC("z_sendmanybatch "
+            "[{\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":1.0}]},"
+            " {\"fromaddress\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\","
+            " \"amounts\":[{\"address\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\", \"amount\":1.0}]},"
+            " {\"fromaddress\":\"tmRr6yJonqGK23UVhrKuyvTpF8qxQQjKigJ\","
+            " \"amounts\":[{\"address\":\"tmQP9L3s31cLsghVYf2Jb5MhKj1jRBPoeQn\", \"amount\":2.0}]}]"
+            ));
+    std::shared_ptr<AsyncRPCOperation> operation = getAsyncRPCQueue()->getOperationForId(retValue.get_str());
+    batch = std::dynamic_pointer_cast<AsyncRPCOperation_sendmanybatch>(operation);
+    BOOST_REQUIRE(batch);
+    BOOST_CHECK_EQUAL(batch->getNumberOfChains(), 2);
+    UniValue transactions = find_value(batch->getStatus(), "transactions");
+    BOOST_CHECK_EQUAL(transactions.size(), 2);
+    BOOST_CHECK_EQUAL(find_value(find_value(transactions[0], "params"), "amounts").size(), 2);
+    BOOST_CHECK_EQUAL(find_value(find_value(transactions[1], "params"), "amounts").size(), 1);
+}
+
+
 // TODO: test private methods
 BOOST_AUTO_TEST_CASE(rpc_z_sendmany_internals)
 {
@@ -1251,7 +1501,7 @@ BOOST_AUTO_TEST_CASE(rpc_z_shieldcoinbase_parameters)
 
     BOOST_CHECK_THROW(CallRPC("z_shieldcoinbase"), runtime_error);
     BOOST_CHECK_THROW(CallRPC("z_shieldcoinbase toofewargs"), runtime_error);
-    BOOST_CHECK_THROW(CallRPC("z_shieldcoinbase too many args here"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_shieldcoinbase too many args shown here"), runtime_error);
 
     // bad from address
     BOOST_CHECK_THROW(CallRPC("z_shieldcoinbase "
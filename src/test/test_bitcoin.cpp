@@ -7,6 +7,8 @@
 #include "test_bitcoin.h"
 
 #include "crypto/common.h"
+#include "crypto/blake2b.h"
+#include "crypto/sha256.h"
 
 #include "key.h"
 #include "main.h"
@@ -34,6 +36,8 @@ BasicTestingSetup::BasicTestingSetup()
 {
         assert(init_and_check_sodium() != -1);
         ECC_Start();
+        SHA256AutoDetect();
+        BLAKE2bAutoDetect();
         pzcashParams = ZCJoinSplit::Unopened();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -0,0 +1,144 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+#include "validationinterface.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+class RecordingListener : public CValidationInterface
+{
+public:
+    bool fAsync;
+    std::vector<std::string> events;
+    std::vector<uint256> txids;
+    std::vector<const CBlock*> blocks;
+    std::vector<std::thread::id> threads;
+    std::vector<CSerializedBlockRef> serialized;
+
+    RecordingListener(bool fAsyncIn) : fAsync(fAsyncIn) {}
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+    {
+        Record("tx", pblock);
+        txids.push_back(tx.GetHash());
+        if (pblock) {
+            // The transaction is the block's own copy.
+            BOOST_CHECK(&tx >= &pblock->vtx.front() && &tx <= &pblock->vtx.back());
+        }
+    }
+    void ChainTip(const CBlockIndex* pindex, const CBlock* pblock, const ZCIncrementalMerkleTree& tree, bool added)
+    {
+        Record(added ? "connect" : "disconnect", pblock);
+        BOOST_CHECK(tree.size() == 0);
+    }
+    void BlockChecked(const CBlock& block, const CValidationState& state) { Record("checked", &block); }
+    void UpdatedBlockTip(const CBlockIndex* pindex, const CSerializedBlockRef& block)
+    {
+        Record("tip", NULL);
+        serialized.push_back(block);
+    }
+    bool NotifyAsynchronously() const { return fAsync; }
+
+private:
+    void Record(const std::string& event, const CBlock* pblock)
+    {
+        events.push_back(event);
+        blocks.push_back(pblock);
+        threads.push_back(std::this_thread::get_id());
+    }
+};
+
+void NotifyBlock(const CBlockIndex* pindex, const CSerializedBlockRef& serialized = CSerializedBlockRef())
+{
+    CBlock block;
+    for (uint32_t i = 0; i < 3; i++) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = i;
+        block.vtx.push_back(mtx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    CValidationState state;
+    ZCIncrementalMerkleTree tree;
+
+    GetMainSignals().BlockChecked(block, state);
+    for (const CTransaction& tx : block.vtx) {
+        GetMainSignals().SyncTransaction(tx, &block);
+    }
+    GetMainSignals().ChainTip(pindex, &block, tree, true);
+    GetMainSignals().UpdatedBlockTip(pindex, serialized);
+    // block goes out of scope here, before the queue is necessarily drained.
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(async_notifications_are_ordered_snapshots)
+{
+    CBlockIndex index;
+    RecordingListener sync(false), async(true);
+    RegisterValidationInterface(&sync);
+    RegisterValidationInterface(&async);
+
+    CSerializedBlockRef serialized = std::make_shared<const std::vector<unsigned char> >(80, 0);
+    NotifyBlock(&index, serialized);
+    NotifyBlock(&index);
+
+    // The synchronous listener has seen everything already, on this thread.
+    std::vector<std::string> expected = {"checked", "tx", "tx", "tx", "connect", "tip",
+                                         "checked", "tx", "tx", "tx", "connect", "tip"};
+    BOOST_CHECK(sync.events == expected);
+    for (std::thread::id id : sync.threads) {
+        BOOST_CHECK(id == std::this_thread::get_id());
+    }
+
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(async.events == expected);
+    BOOST_CHECK(async.txids == sync.txids);
+    for (std::thread::id id : async.threads) {
+        BOOST_CHECK(id != std::this_thread::get_id());
+    }
+    // Each block is copied once, and shared by all of its notifications.
+    for (size_t i = 0; i < 5; i++) {
+        BOOST_CHECK(async.blocks[i] == async.blocks[0]);
+        BOOST_CHECK(async.blocks[6 + i] == async.blocks[6]);
+    }
+    BOOST_CHECK(async.blocks[5] == NULL);
+    // The serialized tip is passed along as it is.
+    BOOST_CHECK(sync.serialized.size() == 2 && async.serialized.size() == 2);
+    BOOST_CHECK(async.serialized[0] == serialized);
+    BOOST_CHECK(!async.serialized[1]);
+
+    UnregisterValidationInterface(&async);
+    UnregisterValidationInterface(&sync);
+}
+
+BOOST_AUTO_TEST_CASE(unregister_delivers_queued_notifications)
+{
+    CBlockIndex index;
+    RecordingListener async(true);
+    RegisterValidationInterface(&async);
+    for (int i = 0; i < 10; i++) {
+        NotifyBlock(&index);
+    }
+    UnregisterValidationInterface(&async);
+    BOOST_CHECK_EQUAL(async.events.size(), 60);
+
+    // Nothing is delivered once unregistered.
+    NotifyBlock(&index);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(async.events.size(), 60);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
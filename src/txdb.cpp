@@ -9,9 +9,11 @@
 #include "hash.h"
 #include "main.h"
 #include "pow.h"
+#include "random.h"
 #include "uint256.h"
 
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -23,12 +25,19 @@ static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_ADDRESSINDEX = 'd';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_NULLIFIERINDEX = 'N';
+static const char DB_COMMITMENTINDEX = 'C';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_ANCHOR = 'a';
+static const char DB_UTXO_COMMITMENT = 'U';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_SNAPSHOT = 'S';
 
 
 void static BatchWriteAnchor(CLevelDBBatch &batch,
@@ -65,10 +74,42 @@ void static BatchWriteHashBestAnchor(CLevelDBBatch &batch, const uint256 &hash)
     batch.Write(DB_BEST_ANCHOR, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe), nullifierFilter(0) {
+    LoadNullifierFilter();
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), nullifierFilter(0) {
+    LoadNullifierFilter();
+}
+
+/**
+ * Rebuild the nullifier filter from the database, with room for as many
+ * nullifiers again before it has to be rebuilt.
+ */
+void CCoinsViewDB::LoadNullifierFilter() {
+    std::vector<uint256> vNullifiers;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_NULLIFIER, uint256());
+    pcursor->Seek(ssKeySet.str());
+    while (pcursor->Valid()) {
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+        char chType;
+        ssKey >> chType;
+        if (chType != DB_NULLIFIER)
+            break;
+        uint256 nf;
+        ssKey >> nf;
+        vNullifiers.push_back(nf);
+        pcursor->Next();
+    }
+
+    nullifierFilter.reset(std::max<size_t>(2 * vNullifiers.size(), MIN_NULLIFIER_FILTER_ELEMENTS));
+    BOOST_FOREACH(const uint256& nf, vNullifiers) {
+        nullifierFilter.insert(nf);
+    }
+    LogPrint("coindb", "Loaded %u nullifiers into a filter of %u bytes\n", vNullifiers.size(), nullifierFilter.DynamicMemoryUsage());
 }
 
 
@@ -85,6 +126,10 @@ bool CCoinsViewDB::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree)
 }
 
 bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
+    // Almost every nullifier looked up is unspent; answer those from memory
+    if (!nullifierFilter.contains(nf))
+        return false;
+
     bool spent = false;
     bool read = db.Read(make_pair(DB_NULLIFIER, nf), spent);
 
@@ -113,11 +158,20 @@ uint256 CCoinsViewDB::GetBestAnchor() const {
     return hashBestAnchor;
 }
 
+bool CCoinsViewDB::GetUtxoCommitment(CUtxoCommitment &commitment) const {
+    std::pair<uint256, CUtxoCommitment> stored;
+    if (!db.Read(DB_UTXO_COMMITMENT, stored))
+        return false;
+    commitment = stored.second;
+    return true;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
                               const uint256 &hashBlock,
                               const uint256 &hashAnchor,
                               CAnchorsMap &mapAnchors,
-                              CNullifiersMap &mapNullifiers) {
+                              CNullifiersMap &mapNullifiers,
+                              const CUtxoCommitment *pUtxoCommitment) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
@@ -143,6 +197,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     for (CNullifiersMap::iterator it = mapNullifiers.begin(); it != mapNullifiers.end();) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             BatchWriteNullifier(batch, it->first, it->second.entered);
+            // Nullifiers unspent by a reorg stay in the filter until it is rebuilt
+            if (it->second.entered)
+                nullifierFilter.insert(it->first);
             // TODO: changed++?
         }
         CNullifiersMap::iterator itOld = it++;
@@ -153,9 +210,17 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         BatchWriteHashBestChain(batch, hashBlock);
     if (!hashAnchor.IsNull())
         BatchWriteHashBestAnchor(batch, hashAnchor);
+    // The commitment is stored with the best block it matches, so that one left
+    // behind by a binary that doesn't maintain it is detected
+    if (pUtxoCommitment)
+        batch.Write(DB_UTXO_COMMITMENT, std::make_pair(hashBlock.IsNull() ? GetBestBlock() : hashBlock, *pUtxoCommitment));
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+    if (nullifierFilter.IsFull())
+        LoadNullifierFilter();
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -181,17 +246,35 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+/** Read a record through an iterator, so that it comes from the iterator's snapshot. */
+template<typename K, typename V>
+static bool ReadAtCursor(leveldb::Iterator *pcursor, const K &key, V &value)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << key;
+    std::string strKey = ssKey.str();
+    pcursor->Seek(strKey);
+    if (!pcursor->Valid() || pcursor->key() != leveldb::Slice(strKey))
+        return false;
+    try {
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> value;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/** Compute the statistics and the commitment of the UTXO set from every coins record. */
+static bool ScanCoinsDB(leveldb::Iterator *pcursor, CCoinsStats &stats, CUtxoCommitment &commitment)
+{
+    if (!ReadAtCursor(pcursor, DB_BEST_BLOCK, stats.hashBlock))
+        stats.hashBlock = uint256();
     pcursor->SeekToFirst();
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -210,16 +293,14 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
                 ss << VARINT(coins.nVersion);
                 ss << (coins.fCoinBase ? 'c' : 'n');
                 ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
                 for (unsigned int i=0; i<coins.vout.size(); i++) {
                     const CTxOut &out = coins.vout[i];
                     if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
                         ss << VARINT(i+1);
                         ss << out;
-                        nTotalAmount += out.nValue;
                     }
                 }
+                commitment.AddCoins(txhash, coins);
                 stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
             }
@@ -228,15 +309,61 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
             return error("%s: Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    stats.nTransactions = commitment.nTransactions;
+    stats.nTransactionOutputs = commitment.nTransactionOutputs;
+    stats.nTotalAmount = commitment.nTotalAmount;
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
+
+bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
+    /* It seems that there are no "const iterators" for LevelDB.  Since we
+       only need read operations on it, use a const-cast to get around
+       that restriction.  */
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+
+    // Everything is read through the one iterator, so the scanned set and the
+    // stored commitment match the same best block even if the coins database
+    // is flushed meanwhile.
+    std::pair<uint256, CUtxoCommitment> stored;
+    bool fHaveStored = ReadAtCursor(pcursor.get(), DB_UTXO_COMMITMENT, stored);
+    CUtxoCommitment scanned;
+    if (!ScanCoinsDB(pcursor.get(), stats, scanned))
+        return false;
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    stats.hashUtxoSet = scanned.GetHash();
+    stats.fUtxoCommitmentValid = fHaveStored &&
+        stored.first == stats.hashBlock &&
+        stored.second.nTransactions == scanned.nTransactions &&
+        stored.second.nTransactionOutputs == scanned.nTransactionOutputs &&
+        stored.second.nTotalAmount == scanned.nTotalAmount &&
+        stored.second.GetHash() == stats.hashUtxoSet;
     return true;
 }
 
+bool CCoinsViewDB::InitUtxoCommitment() {
+    std::pair<uint256, CUtxoCommitment> stored;
+    if (db.Read(DB_UTXO_COMMITMENT, stored)) {
+        if (stored.first == GetBestBlock())
+            return true;
+        // The coins were updated by a binary that doesn't maintain the commitment
+        LogPrintf("UTXO set commitment is for block %s, not the best block\n", stored.first.ToString());
+    }
+
+    LogPrintf("Computing the UTXO set commitment...\n");
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CCoinsStats stats;
+    CUtxoCommitment commitment;
+    if (!ScanCoinsDB(pcursor.get(), stats, commitment))
+        return false;
+    LogPrintf("UTXO set commitment covers %u outputs of %u transactions\n",
+              commitment.nTransactionOutputs, commitment.nTransactions);
+    return db.Write(DB_UTXO_COMMITMENT, std::make_pair(stats.hashBlock, commitment), true);
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -244,11 +371,24 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        CDiskBlockIndex diskindex(*it);
+        if (diskindex.nSolution.empty()) {
+            // The solution is not kept in memory once an entry has been
+            // written, so take it from the existing record.
+            CDiskBlockIndex prev;
+            if (!ReadDiskBlockIndex((*it)->GetBlockHash(), prev))
+                return error("%s: no solution for block %s", __func__, (*it)->GetBlockHash().ToString());
+            diskindex.nSolution = prev.nSolution;
+        }
+        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), diskindex);
     }
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex) {
+    return Read(make_pair(DB_BLOCK_INDEX, hash), diskindex);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
@@ -260,6 +400,138 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                        const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                                        const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                                        bool fDisconnect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        if (fDisconnect)
+            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    }
+    // Entries are applied in order, so an output created and spent within the block ends up erased
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=addressUnspentIndex.begin(); it!=addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=spentIndex.begin(); it!=spentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160 &addressHash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    int nStart, int nEnd) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0)
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nStart));
+    else
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSINDEX)
+                break;
+            CAddressIndexKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            if (nEnd > 0 && indexKey.blockHeight > nEnd)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            addressIndex.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160 &addressHash, int type,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSUNSPENTINDEX)
+                break;
+            CAddressUnspentKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            unspentOutputs.push_back(make_pair(indexKey, value));
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::UpdateShieldedIndex(const std::vector<std::pair<uint256, CNullifierIndexValue> > &nullifierIndex,
+                                       const std::vector<std::pair<uint256, CCommitmentIndexValue> > &commitmentIndex,
+                                       bool fDisconnect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, CNullifierIndexValue> >::const_iterator it=nullifierIndex.begin(); it!=nullifierIndex.end(); it++) {
+        if (fDisconnect)
+            batch.Erase(make_pair(DB_NULLIFIERINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_NULLIFIERINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<uint256, CCommitmentIndexValue> >::const_iterator it=commitmentIndex.begin(); it!=commitmentIndex.end(); it++) {
+        if (fDisconnect)
+            batch.Erase(make_pair(DB_COMMITMENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_COMMITMENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadNullifierIndex(const uint256 &nullifier, CNullifierIndexValue &value) {
+    return Read(make_pair(DB_NULLIFIERINDEX, nullifier), value);
+}
+
+bool CBlockTreeDB::ReadCommitmentIndex(const uint256 &commitment, CCommitmentIndexValue &value) {
+    return Read(make_pair(DB_COMMITMENTINDEX, commitment), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -272,54 +544,255 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+/** Copy a block index record into its in-memory entry, creating it if needed. */
+static void LoadDiskBlockIndex(const uint256& hash, const CDiskBlockIndex& diskindex)
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    CBlockIndex* pindexNew = InsertBlockIndex(hash);
+    pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight        = diskindex.nHeight;
+    pindexNew->nFile          = diskindex.nFile;
+    pindexNew->nDataPos       = diskindex.nDataPos;
+    pindexNew->nUndoPos       = diskindex.nUndoPos;
+    pindexNew->hashAnchor     = diskindex.hashAnchor;
+    pindexNew->nVersion       = diskindex.nVersion;
+    pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+    pindexNew->hashReserved   = diskindex.hashReserved;
+    pindexNew->nTime          = diskindex.nTime;
+    pindexNew->nBits          = diskindex.nBits;
+    pindexNew->nNonce         = diskindex.nNonce;
+    // nSolution is left on disk, see ReadBlockHeader()
+    pindexNew->nStatus        = diskindex.nStatus;
+    pindexNew->nTx            = diskindex.nTx;
+}
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair(DB_BLOCK_INDEX, uint256());
-    pcursor->Seek(ssKeySet.str());
+namespace {
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+/** Block index records of one part of the 'b' keyspace, decoded by a worker thread. */
+struct BlockIndexPartition {
+    std::vector<std::pair<uint256, CDiskBlockIndex> > vEntries;
+    std::string strError;
+};
+
+}
+
+/**
+ * Decode the block index records whose hash starts with a byte in
+ * [nBegin, nEnd). Hashing each header and checking its proof of work
+ * dominates the cost of loading the index, so this is what runs in parallel.
+ */
+static void LoadBlockIndexPartition(CBlockTreeDB* pdb, int nBegin, int nEnd, BlockIndexPartition* pResult)
+{
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pdb->NewIterator());
+
+        uint256 hashStart;
+        *hashStart.begin() = nBegin;
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << make_pair(DB_BLOCK_INDEX, hashStart);
+        pcursor->Seek(ssKeySet.str());
+
+        while (pcursor->Valid()) {
             leveldb::Slice slKey = pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
+            uint256 hashKey;
             ssKey >> chType;
-            if (chType == DB_BLOCK_INDEX) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashAnchor     = diskindex.hashAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            if (chType != DB_BLOCK_INDEX)
+                break;
+            ssKey >> hashKey;
+            if (*hashKey.begin() >= nEnd)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            uint256 hash = diskindex.GetBlockHash();
+            if (!CheckProofOfWork(hash, diskindex.nBits, Params().GetConsensus())) {
+                pResult->strError = strprintf("CheckProofOfWork failed: %s", diskindex.ToString());
+                return;
             }
-        } catch (const std::exception& e) {
-            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+
+            // Only the hash needs the solution; don't hold it in memory
+            std::vector<unsigned char>().swap(diskindex.nSolution);
+            pResult->vEntries.push_back(make_pair(hash, diskindex));
+            pcursor->Next();
+        }
+    } catch (const std::exception& e) {
+        pResult->strError = strprintf("Deserialize or I/O error - %s", e.what());
+    }
+}
+
+static boost::filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "indexsnapshot.dat";
+}
+
+namespace {
+
+/**
+ * The DB_INDEX_SNAPSHOT record: the id of the snapshot file, and the state of
+ * the database it was taken from. A binary that doesn't know about snapshots
+ * leaves the record behind, but connecting or storing any block changes the
+ * best block or the last block file, so the record no longer matches.
+ */
+struct CBlockIndexSnapshotRecord
+{
+    uint256 id;
+    uint256 hashBestChain;
+    int nLastBlockFile;
+    CBlockFileInfo lastBlockFileInfo;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(id);
+        READWRITE(hashBestChain);
+        READWRITE(nLastBlockFile);
+        READWRITE(lastBlockFileInfo);
+    }
+
+    bool Matches(const CBlockIndexSnapshotRecord& other) const {
+        return hashBestChain == other.hashBestChain &&
+               nLastBlockFile == other.nLastBlockFile &&
+               lastBlockFileInfo.nBlocks == other.lastBlockFileInfo.nBlocks &&
+               lastBlockFileInfo.nSize == other.lastBlockFileInfo.nSize &&
+               lastBlockFileInfo.nUndoSize == other.lastBlockFileInfo.nUndoSize;
+    }
+};
+
+}
+
+/** Fill in the database state that a snapshot record is checked against. */
+static void ReadBlockIndexSnapshotState(CBlockTreeDB* pdb, const uint256& hashBestChain, CBlockIndexSnapshotRecord& record)
+{
+    record.hashBestChain = hashBestChain;
+    record.nLastBlockFile = 0;
+    pdb->ReadLastBlockFile(record.nLastBlockFile);
+    record.lastBlockFileInfo.SetNull();
+    pdb->ReadBlockFileInfo(record.nLastBlockFile, record.lastBlockFileInfo);
+}
+
+/**
+ * Write every block index entry to a single file, so that the next start can
+ * load the index in one sequential read instead of decoding and hashing each
+ * record. The snapshot is tied to the database by a random id, stored with
+ * the best block and the last block file. The record is erased as soon as the
+ * snapshot is loaded, so a snapshot is only ever used once, and it is ignored
+ * if the database has changed since.
+ *
+ * Must be called with the block index fully flushed.
+ */
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const uint256& hashBestChain)
+{
+    boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    FILE *file = fopen(path.string().c_str(), "wb");
+    if (!file)
+        return error("%s: failed to open %s", __func__, path.string());
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+
+    CBlockIndexSnapshotRecord record;
+    record.id = GetRandHash();
+    ReadBlockIndexSnapshotState(this, hashBestChain, record);
+    try {
+        fileout << record.id;
+        WriteCompactSize(fileout, mapBlockIndex.size());
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            CDiskBlockIndex diskindex(item.second);
+            diskindex.nSolution.clear();
+            fileout << item.first;
+            fileout << diskindex;
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!Write(DB_INDEX_SNAPSHOT, record, true))
+        return error("%s: failed to record snapshot id", __func__);
+    LogPrintf("Wrote block index snapshot of %d entries\n", mapBlockIndex.size());
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(const uint256& hashBestChain)
+{
+    if (!Exists(DB_INDEX_SNAPSHOT))
+        return false;
+    // A record in an older format, holding only the id, fails to read here
+    CBlockIndexSnapshotRecord record;
+    if (!Read(DB_INDEX_SNAPSHOT, record))
+        record.id.SetNull();
+    // Whatever happens next, the snapshot must not be used again
+    if (!Erase(DB_INDEX_SNAPSHOT, true))
+        return false;
+    // A node restarted without -blockindexsnapshot still drops the id above,
+    // as the database may change before the option is given again
+    if (!GetBoolArg("-blockindexsnapshot", false))
+        return false;
+
+    CBlockIndexSnapshotRecord current;
+    ReadBlockIndexSnapshotState(this, hashBestChain, current);
+    if (record.id.IsNull() || !record.Matches(current)) {
+        LogPrintf("%s: block index database changed since the snapshot, ignoring it\n", __func__);
+        return false;
+    }
+
+    boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    // Read the whole snapshot before touching mapBlockIndex, so that a bad
+    // file leaves nothing behind for the database scan
+    std::vector<std::pair<uint256, CDiskBlockIndex> > vEntries;
+    try {
+        uint256 idFile;
+        filein >> idFile;
+        if (idFile != record.id) {
+            LogPrintf("%s: snapshot does not match the block index database, ignoring it\n", __func__);
+            return false;
+        }
+        filein >> vEntries;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        return false;
+    }
+
+    for (const std::pair<uint256, CDiskBlockIndex>& entry : vEntries) {
+        LoadDiskBlockIndex(entry.first, entry.second);
+    }
+    LogPrintf("Loaded block index snapshot of %d entries\n", vEntries.size());
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const uint256& hashBestChain)
+{
+    if (LoadBlockIndexSnapshot(hashBestChain))
+        return true;
+
+    // Split the keyspace by the first byte of the block hash. Block hashes
+    // are uniformly distributed, so the parts are of similar size.
+    int nThreads = std::max(1, std::min(MAX_BLOCK_INDEX_LOAD_THREADS, (int)boost::thread::hardware_concurrency()));
+    std::vector<BlockIndexPartition> vPartitions(nThreads);
+    std::vector<std::thread> vThreads;
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(LoadBlockIndexPartition, this,
+                              256 * i / nThreads, 256 * (i + 1) / nThreads, &vPartitions[i]);
+    }
+    for (std::thread& t : vThreads) {
+        t.join();
+    }
+
+    // Load mapBlockIndex
+    for (const BlockIndexPartition& partition : vPartitions) {
+        if (!partition.strError.empty())
+            return error("LoadBlockIndex(): %s", partition.strError);
+        for (const std::pair<uint256, CDiskBlockIndex>& entry : partition.vEntries) {
+            boost::this_thread::interruption_point();
+            LoadDiskBlockIndex(entry.first, entry.second);
         }
     }
 
@@ -6,8 +6,12 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
+#include "bloom.h"
 #include "coins.h"
 #include "leveldbwrapper.h"
+#include "shieldedindex.h"
+#include "spentindex.h"
 
 #include <map>
 #include <string>
@@ -16,6 +20,7 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 class uint256;
 
@@ -25,13 +30,20 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! min. number of nullifiers the nullifier filter is sized for
+static const size_t MIN_NULLIFIER_FILTER_ELEMENTS = 100000;
+//! max. threads decoding the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+    //! Filter of the spent nullifiers in db, so that unspent ones are answered without a read
+    CBlockedBloomFilter nullifierFilter;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    void LoadNullifierFilter();
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -41,12 +53,16 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
+    bool GetUtxoCommitment(CUtxoCommitment &commitment) const;
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
                     const uint256 &hashAnchor,
                     CAnchorsMap &mapAnchors,
-                    CNullifiersMap &mapNullifiers);
+                    CNullifiersMap &mapNullifiers,
+                    const CUtxoCommitment *pUtxoCommitment);
     bool GetStats(CCoinsStats &stats) const;
+    //! Build the UTXO set commitment with a full scan, if the database has none for its best block
+    bool InitUtxoCommitment();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -59,15 +75,40 @@ private:
     void operator=(const CBlockTreeDB&);
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    //! Apply a block's changes to the address and spent indexes in one batch.
+    //! Null unspent and spent values are erased, as are the address records when disconnecting.
+    bool UpdateAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                              const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                              const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                              bool fDisconnect);
+    //! Read the records of an address, optionally only those between two heights inclusive
+    bool ReadAddressIndex(const uint160 &addressHash, int type,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                          int nStart = 0, int nEnd = 0);
+    bool ReadAddressUnspentIndex(const uint160 &addressHash, int type,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
+    //! Apply a block's changes to the shielded index in one batch, erasing its entries when disconnecting
+    bool UpdateShieldedIndex(const std::vector<std::pair<uint256, CNullifierIndexValue> > &nullifierIndex,
+                             const std::vector<std::pair<uint256, CCommitmentIndexValue> > &commitmentIndex,
+                             bool fDisconnect);
+    bool ReadNullifierIndex(const uint256 &nullifier, CNullifierIndexValue &value);
+    bool ReadCommitmentIndex(const uint256 &commitment, CCommitmentIndexValue &value);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts();
+    //! Load the block index, from the snapshot if it matches the database and hashBestChain
+    bool LoadBlockIndexGuts(const uint256& hashBestChain);
+    //! Write a snapshot of mapBlockIndex, valid while the database and hashBestChain don't change
+    bool WriteBlockIndexSnapshot(const uint256& hashBestChain);
+    //! Load mapBlockIndex from the snapshot, which is then dropped; false if it is missing or stale
+    bool LoadBlockIndexSnapshot(const uint256& hashBestChain);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -5,15 +5,299 @@
 
 #include "validationinterface.h"
 
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * Delivers notifications to the listeners that asked for them asynchronously.
+ *
+ * It is connected to the signals as a single synchronous listener, and
+ * queues every notification together with shared snapshots of the block,
+ * transaction or tree it refers to. A thread of its own then calls each
+ * asynchronous listener in turn, in the order the notifications were sent.
+ * The thread runs for as long as there are asynchronous listeners.
+ */
+class CAsyncValidationDispatcher
+{
+private:
+    typedef std::function<void(CValidationInterface*)> Callback;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condProgress;
+    std::deque<Callback> queue;
+    std::vector<CValidationInterface*> listeners;
+    bool fBusy = false;
+    bool fStop = false;
+    std::thread thread;
+
+    //! The block last shared with the queue, so that it is only copied once
+    //! for its BlockChecked, SyncTransaction and ChainTip notifications.
+    std::mutex csSnapshot;
+    const CBlock* pblockLast = NULL;
+    std::shared_ptr<const CBlock> blockLast;
+
+    void Push(Callback callback)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (listeners.empty())
+            return;
+        queue.push_back(std::move(callback));
+        condWork.notify_one();
+    }
+
+    std::shared_ptr<const CBlock> Snapshot(const CBlock* pblock)
+    {
+        if (!pblock)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(csSnapshot);
+        if (pblock != pblockLast || !blockLast || blockLast->hashMerkleRoot != pblock->hashMerkleRoot) {
+            blockLast = std::make_shared<const CBlock>(*pblock);
+            pblockLast = pblock;
+        }
+        return blockLast;
+    }
+
+    void ResetSnapshot()
+    {
+        std::lock_guard<std::mutex> lock(csSnapshot);
+        pblockLast = NULL;
+        blockLast.reset();
+    }
+
+    void ThreadDispatch()
+    {
+        RenameThread("zcash-notify");
+        std::unique_lock<std::mutex> lock(cs);
+        while (true) {
+            condWork.wait(lock, [this] { return fStop || !queue.empty(); });
+            // Whatever was queued before stopping is still delivered.
+            if (queue.empty())
+                break;
+            Callback callback = std::move(queue.front());
+            queue.pop_front();
+            std::vector<CValidationInterface*> targets = listeners;
+            fBusy = true;
+            lock.unlock();
+            for (CValidationInterface* listener : targets) {
+                try {
+                    callback(listener);
+                } catch (const std::exception& e) {
+                    PrintExceptionContinue(&e, "zcash-notify");
+                } catch (...) {
+                    PrintExceptionContinue(NULL, "zcash-notify");
+                }
+            }
+            lock.lock();
+            fBusy = false;
+            condProgress.notify_all();
+        }
+    }
+
+    void Connect();
+    void Disconnect();
+
+public:
+    ~CAsyncValidationDispatcher()
+    {
+        if (thread.joinable())
+            Stop();
+    }
+
+    void Add(CValidationInterface* listener)
+    {
+        bool fStart;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            listeners.push_back(listener);
+            fStart = !thread.joinable();
+            if (fStart) {
+                fStop = false;
+                thread = std::thread(&CAsyncValidationDispatcher::ThreadDispatch, this);
+            }
+        }
+        if (fStart)
+            Connect();
+    }
+
+    /** Stop notifying a listener, once what is already queued has been delivered. */
+    void Remove(CValidationInterface* listener)
+    {
+        Sync();
+        bool fLast;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            std::vector<CValidationInterface*>::iterator it = std::find(listeners.begin(), listeners.end(), listener);
+            if (it == listeners.end())
+                return;
+            listeners.erase(it);
+            fLast = listeners.empty();
+        }
+        if (fLast)
+            Stop();
+    }
+
+    void RemoveAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (listeners.empty())
+                return;
+        }
+        Sync();
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            listeners.clear();
+        }
+        Stop();
+    }
+
+    void Stop()
+    {
+        Disconnect();
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+            condWork.notify_one();
+        }
+        if (thread.joinable())
+            thread.join();
+        ResetSnapshot();
+    }
+
+    void Sync()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        // A listener waiting on its own notifications would never wake up.
+        if (std::this_thread::get_id() == thread.get_id())
+            return;
+        condProgress.wait(lock, [this] { return queue.empty() && !fBusy; });
+    }
+
+    void Limit()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        if (std::this_thread::get_id() == thread.get_id())
+            return;
+        condProgress.wait(lock, [this] { return queue.size() <= MAX_VALIDATION_QUEUE_SIZE; });
+    }
+
+    // Handlers for the signals, called on the notifying thread.
+
+    void UpdatedBlockTip(const CBlockIndex* pindex, const CSerializedBlockRef& block)
+    {
+        Push([pindex, block](CValidationInterface* listener) { listener->UpdatedBlockTip(pindex, block); });
+    }
+
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+    {
+        std::shared_ptr<const CBlock> block = Snapshot(pblock);
+        std::shared_ptr<const CTransaction> ptx;
+        // Transactions of the block point into its snapshot rather than being copied again.
+        if (pblock) {
+            const CTransaction* begin = pblock->vtx.data();
+            const CTransaction* end = begin + pblock->vtx.size();
+            if (std::less_equal<const CTransaction*>()(begin, &tx) && std::less<const CTransaction*>()(&tx, end)) {
+                ptx = std::shared_ptr<const CTransaction>(block, &block->vtx[&tx - begin]);
+            }
+        }
+        if (!ptx)
+            ptx = std::make_shared<const CTransaction>(tx);
+        Push([ptx, block](CValidationInterface* listener) { listener->SyncTransaction(*ptx, block.get()); });
+    }
+
+    void EraseTransaction(const uint256& hash)
+    {
+        Push([hash](CValidationInterface* listener) { listener->EraseFromWallet(hash); });
+    }
+
+    void UpdatedTransaction(const uint256& hash)
+    {
+        Push([hash](CValidationInterface* listener) { listener->UpdatedTransaction(hash); });
+    }
+
+    void ChainTip(const CBlockIndex* pindex, const CBlock* pblock, const ZCIncrementalMerkleTree& tree, bool added)
+    {
+        std::shared_ptr<const CBlock> block = Snapshot(pblock);
+        std::shared_ptr<const ZCIncrementalMerkleTree> ptree = std::make_shared<const ZCIncrementalMerkleTree>(tree);
+        Push([pindex, block, ptree, added](CValidationInterface* listener) {
+            listener->ChainTip(pindex, block.get(), *ptree, added);
+        });
+        // This is the last notification about the block.
+        ResetSnapshot();
+    }
+
+    void SetBestChain(const CBlockLocator& locator)
+    {
+        Push([locator](CValidationInterface* listener) { listener->SetBestChain(locator); });
+    }
+
+    void Inventory(const uint256& hash)
+    {
+        Push([hash](CValidationInterface* listener) { listener->Inventory(hash); });
+    }
+
+    void Broadcast(int64_t nBestBlockTime)
+    {
+        Push([nBestBlockTime](CValidationInterface* listener) { listener->ResendWalletTransactions(nBestBlockTime); });
+    }
+
+    void BlockChecked(const CBlock& block, const CValidationState& state)
+    {
+        std::shared_ptr<const CBlock> snapshot = Snapshot(&block);
+        Push([snapshot, state](CValidationInterface* listener) { listener->BlockChecked(*snapshot, state); });
+    }
+};
+
 static CMainSignals g_signals;
+static CAsyncValidationDispatcher g_dispatcher;
 
 CMainSignals& GetMainSignals()
 {
     return g_signals;
 }
 
+void CAsyncValidationDispatcher::Connect()
+{
+    g_signals.UpdatedBlockTip.connect(boost::bind(&CAsyncValidationDispatcher::UpdatedBlockTip, this, _1, _2));
+    g_signals.SyncTransaction.connect(boost::bind(&CAsyncValidationDispatcher::SyncTransaction, this, _1, _2));
+    g_signals.EraseTransaction.connect(boost::bind(&CAsyncValidationDispatcher::EraseTransaction, this, _1));
+    g_signals.UpdatedTransaction.connect(boost::bind(&CAsyncValidationDispatcher::UpdatedTransaction, this, _1));
+    g_signals.ChainTip.connect(boost::bind(&CAsyncValidationDispatcher::ChainTip, this, _1, _2, _3, _4));
+    g_signals.SetBestChain.connect(boost::bind(&CAsyncValidationDispatcher::SetBestChain, this, _1));
+    g_signals.Inventory.connect(boost::bind(&CAsyncValidationDispatcher::Inventory, this, _1));
+    g_signals.Broadcast.connect(boost::bind(&CAsyncValidationDispatcher::Broadcast, this, _1));
+    g_signals.BlockChecked.connect(boost::bind(&CAsyncValidationDispatcher::BlockChecked, this, _1, _2));
+}
+
+void CAsyncValidationDispatcher::Disconnect()
+{
+    g_signals.BlockChecked.disconnect(boost::bind(&CAsyncValidationDispatcher::BlockChecked, this, _1, _2));
+    g_signals.Broadcast.disconnect(boost::bind(&CAsyncValidationDispatcher::Broadcast, this, _1));
+    g_signals.Inventory.disconnect(boost::bind(&CAsyncValidationDispatcher::Inventory, this, _1));
+    g_signals.SetBestChain.disconnect(boost::bind(&CAsyncValidationDispatcher::SetBestChain, this, _1));
+    g_signals.ChainTip.disconnect(boost::bind(&CAsyncValidationDispatcher::ChainTip, this, _1, _2, _3, _4));
+    g_signals.UpdatedTransaction.disconnect(boost::bind(&CAsyncValidationDispatcher::UpdatedTransaction, this, _1));
+    g_signals.EraseTransaction.disconnect(boost::bind(&CAsyncValidationDispatcher::EraseTransaction, this, _1));
+    g_signals.SyncTransaction.disconnect(boost::bind(&CAsyncValidationDispatcher::SyncTransaction, this, _1, _2));
+    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CAsyncValidationDispatcher::UpdatedBlockTip, this, _1, _2));
+}
+
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    if (pwalletIn->NotifyAsynchronously()) {
+        g_dispatcher.Add(pwalletIn);
+        return;
+    }
+    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
     g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
@@ -25,6 +309,10 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    if (pwalletIn->NotifyAsynchronously()) {
+        g_dispatcher.Remove(pwalletIn);
+        return;
+    }
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -33,10 +321,11 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_dispatcher.RemoveAll();
     g_signals.BlockChecked.disconnect_all_slots();
     g_signals.Broadcast.disconnect_all_slots();
     g_signals.Inventory.disconnect_all_slots();
@@ -51,3 +340,11 @@ void UnregisterAllValidationInterfaces() {
 void SyncWithWallets(const CTransaction &tx, const CBlock *pblock) {
     g_signals.SyncTransaction(tx, pblock);
 }
+
+void SyncWithValidationInterfaceQueue() {
+    g_dispatcher.Sync();
+}
+
+void LimitValidationInterfaceQueue() {
+    g_dispatcher.Limit();
+}
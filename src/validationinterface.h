@@ -8,8 +8,12 @@
 
 #include <boost/signals2/signal.hpp>
 
+#include <memory>
+#include <vector>
+
 #include "zcash/IncrementalMerkleTree.hpp"
 
+class CAsyncValidationDispatcher;
 class CBlock;
 class CBlockIndex;
 struct CBlockLocator;
@@ -18,6 +22,9 @@ class CValidationInterface;
 class CValidationState;
 class uint256;
 
+/** A block serialized for the network, shared by every listener that publishes it. */
+typedef std::shared_ptr<const std::vector<unsigned char> > CSerializedBlockRef;
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -29,25 +36,49 @@ void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
 
+/** Maximum number of notifications queued for asynchronous listeners before block processing waits for them */
+static const size_t MAX_VALIDATION_QUEUE_SIZE = 1000;
+
+/**
+ * Wait until every notification queued for asynchronous listeners has been
+ * delivered. Must not be called with cs_main held, as listeners may take it.
+ */
+void SyncWithValidationInterfaceQueue();
+/**
+ * Wait until the queue of notifications for asynchronous listeners is no
+ * longer than MAX_VALIDATION_QUEUE_SIZE, so that block processing can't run
+ * arbitrarily far ahead of them. Must not be called with cs_main held.
+ */
+void LimitValidationInterfaceQueue();
+
 class CValidationInterface {
 protected:
-    virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void UpdatedBlockTip(const CBlockIndex *pindex, const CSerializedBlockRef &block) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void EraseFromWallet(const uint256 &hash) {}
-    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added) {}
+    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree& tree, bool added) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
+    /**
+     * Whether to be notified in order on the validation queue's thread,
+     * outside of cs_main, rather than on the notifying thread. Blocks,
+     * transactions and trees are then shared snapshots that stay valid for
+     * the duration of the call. Listeners that must have seen a change
+     * before validation carries on, like the wallet, keep the default.
+     */
+    virtual bool NotifyAsynchronously() const { return false; }
+    friend class ::CAsyncValidationDispatcher;
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
 
 struct CMainSignals {
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of updated block chain tip, with the tip block serialized (NULL if it couldn't be read). */
+    boost::signals2::signal<void (const CBlockIndex *, const CSerializedBlockRef &)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an erased transaction (currently disabled, requires transaction replacement). */
@@ -55,7 +86,7 @@ struct CMainSignals {
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a change to the tip of the active block chain. */
-    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, ZCIncrementalMerkleTree, bool)> ChainTip;
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, const ZCIncrementalMerkleTree&, bool)> ChainTip;
     /** Notifies listeners of a new active block chain. */
     boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
     /** Notifies listeners about an inventory item being seen on the network. */
@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 170002;
+static const int PROTOCOL_VERSION = 170003;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -34,4 +34,7 @@ static const int BIP0031_VERSION = 60000;
 //! "mempool" command, enhanced "getdata" behavior starts with this version
 static const int MEMPOOL_GD_VERSION = 60002;
 
+//! compact block relay ("sendcmpct", "cmpctblock", "getblocktxn", "blocktxn") starts with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 170003;
+
 #endif // BITCOIN_VERSION_H
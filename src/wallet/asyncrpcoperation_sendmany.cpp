@@ -118,11 +118,13 @@ void AsyncRPCOperation_sendmany::main() {
     bool success = false;
 
 #ifdef ENABLE_MINING
+    if (pausemining) {
   #ifdef ENABLE_WALLET
-    GenerateBitcoins(false, NULL, 0);
+        GenerateBitcoins(false, NULL, 0);
   #else
-    GenerateBitcoins(false, 0);
+        GenerateBitcoins(false, 0);
   #endif
+    }
 #endif
 
     try {
@@ -147,17 +149,21 @@ void AsyncRPCOperation_sendmany::main() {
     }
 
 #ifdef ENABLE_MINING
+    if (pausemining) {
   #ifdef ENABLE_WALLET
-    GenerateBitcoins(GetBoolArg("-gen",false), pwalletMain, GetArg("-genproclimit", 1));
+        GenerateBitcoins(GetBoolArg("-gen",false), pwalletMain, GetArg("-genproclimit", 1));
   #else
-    GenerateBitcoins(GetBoolArg("-gen",false), GetArg("-genproclimit", 1));
+        GenerateBitcoins(GetBoolArg("-gen",false), GetArg("-genproclimit", 1));
   #endif
+    }
 #endif
 
     stop_execution_clock();
 
     if (success) {
         set_state(OperationStatus::SUCCESS);
+    } else if (isCancelRequested()) {
+        set_state(OperationStatus::CANCELLED);
     } else {
         set_state(OperationStatus::FAILED);
     }
@@ -795,12 +801,12 @@ void AsyncRPCOperation_sendmany::sign_send_raw_transaction(UniValue obj)
 
 
 bool AsyncRPCOperation_sendmany::find_utxos(bool fAcceptCoinbase=false) {
-    set<CBitcoinAddress> setAddress = {fromtaddr_};
+    set<CTxDestination> destinations = {fromtaddr_.Get()};
     vector<COutput> vecOutputs;
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    pwalletMain->AvailableCoins(vecOutputs, false, NULL, true, fAcceptCoinbase);
+    pwalletMain->AvailableCoinsForDestinations(vecOutputs, destinations, false, true, fAcceptCoinbase);
 
     BOOST_FOREACH(const COutput& out, vecOutputs) {
         if (!out.fSpendable) {
@@ -811,17 +817,6 @@ bool AsyncRPCOperation_sendmany::find_utxos(bool fAcceptCoinbase=false) {
             continue;
         }
 
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-                continue;
-            }
-
-            if (!setAddress.count(address)) {
-                continue;
-            }
-        }
-
         // By default we ignore coinbase outputs
         bool isCoinbase = out.tx->IsCoinBase();
         if (isCoinbase && fAcceptCoinbase==false) {
@@ -945,17 +940,30 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
             {info.vjsout[0], info.vjsout[1]};
     boost::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
     boost::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
-    JSDescription jsdesc = JSDescription::Randomized(
-            *pzcashParams,
-            joinSplitPubKey_,
-            anchor,
-            inputs,
-            outputs,
-            inputMap,
-            outputMap,
-            info.vpub_old,
-            info.vpub_new,
-            !this->testmode);
+
+    // Cancellation is checked between JoinSplits, as a proof cannot be interrupted.
+    if (isCancelRequested()) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Operation was cancelled");
+    }
+
+    JSDescription jsdesc;
+    std::chrono::time_point<std::chrono::system_clock> proving_start;
+    {
+        AsyncRPCProvingSlot slot(getPriority());
+        proving_start = std::chrono::system_clock::now();
+        jsdesc = JSDescription::Randomized(
+                *pzcashParams,
+                joinSplitPubKey_,
+                anchor,
+                inputs,
+                outputs,
+                inputMap,
+                outputMap,
+                info.vpub_old,
+                info.vpub_new,
+                !this->testmode);
+    }
+    add_proving_time(std::chrono::system_clock::now() - proving_start);
 
     {
         auto verifier = libzcash::ProofVerifier::Strict();
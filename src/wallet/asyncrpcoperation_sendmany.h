@@ -63,7 +63,12 @@ public:
 
     virtual UniValue getStatus() const;
 
+    std::string getFromAddress() const {
+        return fromaddress_;
+    }
+
     bool testmode = false;  // Set to true to disable sending txs and generating proofs
+    bool pausemining = true;  // Set to false if the caller already pauses mining, e.g. a batch
 
 private:
     friend class TEST_FRIEND_AsyncRPCOperation_sendmany;    // class for unit testing
@@ -0,0 +1,192 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "asyncrpcoperation_sendmanybatch.h"
+#include "asyncrpcqueue.h"
+#include "init.h"
+#include "miner.h"
+#include "rpcprotocol.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+AsyncRPCOperation_sendmanybatch::AsyncRPCOperation_sendmanybatch(
+        std::vector<std::shared_ptr<AsyncRPCOperation_sendmany>> operations,
+        UniValue contextInfo) :
+        operations_(operations), contextinfo_(contextInfo)
+{
+    if (operations.size() == 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No transactions");
+    }
+
+    // Group operations by from address, keeping the order they were given in
+    std::map<std::string, size_t> chainForAddress;
+    for (size_t i = 0; i < operations_.size(); i++) {
+        std::string fromAddress = operations_[i]->getFromAddress();
+        auto it = chainForAddress.find(fromAddress);
+        if (it == chainForAddress.end()) {
+            chainForAddress[fromAddress] = chains_.size();
+            chains_.push_back({i});
+        } else {
+            chains_[it->second].push_back(i);
+        }
+    }
+
+    LogPrint("zrpc", "%s: z_sendmanybatch initialized (transactions=%d, chains=%d)\n", getId(), operations_.size(), chains_.size());
+}
+
+AsyncRPCOperation_sendmanybatch::~AsyncRPCOperation_sendmanybatch() {
+}
+
+void AsyncRPCOperation_sendmanybatch::main() {
+    if (isCancelled())
+        return;
+
+    set_state(OperationStatus::EXECUTING);
+    start_execution_clock();
+
+    bool success = false;
+
+    // Mining is paused once for the whole batch, as the transactions are built concurrently
+#ifdef ENABLE_MINING
+  #ifdef ENABLE_WALLET
+    GenerateBitcoins(false, NULL, 0);
+  #else
+    GenerateBitcoins(false, 0);
+  #endif
+#endif
+
+    try {
+        success = main_impl();
+    } catch (const UniValue& objError) {
+        int code = find_value(objError, "code").get_int();
+        std::string message = find_value(objError, "message").get_str();
+        set_error_code(code);
+        set_error_message(message);
+    } catch (const runtime_error& e) {
+        set_error_code(-1);
+        set_error_message("runtime error: " + string(e.what()));
+    } catch (const exception& e) {
+        set_error_code(-1);
+        set_error_message("general exception: " + string(e.what()));
+    } catch (...) {
+        set_error_code(-2);
+        set_error_message("unknown error");
+    }
+
+#ifdef ENABLE_MINING
+  #ifdef ENABLE_WALLET
+    GenerateBitcoins(GetBoolArg("-gen",false), pwalletMain, GetArg("-genproclimit", 1));
+  #else
+    GenerateBitcoins(GetBoolArg("-gen",false), GetArg("-genproclimit", 1));
+  #endif
+#endif
+
+    stop_execution_clock();
+
+    if (success) {
+        set_state(OperationStatus::SUCCESS);
+    } else if (isCancelRequested()) {
+        set_state(OperationStatus::CANCELLED);
+    } else {
+        set_state(OperationStatus::FAILED);
+    }
+
+    LogPrintf("%s: z_sendmanybatch finished (status=%s)\n", getId(), getStateAsString());
+}
+
+/**
+ * Worker loop: take the next chain of operations and run it to completion.
+ */
+void AsyncRPCOperation_sendmanybatch::run_chains(std::atomic<size_t>& nextChain) {
+    while (true) {
+        size_t chain = nextChain++;
+        if (chain >= chains_.size()) {
+            break;
+        }
+        for (size_t i : chains_[chain]) {
+            std::shared_ptr<AsyncRPCOperation_sendmany> operation = operations_[i];
+            if (isCancelRequested()) {
+                operation->cancel();
+            }
+            if (!operation->isCancelled()) {
+                operation->main();
+            }
+        }
+    }
+}
+
+bool AsyncRPCOperation_sendmanybatch::main_impl() {
+    for (auto& operation : operations_) {
+        operation->setPriority(getPriority());
+        operation->pausemining = false;
+    }
+
+    // Run as many chains at once as there are proving slots; the slots
+    // themselves bound the proofs generated across all operations.
+    size_t nThreads = AsyncRPCQueue::sharedInstance()->getMaxProvingOperations();
+    if (nThreads == 0) {
+        nThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    nThreads = std::min(nThreads, chains_.size());
+
+    std::atomic<size_t> nextChain(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nThreads; i++) {
+        threads.emplace_back(&AsyncRPCOperation_sendmanybatch::run_chains, this, std::ref(nextChain));
+    }
+    run_chains(nextChain);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    UniValue txids(UniValue::VARR);
+    size_t nFailed = 0;
+    for (auto& operation : operations_) {
+        if (operation->isSuccess()) {
+            txids.push_back(find_value(operation->getResult(), "txid"));
+        } else {
+            nFailed++;
+        }
+    }
+
+    if (isCancelRequested()) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Operation was cancelled");
+    }
+
+    if (nFailed > 0) {
+        throw JSONRPCError(RPC_WALLET_ERROR, strprintf("%d of %d transactions failed, see the status of each transaction",
+                nFailed, operations_.size()));
+    }
+
+    UniValue o(UniValue::VOBJ);
+    o.push_back(Pair("txids", txids));
+    set_result(o);
+    return true;
+}
+
+/**
+ * Override getStatus() to append the input parameters and the status of every
+ * transaction to the default status object.
+ */
+UniValue AsyncRPCOperation_sendmanybatch::getStatus() const {
+    UniValue v = AsyncRPCOperation::getStatus();
+
+    UniValue obj = v.get_obj();
+    obj.push_back(Pair("method", "z_sendmanybatch"));
+    if (!contextinfo_.isNull()) {
+        obj.push_back(Pair("params", contextinfo_));
+    }
+
+    UniValue transactions(UniValue::VARR);
+    for (auto& operation : operations_) {
+        transactions.push_back(operation->getStatus());
+    }
+    obj.push_back(Pair("transactions", transactions));
+    return obj;
+}
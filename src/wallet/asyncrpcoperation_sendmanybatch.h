@@ -0,0 +1,58 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ASYNCRPCOPERATION_SENDMANYBATCH_H
+#define ASYNCRPCOPERATION_SENDMANYBATCH_H
+
+#include "asyncrpcoperation.h"
+#include "asyncrpcoperation_sendmany.h"
+
+#include <memory>
+#include <vector>
+
+#include <univalue.h>
+
+/**
+ * Runs a batch of z_sendmany transactions as a single operation.
+ *
+ * z_sendmanybatch merges the payment groups of each from address into as few
+ * transactions as the size limit allows, so they share one JoinSplit chain.
+ * Each transaction is an AsyncRPCOperation_sendmany.  Transactions spending
+ * from different addresses share no inputs, so their JoinSplit chains are
+ * built in parallel and their proofs are scheduled through the proving slots
+ * of the shared AsyncRPCQueue.  Transactions spending from the same address
+ * run one after the other, so that they never select the same notes or UTXOs.
+ */
+class AsyncRPCOperation_sendmanybatch : public AsyncRPCOperation {
+public:
+    AsyncRPCOperation_sendmanybatch(std::vector<std::shared_ptr<AsyncRPCOperation_sendmany>> operations, UniValue contextInfo = NullUniValue);
+    virtual ~AsyncRPCOperation_sendmanybatch();
+
+    // We don't want to be copied or moved around
+    AsyncRPCOperation_sendmanybatch(AsyncRPCOperation_sendmanybatch const&) = delete;             // Copy construct
+    AsyncRPCOperation_sendmanybatch(AsyncRPCOperation_sendmanybatch&&) = delete;                  // Move construct
+    AsyncRPCOperation_sendmanybatch& operator=(AsyncRPCOperation_sendmanybatch const&) = delete;  // Copy assign
+    AsyncRPCOperation_sendmanybatch& operator=(AsyncRPCOperation_sendmanybatch &&) = delete;      // Move assign
+
+    virtual void main();
+
+    virtual UniValue getStatus() const;
+
+    size_t getNumberOfChains() const {
+        return chains_.size();
+    }
+
+private:
+    UniValue contextinfo_;     // optional data to include in return value from getStatus()
+
+    std::vector<std::shared_ptr<AsyncRPCOperation_sendmany>> operations_;
+
+    // Indexes into operations_, one chain per from address, run in order
+    std::vector<std::vector<size_t>> chains_;
+
+    bool main_impl();
+    void run_chains(std::atomic<size_t>& nextChain);
+};
+
+#endif /* ASYNCRPCOPERATION_SENDMANYBATCH_H */
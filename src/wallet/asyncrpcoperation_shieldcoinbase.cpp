@@ -137,6 +137,8 @@ void AsyncRPCOperation_shieldcoinbase::main() {
 
     if (success) {
         set_state(OperationStatus::SUCCESS);
+    } else if (isCancelRequested()) {
+        set_state(OperationStatus::CANCELLED);
     } else {
         set_state(OperationStatus::FAILED);
     }
@@ -319,17 +321,30 @@ UniValue AsyncRPCOperation_shieldcoinbase::perform_joinsplit(ShieldCoinbaseJSInf
             {info.vjsout[0], info.vjsout[1]};
     boost::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
     boost::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
-    JSDescription jsdesc = JSDescription::Randomized(
-            *pzcashParams,
-            joinSplitPubKey_,
-            anchor,
-            inputs,
-            outputs,
-            inputMap,
-            outputMap,
-            info.vpub_old,
-            info.vpub_new,
-            !this->testmode);
+
+    // Cancellation is checked between JoinSplits, as a proof cannot be interrupted.
+    if (isCancelRequested()) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Operation was cancelled");
+    }
+
+    JSDescription jsdesc;
+    std::chrono::time_point<std::chrono::system_clock> proving_start;
+    {
+        AsyncRPCProvingSlot slot(getPriority());
+        proving_start = std::chrono::system_clock::now();
+        jsdesc = JSDescription::Randomized(
+                *pzcashParams,
+                joinSplitPubKey_,
+                anchor,
+                inputs,
+                outputs,
+                inputMap,
+                outputMap,
+                info.vpub_old,
+                info.vpub_new,
+                !this->testmode);
+    }
+    add_proving_time(std::chrono::system_clock::now() - proving_start);
 
     {
         auto verifier = libzcash::ProofVerifier::Strict();
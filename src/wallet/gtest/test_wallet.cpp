@@ -30,6 +30,7 @@ public:
     MOCK_METHOD0(TxnAbort, bool());
 
     MOCK_METHOD2(WriteTx, bool(uint256 hash, const CWalletTx& wtx));
+    MOCK_METHOD2(WriteNoteWitnesses, bool(const JSOutPoint& jsop, const CNoteData& nd));
     MOCK_METHOD1(WriteWitnessCacheSize, bool(int64_t nWitnessCacheSize));
     MOCK_METHOD1(WriteBestBlock, bool(const CBlockLocator& loc));
 };
@@ -293,6 +294,81 @@ TEST(wallet_tests, find_unspent_notes) {
     mapBlockIndex.erase(blockHash3);
 }
 
+TEST(wallet_tests, filtered_notes_address_index) {
+    CWallet wallet;
+    auto sk = libzcash::SpendingKey::random();
+    auto sk2 = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+    wallet.AddSpendingKey(sk2);
+
+    auto wtx = GetValidReceive(sk, 10, true);
+    auto note = GetNote(sk, wtx, 0, 1);
+    mapNoteData_t noteData;
+    JSOutPoint jsoutpt {wtx.GetHash(), 0, 1};
+    noteData[jsoutpt] = CNoteData {sk.address(), note.nullifier(sk)};
+    wtx.SetNoteData(noteData);
+    wallet.AddToWallet(wtx, true, NULL);
+
+    auto wtx2 = GetValidReceive(sk2, 20, true);
+    auto note2 = GetNote(sk2, wtx2, 0, 1);
+    mapNoteData_t noteData2;
+    JSOutPoint jsoutpt2 {wtx2.GetHash(), 0, 1};
+    noteData2[jsoutpt2] = CNoteData {sk2.address(), note2.nullifier(sk2)};
+    wtx2.SetNoteData(noteData2);
+    wallet.AddToWallet(wtx2, true, NULL);
+
+    EXPECT_EQ(2, wallet.mapAddressNotes.size());
+    EXPECT_EQ(1, wallet.mapAddressNotes[sk.address()].count(jsoutpt));
+    EXPECT_EQ(1, wallet.mapAddressNotes[sk2.address()].count(jsoutpt2));
+    EXPECT_EQ(0, wallet.mapNotePlaintexts.size());
+
+    // Filtering by address only returns that address's note, and caches it
+    std::vector<CNotePlaintextEntry> entries;
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk2.address()).ToString(), -1);
+    ASSERT_EQ(1, entries.size());
+    EXPECT_EQ(jsoutpt2, entries[0].jsop);
+    EXPECT_EQ(20, entries[0].plaintext.value);
+    EXPECT_EQ(1, wallet.mapNotePlaintexts.size());
+    entries.clear();
+
+    // Without a filter, both notes are returned and both are now cached
+    wallet.GetFilteredNotes(entries, "", -1);
+    EXPECT_EQ(2, entries.size());
+    EXPECT_EQ(2, wallet.mapNotePlaintexts.size());
+    entries.clear();
+
+    // Cached plaintexts are returned unchanged
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk.address()).ToString(), -1);
+    ASSERT_EQ(1, entries.size());
+    EXPECT_EQ(jsoutpt, entries[0].jsop);
+    EXPECT_EQ(10, entries[0].plaintext.value);
+}
+
+TEST(wallet_tests, balance_cache_cleared_on_wallet_changes) {
+    CWallet wallet;
+    auto sk = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+    auto key = std::make_pair(std::string(""), 1);
+
+    wallet.mapShieldedBalanceCache[key] = 5;
+    wallet.mapTransparentBalanceCache[key] = 5;
+
+    // Adding a transaction clears both caches
+    auto wtx = GetValidReceive(sk, 10, true);
+    wallet.AddToWallet(wtx, true, NULL);
+    EXPECT_EQ(0, wallet.mapShieldedBalanceCache.size());
+    EXPECT_EQ(0, wallet.mapTransparentBalanceCache.size());
+
+    // So does changing the set of locked coins
+    wallet.mapTransparentBalanceCache[key] = 5;
+    {
+        LOCK(wallet.cs_wallet);
+        COutPoint outpt(wtx.GetHash(), 0);
+        wallet.LockCoin(outpt);
+    }
+    EXPECT_EQ(0, wallet.mapTransparentBalanceCache.size());
+}
+
 
 TEST(wallet_tests, set_note_addrs_in_cwallettx) {
     auto sk = libzcash::SpendingKey::random();
@@ -867,6 +943,8 @@ TEST(wallet_tests, WriteWitnessCache) {
 
     auto wtx = GetValidReceive(sk, 10, true);
     wallet.AddToWallet(wtx, true, NULL);
+    // Only transactions changed since the last flush are written
+    wallet.setDirtyTxs.insert(wtx.GetHash());
 
     // TxnBegin fails
     EXPECT_CALL(walletdb, TxnBegin())
@@ -931,6 +1009,73 @@ TEST(wallet_tests, WriteWitnessCache) {
         .WillRepeatedly(Return(true));
 
     // Everything succeeds
+    EXPECT_EQ(1, wallet.setDirtyTxs.size());
+    wallet.SetBestChain(walletdb, loc);
+    EXPECT_EQ(0, wallet.setDirtyTxs.size());
+}
+
+TEST(wallet_tests, WriteOnlyChangedWitnesses) {
+    TestWallet wallet;
+    MockWalletDB walletdb;
+    CBlockLocator loc;
+
+    auto sk = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+
+    auto wtx = GetValidReceive(sk, 10, true);
+    auto note = GetNote(sk, wtx, 0, 1);
+    mapNoteData_t noteData;
+    JSOutPoint jsoutpt {wtx.GetHash(), 0, 1};
+    CNoteData nd {sk.address(), note.nullifier(sk)};
+    noteData[jsoutpt] = nd;
+    wtx.SetNoteData(noteData);
+    wallet.AddToWallet(wtx, true, NULL);
+
+    // A transaction loaded from disk has nothing to write
+    EXPECT_EQ(0, wallet.setDirtyTxs.size());
+    EXPECT_EQ(0, wallet.setDirtyWitnesses.size());
+
+    // Connecting a block changes the note's witness state
+    CBlock block;
+    block.vtx.push_back(wtx);
+    CBlockIndex index(block);
+    index.nHeight = 1;
+    ZCIncrementalMerkleTree tree;
+    wallet.IncrementNoteWitnesses(&index, &block, tree);
+    EXPECT_EQ(0, wallet.setDirtyTxs.size());
+    EXPECT_EQ(1, wallet.setDirtyWitnesses.size());
+    EXPECT_EQ(1, wallet.setDirtyWitnesses.count(jsoutpt));
+
+    // Only the witnesses are written, not the unchanged transaction
+    EXPECT_CALL(walletdb, TxnBegin())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(walletdb, WriteTx(testing::_, testing::_))
+        .Times(0);
+    EXPECT_CALL(walletdb, WriteWitnessCacheSize(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(walletdb, WriteBestBlock(loc))
+        .WillRepeatedly(Return(true));
+
+    // A failed write keeps the witnesses marked as changed
+    EXPECT_CALL(walletdb, WriteNoteWitnesses(jsoutpt, testing::_))
+        .WillOnce(Return(false));
+    EXPECT_CALL(walletdb, TxnAbort())
+        .Times(1);
+    wallet.SetBestChain(walletdb, loc);
+    EXPECT_EQ(1, wallet.setDirtyWitnesses.size());
+
+    EXPECT_CALL(walletdb, WriteNoteWitnesses(jsoutpt, testing::_))
+        .WillOnce(Return(true));
+    EXPECT_CALL(walletdb, TxnCommit())
+        .WillOnce(Return(true));
+    wallet.SetBestChain(walletdb, loc);
+    EXPECT_EQ(0, wallet.setDirtyWitnesses.size());
+
+    // Nothing changed since, so the next flush writes neither
+    EXPECT_CALL(walletdb, WriteNoteWitnesses(testing::_, testing::_))
+        .Times(0);
+    EXPECT_CALL(walletdb, TxnCommit())
+        .WillOnce(Return(true));
     wallet.SetBestChain(walletdb, loc);
 }
 
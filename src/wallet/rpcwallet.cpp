@@ -24,6 +24,7 @@
 #include "asyncrpcoperation.h"
 #include "asyncrpcqueue.h"
 #include "wallet/asyncrpcoperation_sendmany.h"
+#include "wallet/asyncrpcoperation_sendmanybatch.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 
 #include "sodium.h"
@@ -2520,6 +2521,28 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "Runs a benchmark of the selected type samplecount times,\n"
             "returning the running times of each sample.\n"
             "\n"
+            "For the \"parameterloading\" benchmark each sample also reports\n"
+            "\"timetofirstproof\" (loading plus one JoinSplit proof, in seconds),\n"
+            "\"residentbytes\" (growth of the process resident set while loading) and\n"
+            "\"residentbytesafterproof\" (its growth by the end of the first proof).\n"
+            "\n"
+            "The \"flushwallet\" benchmark times writing the wallet state for the\n"
+            "current tip. Pass true as a third argument to write every transaction\n"
+            "and note witness cache in the wallet rather than only the changed ones.\n"
+            "\n"
+            "The \"sha256\" benchmark hashes a buffer of the size in bytes given as a\n"
+            "third argument (default 1 MB), and the \"sha256d64\" benchmark computes the\n"
+            "double-SHA256 of the given number of 64-byte blocks (default 4096), using the\n"
+            "implementation selected at startup.\n"
+            "\n"
+            "The \"verifyequihashreference\" benchmark verifies the genesis block's\n"
+            "Equihash solution with the original verifier, for comparison with\n"
+            "\"verifyequihash\".\n"
+            "\n"
+            "The \"merkleappend\", \"merkleroot\" and \"witnessupdate\" benchmarks\n"
+            "append the given number of commitments (default 1000) to a note\n"
+            "commitment tree; the latter two also compute the tree and witness roots.\n"
+            "\n"
             "Output: [\n"
             "  {\n"
             "    \"runningtime\": runningtime\n"
@@ -2542,6 +2565,7 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
     }
 
     std::vector<double> sample_times;
+    std::vector<UniValue> sample_details;
 
     if (benchmarktype == "createjoinsplit") {
         /* Load the proving now key so that it doesn't happen as part of the
@@ -2560,7 +2584,13 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
         if (benchmarktype == "sleep") {
             sample_times.push_back(benchmark_sleep());
         } else if (benchmarktype == "parameterloading") {
-            sample_times.push_back(benchmark_parameter_loading());
+            ParameterLoadingStats stats = benchmark_parameter_loading();
+            sample_times.push_back(stats.loadTime);
+            UniValue details(UniValue::VOBJ);
+            details.push_back(Pair("timetofirstproof", stats.firstProofTime));
+            details.push_back(Pair("residentbytes", (uint64_t)stats.residentBytes));
+            details.push_back(Pair("residentbytesafterproof", (uint64_t)stats.residentBytesAfterProof));
+            sample_details.push_back(details);
         } else if (benchmarktype == "createjoinsplit") {
             if (params.size() < 3) {
                 sample_times.push_back(benchmark_create_joinsplit());
@@ -2585,6 +2615,8 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
 #endif
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "verifyequihashreference") {
+            sample_times.push_back(benchmark_verify_equihash_reference());
         } else if (benchmarktype == "validatelargetx") {
             sample_times.push_back(benchmark_large_tx());
         } else if (benchmarktype == "trydecryptnotes") {
@@ -2593,6 +2625,9 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
             sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
+        } else if (benchmarktype == "flushwallet") {
+            bool fAllDirty = params.size() > 2 && params[2].get_bool();
+            sample_times.push_back(benchmark_flush_wallet(fAllDirty));
         } else if (benchmarktype == "connectblockslow") {
             if (Params().NetworkIDString() != "regtest") {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
@@ -2611,15 +2646,44 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
             sample_times.push_back(benchmark_listunspent());
+        } else if (benchmarktype == "sha256") {
+            int nBytes = params.size() > 2 ? params[2].get_int() : 1000000;
+            if (nBytes < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid size");
+            }
+            sample_times.push_back(benchmark_sha256(nBytes));
+        } else if (benchmarktype == "merkleappend" ||
+                   benchmarktype == "merkleroot" ||
+                   benchmarktype == "witnessupdate") {
+            int nLeaves = params.size() > 2 ? params[2].get_int() : 1000;
+            if (nLeaves < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of commitments");
+            }
+            if (benchmarktype == "merkleappend") {
+                sample_times.push_back(benchmark_merkle_append(nLeaves));
+            } else if (benchmarktype == "merkleroot") {
+                sample_times.push_back(benchmark_merkle_root(nLeaves));
+            } else {
+                sample_times.push_back(benchmark_witness_update(nLeaves));
+            }
+        } else if (benchmarktype == "sha256d64") {
+            int nBlocks = params.size() > 2 ? params[2].get_int() : 4096;
+            if (nBlocks < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of blocks");
+            }
+            sample_times.push_back(benchmark_sha256d64(nBlocks));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
     }
 
     UniValue results(UniValue::VARR);
-    for (auto time : sample_times) {
+    for (size_t i = 0; i < sample_times.size(); i++) {
         UniValue result(UniValue::VOBJ);
-        result.push_back(Pair("runningtime", time));
+        result.push_back(Pair("runningtime", sample_times[i]));
+        if (i < sample_details.size()) {
+            result.pushKVs(sample_details[i]);
+        }
         results.push_back(result);
     }
 
@@ -2991,7 +3055,7 @@ UniValue z_listaddresses(const UniValue& params, bool fHelp)
 }
 
 CAmount getBalanceTaddr(std::string transparentAddress, int minDepth=1) {
-    set<CBitcoinAddress> setAddress;
+    set<CTxDestination> destinations;
     vector<COutput> vecOutputs;
     CAmount balance = 0;
 
@@ -3000,32 +3064,33 @@ CAmount getBalanceTaddr(std::string transparentAddress, int minDepth=1) {
         if (!taddr.IsValid()) {
             throw std::runtime_error("invalid transparent address");
         }
-        setAddress.insert(taddr);
+        destinations.insert(taddr.Get());
     }
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
+    auto key = std::make_pair(transparentAddress, minDepth);
+    auto it = pwalletMain->mapTransparentBalanceCache.find(key);
+    if (it != pwalletMain->mapTransparentBalanceCache.end()) {
+        return it->second;
+    }
+
+    if (destinations.size()) {
+        pwalletMain->AvailableCoinsForDestinations(vecOutputs, destinations, false, true);
+    } else {
+        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
+    }
 
     BOOST_FOREACH(const COutput& out, vecOutputs) {
         if (out.nDepth < minDepth) {
             continue;
         }
 
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-                continue;
-            }
-
-            if (!setAddress.count(address)) {
-                continue;
-            }
-        }
-
         CAmount nValue = out.tx->vout[out.i].nValue;
         balance += nValue;
     }
+
+    pwalletMain->mapTransparentBalanceCache[key] = balance;
     return balance;
 }
 
@@ -3033,10 +3098,19 @@ CAmount getBalanceZaddr(std::string address, int minDepth = 1) {
     CAmount balance = 0;
     std::vector<CNotePlaintextEntry> entries;
     LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    auto key = std::make_pair(address, minDepth);
+    auto it = pwalletMain->mapShieldedBalanceCache.find(key);
+    if (it != pwalletMain->mapShieldedBalanceCache.end()) {
+        return it->second;
+    }
+
     pwalletMain->GetFilteredNotes(entries, address, minDepth);
     for (auto & entry : entries) {
         balance += CAmount(entry.plaintext.value);
     }
+
+    pwalletMain->mapShieldedBalanceCache[key] = balance;
     return balance;
 }
 
@@ -3322,38 +3396,59 @@ UniValue z_getoperationstatus_IMPL(const UniValue& params, bool fRemoveFinishedO
 #define CTXIN_SPEND_DUST_SIZE   148
 #define CTXOUT_REGULAR_SIZE     34
 
-UniValue z_sendmany(const UniValue& params, bool fHelp)
+// Parse the optional priority argument of asynchronous operations.
+static OperationPriority ParseOperationPriority(const UniValue& value)
 {
-    if (!EnsureWalletIsAvailable(fHelp))
-        return NullUniValue;
+    std::string s = value.get_str();
+    if (s == "low") {
+        return OperationPriority::LOW;
+    } else if (s == "normal") {
+        return OperationPriority::NORMAL;
+    } else if (s == "high") {
+        return OperationPriority::HIGH;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, priority must be \"low\", \"normal\" or \"high\"");
+}
 
-    if (fHelp || params.size() < 2 || params.size() > 4)
-        throw runtime_error(
-            "z_sendmany \"fromaddress\" [{\"address\":... ,\"amount\":...},...] ( minconf ) ( fee )\n"
-            "\nSend multiple times. Amounts are double-precision floating point numbers."
-            "\nChange from a taddr flows to a new taddr address, while change from zaddr returns to itself."
-            "\nWhen sending coinbase UTXOs to a zaddr, change is not allowed. The entire value of the UTXO(s) must be consumed."
-            + strprintf("\nCurrently, the maximum number of zaddr outputs is %d due to transaction size limits.\n", Z_SENDMANY_MAX_ZADDR_OUTPUTS)
-            + HelpRequiringPassphrase() + "\n"
-            "\nArguments:\n"
-            "1. \"fromaddress\"         (string, required) The taddr or zaddr to send the funds from.\n"
-            "2. \"amounts\"             (array, required) An array of json objects representing the amounts to send.\n"
-            "    [{\n"
-            "      \"address\":address  (string, required) The address is a taddr or zaddr\n"
-            "      \"amount\":amount    (numeric, required) The numeric amount in " + CURRENCY_UNIT + " is the value\n"
-            "      \"memo\":memo        (string, optional) If the address is a zaddr, raw data represented in hexadecimal string format\n"
-            "    }, ... ]\n"
-            "3. minconf               (numeric, optional, default=1) Only use funds confirmed at least this many times.\n"
-            "4. fee                   (numeric, optional, default="
-            + strprintf("%s", FormatMoney(ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE)) + ") The fee amount to attach to this transaction.\n"
-            "\nResult:\n"
-            "\"operationid\"          (string) An operationid to pass to z_getoperationstatus to get the result of the operation.\n"
-        );
+/**
+ * Estimate the size of a z_sendmany transaction, assuming one JoinSplit per
+ * zaddr output. Depending on the input notes, the actual tx size may turn out
+ * to be larger.
+ */
+static size_t EstimateSendManyTxSize(bool fromTaddr, size_t nTaddrOutputs, size_t nZaddrOutputs)
+{
+    size_t txsize = 0;
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    for (size_t i = 0; i < nZaddrOutputs; i++) {
+        mtx.vjoinsplit.push_back(JSDescription());
+    }
+    CTransaction tx(mtx);
+    txsize += tx.GetSerializeSize(SER_NETWORK, tx.nVersion);
+    if (fromTaddr) {
+        txsize += CTXIN_SPEND_DUST_SIZE;
+        txsize += CTXOUT_REGULAR_SIZE;      // There will probably be taddr change
+    }
+    txsize += CTXOUT_REGULAR_SIZE * nTaddrOutputs;
+    return txsize;
+}
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+/**
+ * Validate the from address and the amounts array of a z_sendmany payment,
+ * splitting the recipients into taddr and zaddr outputs.
+ */
+static void ParseSendManyPayment(
+        const UniValue& fromValue,
+        const UniValue& amounts,
+        std::string& fromaddress,
+        std::vector<SendManyRecipient>& taddrRecipients,
+        std::vector<SendManyRecipient>& zaddrRecipients,
+        CAmount& nTotalOut)
+{
+    AssertLockHeld(pwalletMain->cs_wallet);
 
     // Check that the from address is valid.
-    auto fromaddress = params[0].get_str();
+    fromaddress = fromValue.get_str();
     bool fromTaddr = false;
     CBitcoinAddress taddr(fromaddress);
     fromTaddr = taddr.IsValid();
@@ -3375,7 +3470,7 @@ UniValue z_sendmany(const UniValue& params, bool fHelp)
         }
     }
 
-    UniValue outputs = params[1].get_array();
+    UniValue outputs = amounts.get_array();
 
     if (outputs.size()==0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, amounts array is empty.");
@@ -3383,10 +3478,9 @@ UniValue z_sendmany(const UniValue& params, bool fHelp)
     // Keep track of addresses to spot duplicates
     set<std::string> setAddress;
 
-    // Recipients
-    std::vector<SendManyRecipient> taddrRecipients;
-    std::vector<SendManyRecipient> zaddrRecipients;
-    CAmount nTotalOut = 0;
+    taddrRecipients.clear();
+    zaddrRecipients.clear();
+    nTotalOut = 0;
 
     for (const UniValue& o : outputs.getValues()) {
         if (!o.isObject())
@@ -3451,22 +3545,49 @@ UniValue z_sendmany(const UniValue& params, bool fHelp)
 
     // As a sanity check, estimate and verify that the size of the transaction will be valid.
     // Depending on the input notes, the actual tx size may turn out to be larger and perhaps invalid.
-    size_t txsize = 0;
-    CMutableTransaction mtx;
-    mtx.nVersion = 2;
-    for (int i = 0; i < zaddrRecipients.size(); i++) {
-        mtx.vjoinsplit.push_back(JSDescription());
-    }
-    CTransaction tx(mtx);
-    txsize += tx.GetSerializeSize(SER_NETWORK, tx.nVersion);
-    if (fromTaddr) {
-        txsize += CTXIN_SPEND_DUST_SIZE;
-        txsize += CTXOUT_REGULAR_SIZE;      // There will probably be taddr change
-    }
-    txsize += CTXOUT_REGULAR_SIZE * taddrRecipients.size();
+    size_t txsize = EstimateSendManyTxSize(fromTaddr, taddrRecipients.size(), zaddrRecipients.size());
     if (txsize > MAX_TX_SIZE) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many outputs, size of raw transaction would be larger than limit of %d bytes", MAX_TX_SIZE ));
     }
+}
+
+UniValue z_sendmany(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 2 || params.size() > 5)
+        throw runtime_error(
+            "z_sendmany \"fromaddress\" [{\"address\":... ,\"amount\":...},...] ( minconf ) ( fee ) ( \"priority\" )\n"
+            "\nSend multiple times. Amounts are double-precision floating point numbers."
+            "\nChange from a taddr flows to a new taddr address, while change from zaddr returns to itself."
+            "\nWhen sending coinbase UTXOs to a zaddr, change is not allowed. The entire value of the UTXO(s) must be consumed."
+            + strprintf("\nCurrently, the maximum number of zaddr outputs is %d due to transaction size limits.\n", Z_SENDMANY_MAX_ZADDR_OUTPUTS)
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. \"fromaddress\"         (string, required) The taddr or zaddr to send the funds from.\n"
+            "2. \"amounts\"             (array, required) An array of json objects representing the amounts to send.\n"
+            "    [{\n"
+            "      \"address\":address  (string, required) The address is a taddr or zaddr\n"
+            "      \"amount\":amount    (numeric, required) The numeric amount in " + CURRENCY_UNIT + " is the value\n"
+            "      \"memo\":memo        (string, optional) If the address is a zaddr, raw data represented in hexadecimal string format\n"
+            "    }, ... ]\n"
+            "3. minconf               (numeric, optional, default=1) Only use funds confirmed at least this many times.\n"
+            "4. fee                   (numeric, optional, default="
+            + strprintf("%s", FormatMoney(ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE)) + ") The fee amount to attach to this transaction.\n"
+            "5. \"priority\"            (string, optional, default=\"normal\") One of \"low\", \"normal\" or \"high\". Queued operations\n"
+            "                         of a higher priority are started, and given proving resources, first.\n"
+            "\nResult:\n"
+            "\"operationid\"          (string) An operationid to pass to z_getoperationstatus to get the result of the operation.\n"
+        );
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    std::string fromaddress;
+    std::vector<SendManyRecipient> taddrRecipients;
+    std::vector<SendManyRecipient> zaddrRecipients;
+    CAmount nTotalOut = 0;
+    ParseSendManyPayment(params[0], params[1], fromaddress, taddrRecipients, zaddrRecipients, nTotalOut);
 
     // Minimum confirmations
     int nMinDepth = 1;
@@ -3500,15 +3621,166 @@ UniValue z_sendmany(const UniValue& params, bool fHelp)
     o.push_back(Pair("fee", std::stod(FormatMoney(nFee))));
     UniValue contextInfo = o;
 
+    OperationPriority priority = OperationPriority::NORMAL;
+    if (params.size() > 4) {
+        priority = ParseOperationPriority(params[4]);
+    }
+
     // Create operation and add to global queue
     std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
     std::shared_ptr<AsyncRPCOperation> operation( new AsyncRPCOperation_sendmany(fromaddress, taddrRecipients, zaddrRecipients, nMinDepth, nFee, contextInfo) );
+    operation->setPriority(priority);
     q->addOperation(operation);
     AsyncRPCOperationId operationId = operation->getId();
     return operationId;
 }
 
 
+UniValue z_sendmanybatch(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error(
+            "z_sendmanybatch [{\"fromaddress\":... ,\"amounts\":[...]},...] ( minconf ) ( fee ) ( \"priority\" )\n"
+            "\nSend a batch of z_sendmany payments as one asynchronous operation."
+            "\nGroups spending from the same address are merged into one transaction, sharing its JoinSplits and"
+            "\nits fee, as far as the transaction size limit allows. Transactions spending from different addresses"
+            "\nare built in parallel, sharing the node's proving resources; those spending from the same address"
+            "\nare built in the order given so they never select the same funds.\n"
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. \"groups\"              (array, required) An array of json objects, one per payment group.\n"
+            "    [{\n"
+            "      \"fromaddress\":address   (string, required) The taddr or zaddr to send the funds from.\n"
+            "      \"amounts\":[...]         (array, required) The amounts to send, as for z_sendmany.\n"
+            "    }, ... ]\n"
+            "2. minconf               (numeric, optional, default=1) Only use funds confirmed at least this many times.\n"
+            "3. fee                   (numeric, optional, default="
+            + strprintf("%s", FormatMoney(ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE)) + ") The fee amount to attach to each transaction.\n"
+            "4. \"priority\"            (string, optional, default=\"normal\") One of \"low\", \"normal\" or \"high\".\n"
+            "\nResult:\n"
+            "\"operationid\"          (string) An operationid to pass to z_getoperationstatus to get the result of the operation.\n"
+            "                         On success the result holds the txids of all transactions; the status lists each one.\n"
+        );
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    UniValue groups = params[0].get_array();
+    if (groups.size() == 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, groups array is empty.");
+    }
+
+    // Minimum confirmations
+    int nMinDepth = 1;
+    if (params.size() > 1) {
+        nMinDepth = params[1].get_int();
+    }
+    if (nMinDepth < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Minimum number of confirmations cannot be less than 0");
+    }
+
+    // Fee in Zatoshis, not currency format)
+    CAmount nFee = ASYNC_RPC_OPERATION_DEFAULT_MINERS_FEE;
+    if (params.size() > 2) {
+        if (params[2].get_real() == 0.0) {
+            nFee = 0;
+        } else {
+            nFee = AmountFromValue( params[2] );
+        }
+    }
+
+    OperationPriority priority = OperationPriority::NORMAL;
+    if (params.size() > 3) {
+        priority = ParseOperationPriority(params[3]);
+    }
+
+    // A transaction being assembled from the payment groups of one from address
+    struct BatchTransaction {
+        std::string fromaddress;
+        bool fromTaddr;
+        std::vector<SendManyRecipient> taddrRecipients;
+        std::vector<SendManyRecipient> zaddrRecipients;
+        UniValue amounts;
+    };
+    std::vector<BatchTransaction> transactions;
+    std::map<std::string, size_t> mapOpenTransaction;
+
+    for (const UniValue& group : groups.getValues()) {
+        if (!group.isObject())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected object");
+
+        for (const string& name_ : group.getKeys()) {
+            if (name_ != "fromaddress" && name_ != "amounts")
+                throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, unknown key: ")+name_);
+        }
+
+        UniValue fromValue = find_value(group, "fromaddress");
+        UniValue amounts = find_value(group, "amounts");
+        std::string fromaddress;
+        std::vector<SendManyRecipient> taddrRecipients;
+        std::vector<SendManyRecipient> zaddrRecipients;
+        CAmount nTotalOut = 0;
+        ParseSendManyPayment(fromValue, amounts, fromaddress, taddrRecipients, zaddrRecipients, nTotalOut);
+
+        if (nFee > nTotalOut) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Fee %s is greater than the sum of outputs %s of a group from %s", FormatMoney(nFee), FormatMoney(nTotalOut), fromaddress));
+        }
+
+        // Add the group to the open transaction from the same address if it still fits
+        auto it = mapOpenTransaction.find(fromaddress);
+        if (it != mapOpenTransaction.end()) {
+            BatchTransaction& btx = transactions[it->second];
+            size_t nTaddrOutputs = btx.taddrRecipients.size() + taddrRecipients.size();
+            size_t nZaddrOutputs = btx.zaddrRecipients.size() + zaddrRecipients.size();
+            if (nZaddrOutputs <= Z_SENDMANY_MAX_ZADDR_OUTPUTS &&
+                EstimateSendManyTxSize(btx.fromTaddr, nTaddrOutputs, nZaddrOutputs) <= MAX_TX_SIZE) {
+                btx.taddrRecipients.insert(btx.taddrRecipients.end(), taddrRecipients.begin(), taddrRecipients.end());
+                btx.zaddrRecipients.insert(btx.zaddrRecipients.end(), zaddrRecipients.begin(), zaddrRecipients.end());
+                for (const UniValue& amount : amounts.getValues()) {
+                    btx.amounts.push_back(amount);
+                }
+                continue;
+            }
+        }
+
+        BatchTransaction btx;
+        btx.fromaddress = fromaddress;
+        btx.fromTaddr = CBitcoinAddress(fromaddress).IsValid();
+        btx.taddrRecipients = taddrRecipients;
+        btx.zaddrRecipients = zaddrRecipients;
+        btx.amounts = amounts;
+        mapOpenTransaction[fromaddress] = transactions.size();
+        transactions.push_back(btx);
+    }
+
+    std::vector<std::shared_ptr<AsyncRPCOperation_sendmany>> operations;
+    for (const BatchTransaction& btx : transactions) {
+        UniValue o(UniValue::VOBJ);
+        o.push_back(Pair("fromaddress", btx.fromaddress));
+        o.push_back(Pair("amounts", btx.amounts));
+        o.push_back(Pair("minconf", nMinDepth));
+        o.push_back(Pair("fee", std::stod(FormatMoney(nFee))));
+
+        operations.push_back(std::shared_ptr<AsyncRPCOperation_sendmany>( new AsyncRPCOperation_sendmany(btx.fromaddress, btx.taddrRecipients, btx.zaddrRecipients, nMinDepth, nFee, o) ));
+    }
+
+    UniValue contextInfo(UniValue::VOBJ);
+    contextInfo.push_back(Pair("groups", (uint64_t)groups.size()));
+    contextInfo.push_back(Pair("transactions", (uint64_t)operations.size()));
+    contextInfo.push_back(Pair("minconf", nMinDepth));
+    contextInfo.push_back(Pair("fee", std::stod(FormatMoney(nFee))));
+
+    // Create operation and add to global queue
+    std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
+    std::shared_ptr<AsyncRPCOperation> operation( new AsyncRPCOperation_sendmanybatch(operations, contextInfo) );
+    operation->setPriority(priority);
+    q->addOperation(operation);
+    AsyncRPCOperationId operationId = operation->getId();
+    return operationId;
+}
+
 /**
 When estimating the number of coinbase utxos we can shield in a single transaction:
 1. Joinsplit description is 1802 bytes.
@@ -3533,9 +3805,9 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
         strDisabledMsg = "\nWARNING: z_shieldcoinbase is DISABLED but can be enabled as an experimental feature.\n";
     }
 
-    if (fHelp || params.size() < 2 || params.size() > 3)
+    if (fHelp || params.size() < 2 || params.size() > 4)
         throw runtime_error(
-            "z_shieldcoinbase \"fromaddress\" \"tozaddress\" ( fee )\n"
+            "z_shieldcoinbase \"fromaddress\" \"tozaddress\" ( fee ) ( \"priority\" )\n"
             + strDisabledMsg +
             "\nShield transparent coinbase funds by sending to a shielded zaddr.  This is an asynchronous operation and utxos"
             "\nselected for shielding will be locked.  If there is an error, they are unlocked.  The RPC call `listlockunspent`"
@@ -3548,6 +3820,7 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
             "2. \"toaddress\"           (string, required) The address is a zaddr.\n"
             "3. fee                   (numeric, optional, default="
             + strprintf("%s", FormatMoney(SHIELD_COINBASE_DEFAULT_MINERS_FEE)) + ") The fee amount to attach to this transaction.\n"
+            "4. \"priority\"            (string, optional, default=\"normal\") One of \"low\", \"normal\" or \"high\".\n"
             "\nResult:\n"
             "{\n"
             "  \"operationid\": xxx          (string) An operationid to pass to z_getoperationstatus to get the result of the operation.\n"
@@ -3679,9 +3952,15 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
     contextInfo.push_back(Pair("toaddress", params[1]));
     contextInfo.push_back(Pair("fee", ValueFromAmount(nFee)));
 
+    OperationPriority priority = OperationPriority::NORMAL;
+    if (params.size() > 3) {
+        priority = ParseOperationPriority(params[3]);
+    }
+
     // Create operation and add to global queue
     std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
     std::shared_ptr<AsyncRPCOperation> operation( new AsyncRPCOperation_shieldcoinbase(inputs, destaddress, nFee, contextInfo) );
+    operation->setPriority(priority);
     q->addOperation(operation);
     AsyncRPCOperationId operationId = operation->getId();
 
@@ -368,10 +368,12 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 }
 
 void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
-                       ZCIncrementalMerkleTree tree, bool added)
+                       const ZCIncrementalMerkleTree& tree, bool added)
 {
     if (added) {
-        IncrementNoteWitnesses(pindex, pblock, tree);
+        // IncrementNoteWitnesses advances the tree it is given through the block
+        ZCIncrementalMerkleTree treeCopy(tree);
+        IncrementNoteWitnesses(pindex, pblock, treeCopy);
     } else {
         DecrementNoteWitnesses(pindex);
     }
@@ -631,6 +633,7 @@ void CWallet::ClearNoteWitnessCache()
         for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
+            setDirtyWitnesses.insert(item.first);
         }
     }
     nWitnessCacheSize = 0;
@@ -642,6 +645,8 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 {
     {
         LOCK(cs_wallet);
+        // Note and output depths change with the tip
+        ClearBalanceCache();
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
             for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
                 CNoteData* nd = &(item.second);
@@ -678,69 +683,89 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             pblock = &block;
         }
 
+        // Collect the block's note commitments, and our notes among them
+        // along with the number of commitments up to and including each.
+        std::vector<libzcash::SHA256Compress> commitments;
+        std::vector<std::pair<JSOutPoint, size_t>> ourNotes;
         for (const CTransaction& tx : pblock->vtx) {
             auto hash = tx.GetHash();
             bool txIsOurs = mapWallet.count(hash);
             for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
                 const JSDescription& jsdesc = tx.vjoinsplit[i];
                 for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
-                    const uint256& note_commitment = jsdesc.commitments[j];
-                    tree.append(note_commitment);
+                    commitments.push_back(jsdesc.commitments[j]);
 
-                    // Increment existing witnesses
-                    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                        for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                            CNoteData* nd = &(item.second);
-                            if (nd->witnessHeight < pindex->nHeight &&
-                                    nd->witnesses.size() > 0) {
-                                // Check the validity of the cache
-                                // See earlier comment about validity.
-                                assert(nWitnessCacheSize >= nd->witnesses.size());
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
-                    }
-
-                    // If this is our note, witness it
                     if (txIsOurs) {
                         JSOutPoint jsoutpt {hash, i, j};
                         if (mapWallet[hash].mapNoteData.count(jsoutpt) &&
                                 mapWallet[hash].mapNoteData[jsoutpt].witnessHeight < pindex->nHeight) {
-                            CNoteData* nd = &(mapWallet[hash].mapNoteData[jsoutpt]);
-                            if (nd->witnesses.size() > 0) {
-                                // We think this can happen because we write out the
-                                // witness cache state after every block increment or
-                                // decrement, but the block index itself is written in
-                                // batches. So if the node crashes in between these two
-                                // operations, it is possible for IncrementNoteWitnesses
-                                // to be called again on previously-cached blocks. This
-                                // doesn't affect existing cached notes because of the
-                                // CNoteData::witnessHeight checks. See #1378 for details.
-                                LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
-                                          jsoutpt.ToString(), nd->witnesses.size(),
-                                          nd->witnessHeight,
-                                          nd->witnesses.front().root().GetHex(),
-                                          pindex->nHeight,
-                                          tree.witness().root().GetHex());
-                                nd->witnesses.clear();
-                            }
-                            nd->witnesses.push_front(tree.witness());
-                            // Set height to one less than pindex so it gets incremented
-                            nd->witnessHeight = pindex->nHeight - 1;
-                            // Check the validity of the cache
-                            assert(nWitnessCacheSize >= nd->witnesses.size());
+                            ourNotes.push_back(std::make_pair(jsoutpt, commitments.size()));
                         }
                     }
                 }
             }
         }
 
+        // The subtrees the block's commitments complete are hashed once, and
+        // shared by every witness.
+        libzcash::MerkleSubtrees<INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::SHA256Compress> subtrees(
+            tree.size(), commitments.begin(), commitments.end());
+
+        // Increment existing witnesses
+        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
+            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
+                CNoteData* nd = &(item.second);
+                if (nd->witnessHeight < pindex->nHeight &&
+                        nd->witnesses.size() > 0) {
+                    // Check the validity of the cache
+                    // See earlier comment about validity.
+                    assert(nWitnessCacheSize >= nd->witnesses.size());
+                    nd->witnesses.front().append_batch(subtrees, subtrees.start());
+                }
+            }
+        }
+
+        // Witness our notes, and bring them up to the end of the block
+        size_t nAppended = 0;
+        for (const std::pair<JSOutPoint, size_t>& note : ourNotes) {
+            tree.append_batch(commitments.begin() + nAppended, commitments.begin() + note.second);
+            nAppended = note.second;
+
+            const JSOutPoint& jsoutpt = note.first;
+            CNoteData* nd = &(mapWallet[jsoutpt.hash].mapNoteData[jsoutpt]);
+            if (nd->witnesses.size() > 0) {
+                // We think this can happen because we write out the
+                // witness cache state after every block increment or
+                // decrement, but the block index itself is written in
+                // batches. So if the node crashes in between these two
+                // operations, it is possible for IncrementNoteWitnesses
+                // to be called again on previously-cached blocks. This
+                // doesn't affect existing cached notes because of the
+                // CNoteData::witnessHeight checks. See #1378 for details.
+                LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
+                          jsoutpt.ToString(), nd->witnesses.size(),
+                          nd->witnessHeight,
+                          nd->witnesses.front().root().GetHex(),
+                          pindex->nHeight,
+                          tree.witness().root().GetHex());
+                nd->witnesses.clear();
+            }
+            nd->witnesses.push_front(tree.witness());
+            nd->witnesses.front().append_batch(subtrees, subtrees.start() + nAppended);
+            // Set height to one less than pindex so it gets incremented
+            nd->witnessHeight = pindex->nHeight - 1;
+            // Check the validity of the cache
+            assert(nWitnessCacheSize >= nd->witnesses.size());
+        }
+        tree.append_batch(commitments.begin() + nAppended, commitments.end());
+
         // Update witness heights
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
             for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
                 CNoteData* nd = &(item.second);
                 if (nd->witnessHeight < pindex->nHeight) {
                     nd->witnessHeight = pindex->nHeight;
+                    setDirtyWitnesses.insert(item.first);
                     // Check the validity of the cache
                     // See earlier comment about validity.
                     assert(nWitnessCacheSize >= nd->witnesses.size());
@@ -758,6 +783,8 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     {
         LOCK(cs_wallet);
+        // Note and output depths change with the tip
+        ClearBalanceCache();
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
             for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
                 CNoteData* nd = &(item.second);
@@ -777,6 +804,7 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
                     // pindex is the block being removed, so the new witness cache
                     // height is one below it.
                     nd->witnessHeight = pindex->nHeight - 1;
+                    setDirtyWitnesses.insert(item.first);
                 }
             }
         }
@@ -942,6 +970,16 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        ClearBalanceCache();
+    }
+}
+
+void CWallet::ClearBalanceCache()
+{
+    {
+        LOCK(cs_wallet);
+        mapTransparentBalanceCache.clear();
+        mapShieldedBalanceCache.clear();
     }
 }
 
@@ -970,10 +1008,15 @@ bool CWallet::UpdateNullifierNoteMap()
                         dec,
                         hSig,
                         item.first.n);
+                    if (item.second.nullifier) {
+                        setDirtyTxs.insert(wtxItem.first);
+                    }
                 }
             }
             UpdateNullifierNoteMapWithTx(wtxItem.second);
         }
+        // Newly cached nullifiers may mark notes as spent
+        ClearBalanceCache();
     }
     return true;
 }
@@ -993,6 +1036,60 @@ void CWallet::UpdateNullifierNoteMapWithTx(const CWalletTx& wtx)
     }
 }
 
+/**
+ * Add the notes and transparent outputs of this tx to the selection indexes.
+ */
+void CWallet::UpdateAddressIndexWithTx(const CWalletTx& wtx)
+{
+    {
+        LOCK(cs_wallet);
+        for (const mapNoteData_t::value_type& item : wtx.mapNoteData) {
+            mapAddressNotes[item.second.address].insert(item.first);
+        }
+        uint256 hash = wtx.GetHash();
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            CTxDestination address;
+            if (ExtractDestination(wtx.vout[i].scriptPubKey, address)) {
+                mapAddressOutputs[address].insert(COutPoint(hash, i));
+            }
+        }
+    }
+}
+
+/**
+ * Remove the notes and transparent outputs of this tx from the selection
+ * indexes, along with any cached note plaintexts.
+ */
+void CWallet::EraseAddressIndexWithTx(const CWalletTx& wtx)
+{
+    {
+        LOCK(cs_wallet);
+        for (const mapNoteData_t::value_type& item : wtx.mapNoteData) {
+            auto it = mapAddressNotes.find(item.second.address);
+            if (it != mapAddressNotes.end()) {
+                it->second.erase(item.first);
+                if (it->second.empty()) {
+                    mapAddressNotes.erase(it);
+                }
+            }
+            mapNotePlaintexts.erase(item.first);
+        }
+        uint256 hash = wtx.GetHash();
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            CTxDestination address;
+            if (ExtractDestination(wtx.vout[i].scriptPubKey, address)) {
+                auto it = mapAddressOutputs.find(address);
+                if (it != mapAddressOutputs.end()) {
+                    it->second.erase(COutPoint(hash, i));
+                    if (it->second.empty()) {
+                        mapAddressOutputs.erase(it);
+                    }
+                }
+            }
+        }
+    }
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
 {
     uint256 hash = wtxIn.GetHash();
@@ -1002,7 +1099,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+        UpdateAddressIndexWithTx(mapWallet[hash]);
         AddToSpends(hash);
+        ClearBalanceCache();
     }
     else
     {
@@ -1091,6 +1190,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
             }
         }
 
+        UpdateAddressIndexWithTx(wtx);
+        ClearBalanceCache();
+
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -1206,8 +1308,19 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
-            CWalletDB(strWalletFile).EraseTx(hash);
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            CWalletDB walletdb(strWalletFile);
+            for (const mapNoteData_t::value_type& item : it->second.mapNoteData) {
+                walletdb.EraseNoteWitnesses(item.first);
+                setDirtyWitnesses.erase(item.first);
+            }
+            setDirtyTxs.erase(hash);
+            EraseAddressIndexWithTx(it->second);
+            mapWallet.erase(it);
+            ClearBalanceCache();
+            walletdb.EraseTx(hash);
+        }
     }
     return;
 }
@@ -2226,6 +2339,53 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
     }
 }
 
+/**
+ * populate vCoins with the available COutputs paying to any of destinations,
+ * looking them up in mapAddressOutputs rather than scanning mapWallet.
+ */
+void CWallet::AvailableCoinsForDestinations(vector<COutput>& vCoins, const std::set<CTxDestination>& destinations, bool fOnlyConfirmed, bool fIncludeZeroValue, bool fIncludeCoinBase) const
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        for (const CTxDestination& dest : destinations) {
+            auto itOutputs = mapAddressOutputs.find(dest);
+            if (itOutputs == mapAddressOutputs.end())
+                continue;
+
+            for (const COutPoint& outpoint : itOutputs->second) {
+                map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
+                if (it == mapWallet.end())
+                    continue;
+                const CWalletTx* pcoin = &(*it).second;
+
+                if (!CheckFinalTx(*pcoin))
+                    continue;
+
+                if (fOnlyConfirmed && !pcoin->IsTrusted())
+                    continue;
+
+                if (pcoin->IsCoinBase() && !fIncludeCoinBase)
+                    continue;
+
+                if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+                    continue;
+
+                int nDepth = pcoin->GetDepthInMainChain();
+                if (nDepth < 0)
+                    continue;
+
+                unsigned int i = outpoint.n;
+                isminetype mine = IsMine(pcoin->vout[i]);
+                if (!(IsSpent(outpoint.hash, i)) && mine != ISMINE_NO &&
+                    !IsLockedCoin(outpoint.hash, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue))
+                        vCoins.push_back(COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
+            }
+        }
+    }
+}
+
 static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
@@ -3343,18 +3503,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    ClearBalanceCache();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    ClearBalanceCache();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    ClearBalanceCache();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -3607,6 +3770,9 @@ bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree, bool fRejectAbsurdFee)
 /**
  * Find notes in the wallet filtered by payment address, min depth and ability to spend.
  * These notes are decrypted and added to the output parameter vector, outEntries.
+ *
+ * Notes are looked up through mapAddressNotes, and each note is decrypted at
+ * most once; later calls take the plaintext from mapNotePlaintexts.
  */
 void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, std::string address, int minDepth, bool ignoreSpent)
 {
@@ -3619,33 +3785,48 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
 
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
-
-        // Filter the transactions before checking for notes
-        if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < minDepth) {
-            continue;
+    // Only look at the notes of the filter address, if there is one
+    auto itBegin = mapAddressNotes.begin();
+    auto itEnd = mapAddressNotes.end();
+    if (fFilterAddress) {
+        itBegin = mapAddressNotes.find(filterPaymentAddress);
+        if (itBegin != itEnd) {
+            itEnd = std::next(itBegin);
         }
+    }
 
-        if (wtx.mapNoteData.size() == 0) {
-            continue;
-        }
+    for (auto itAddress = itBegin; itAddress != itEnd; ++itAddress) {
+        const PaymentAddress & pa = itAddress->first;
+
+        for (const JSOutPoint & jsop : itAddress->second) {
+            auto itTx = mapWallet.find(jsop.hash);
+            if (itTx == mapWallet.end()) {
+                continue;
+            }
+            const CWalletTx & wtx = itTx->second;
 
-        for (auto & pair : wtx.mapNoteData) {
-            JSOutPoint jsop = pair.first;
-            CNoteData nd = pair.second;
-            PaymentAddress pa = nd.address;
+            // Filter the transactions before checking for notes
+            if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < minDepth) {
+                continue;
+            }
 
-            // skip notes which belong to a different payment address in the wallet
-            if (fFilterAddress && !(pa == filterPaymentAddress)) {
+            auto itNote = wtx.mapNoteData.find(jsop);
+            if (itNote == wtx.mapNoteData.end()) {
                 continue;
             }
+            const CNoteData & nd = itNote->second;
 
             // skip note which has been spent
             if (ignoreSpent && nd.nullifier && IsSpent(*nd.nullifier)) {
                 continue;
             }
 
+            auto itPlaintext = mapNotePlaintexts.find(jsop);
+            if (itPlaintext != mapNotePlaintexts.end()) {
+                outEntries.push_back(CNotePlaintextEntry{jsop, itPlaintext->second});
+                continue;
+            }
+
             int i = jsop.js; // Index into CTransaction.vjoinsplit
             int j = jsop.n; // Index into JSDescription.ciphertexts
 
@@ -3666,6 +3847,7 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
                         hSig,
                         (unsigned char) j);
 
+                mapNotePlaintexts.insert(std::make_pair(jsop, plaintext));
                 outEntries.push_back(CNotePlaintextEntry{jsop, plaintext});
 
             } catch (const note_decryption_failed &err) {
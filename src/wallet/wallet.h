@@ -637,19 +637,38 @@ protected:
 
     template <typename WalletDB>
     void SetBestChainINTERNAL(WalletDB& walletdb, const CBlockLocator& loc) {
+        LOCK(cs_wallet);
         if (!walletdb.TxnBegin()) {
             // This needs to be done atomically, so don't do it at all
             LogPrintf("SetBestChain(): Couldn't start atomic write\n");
             return;
         }
         try {
-            for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                if (!walletdb.WriteTx(wtxItem.first, wtxItem.second)) {
+            // Only write what changed in memory since the last flush. The
+            // witness caches are written as separate notewitness records, so
+            // that the transactions they belong to need not be rewritten.
+            for (const uint256& hash : setDirtyTxs) {
+                auto it = mapWallet.find(hash);
+                if (it == mapWallet.end()) {
+                    continue;
+                }
+                if (!walletdb.WriteTx(it->first, it->second)) {
                     LogPrintf("SetBestChain(): Failed to write CWalletTx, aborting atomic write\n");
                     walletdb.TxnAbort();
                     return;
                 }
             }
+            for (const JSOutPoint& jsop : setDirtyWitnesses) {
+                auto it = mapWallet.find(jsop.hash);
+                if (it == mapWallet.end() || !it->second.mapNoteData.count(jsop)) {
+                    continue;
+                }
+                if (!walletdb.WriteNoteWitnesses(jsop, it->second.mapNoteData.at(jsop))) {
+                    LogPrintf("SetBestChain(): Failed to write note witnesses, aborting atomic write\n");
+                    walletdb.TxnAbort();
+                    return;
+                }
+            }
             if (!walletdb.WriteWitnessCacheSize(nWitnessCacheSize)) {
                 LogPrintf("SetBestChain(): Failed to write nWitnessCacheSize, aborting atomic write\n");
                 walletdb.TxnAbort();
@@ -672,6 +691,10 @@ protected:
             LogPrintf("SetBestChain(): Couldn't commit atomic write\n");
             return;
         }
+        LogPrint("db", "SetBestChain(): wrote %d transactions and %d note witness caches\n",
+                 setDirtyTxs.size(), setDirtyWitnesses.size());
+        setDirtyTxs.clear();
+        setDirtyWitnesses.clear();
     }
 
 private:
@@ -787,6 +810,49 @@ public:
      */
     std::map<uint256, JSOutPoint> mapNullifiersToNotes;
 
+    /**
+     * Selection indexes over mapWallet, so that spending from one address
+     * does not need to walk every wallet transaction.
+     *
+     * - mapAddressNotes holds every note in mapNoteData, by payment address.
+     * - mapAddressOutputs holds every transparent output of a wallet
+     *   transaction, by destination. Ownership is checked when the index is
+     *   read, so that outputs to keys imported later are still found.
+     *
+     * Entries are added as transactions are added to or updated in the
+     * wallet, and removed with the transaction. Spent state is not indexed:
+     * it changes with reorgs and conflicts, and is checked on each lookup.
+     */
+    std::map<libzcash::PaymentAddress, std::set<JSOutPoint>> mapAddressNotes;
+    std::map<CTxDestination, std::set<COutPoint>> mapAddressOutputs;
+
+    /**
+     * Cache of decrypted note plaintexts. Note ciphertexts never change for a
+     * given transaction, so an entry stays valid until the transaction is
+     * removed from the wallet.
+     */
+    std::map<JSOutPoint, libzcash::NotePlaintext> mapNotePlaintexts;
+
+    /**
+     * Cached balances of transparent and shielded addresses, by address and
+     * minimum depth. The empty address holds the total over the wallet.
+     *
+     * A balance depends on the wallet transactions, their spent state and
+     * depth, and the locked coins; the cache is cleared whenever any of these
+     * change (see ClearBalanceCache), so repeated queries between blocks do
+     * not need to look at any notes or outputs.
+     */
+    std::map<std::pair<std::string, int>, CAmount> mapTransparentBalanceCache;
+    std::map<std::pair<std::string, int>, CAmount> mapShieldedBalanceCache;
+
+    /**
+     * State changed in memory since the last SetBestChain, and not yet
+     * written to disk: transactions whose cached nullifiers were filled in,
+     * and notes whose witness cache was incremented, decremented or cleared.
+     */
+    std::set<uint256> setDirtyTxs;
+    std::set<JSOutPoint> setDirtyWitnesses;
+
     std::map<uint256, CWalletTx> mapWallet;
 
     int64_t nOrderPosNext;
@@ -806,6 +872,7 @@ public:
     bool CanSupportFeature(enum WalletFeature wf) { AssertLockHeld(cs_wallet); return nWalletMaxVersion >= wf; }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, bool fIncludeZeroValue=false, bool fIncludeCoinBase=true) const;
+    void AvailableCoinsForDestinations(std::vector<COutput>& vCoins, const std::set<CTxDestination>& destinations, bool fOnlyConfirmed=true, bool fIncludeZeroValue=false, bool fIncludeCoinBase=true) const;
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
@@ -892,8 +959,11 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    void ClearBalanceCache();
     bool UpdateNullifierNoteMap();
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
+    void UpdateAddressIndexWithTx(const CWalletTx& wtx);
+    void EraseAddressIndexWithTx(const CWalletTx& wtx);
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
@@ -959,7 +1029,7 @@ public:
     CAmount GetDebit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetCredit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetChange(const CTransaction& tx) const;
-    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree& tree, bool added);
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc);
 
@@ -58,7 +58,18 @@ bool CWalletDB::ErasePurpose(const string& strPurpose)
 bool CWalletDB::WriteTx(uint256 hash, const CWalletTx& wtx)
 {
     nWalletDBUpdated++;
-    return Write(std::make_pair(std::string("tx"), hash), wtx);
+    if (wtx.mapNoteData.empty()) {
+        return Write(std::make_pair(std::string("tx"), hash), wtx);
+    }
+    // The witness caches are kept in notewitness records. Leave them out of
+    // the transaction, so that a binary which doesn't know those records sees
+    // notes without witnesses, rather than witnesses that may be stale.
+    CWalletTx wtxCopy(wtx);
+    for (mapNoteData_t::value_type& item : wtxCopy.mapNoteData) {
+        item.second.witnesses.clear();
+        item.second.witnessHeight = -1;
+    }
+    return Write(std::make_pair(std::string("tx"), hash), wtxCopy);
 }
 
 bool CWalletDB::EraseTx(uint256 hash)
@@ -163,7 +174,10 @@ bool CWalletDB::EraseWatchOnly(const CScript &dest)
 bool CWalletDB::WriteBestBlock(const CBlockLocator& locator)
 {
     nWalletDBUpdated++;
-    return Write(std::string("bestblock"), locator);
+    // The notewitness records are current as of this block. Older binaries
+    // write only "bestblock", so on load a mismatch means they ran since.
+    return Write(std::string("bestblock"), locator) &&
+           Write(std::string("witnessbestblock"), locator);
 }
 
 bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
@@ -189,6 +203,19 @@ bool CWalletDB::WriteWitnessCacheSize(int64_t nWitnessCacheSize)
     return Write(std::string("witnesscachesize"), nWitnessCacheSize);
 }
 
+bool CWalletDB::WriteNoteWitnesses(const JSOutPoint& jsop, const CNoteData& nd)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("notewitness"), jsop),
+                 std::make_pair(nd.witnesses, nd.witnessHeight));
+}
+
+bool CWalletDB::EraseNoteWitnesses(const JSOutPoint& jsop)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("notewitness"), jsop));
+}
+
 bool CWalletDB::ReadPool(int64_t nPool, CKeyPool& keypool)
 {
     return Read(std::make_pair(std::string("pool"), nPool), keypool);
@@ -375,6 +402,7 @@ public:
     bool fAnyUnordered;
     int nFileVersion;
     vector<uint256> vWalletUpgrade;
+    map<JSOutPoint, pair<list<ZCIncrementalWitness>, int>> mapNoteWitnesses;
 
     CWalletScanState() {
         nKeys = nCKeys = nKeyMeta = nZKeys = nCZKeys = nZKeyMeta = 0;
@@ -683,6 +711,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         {
             ssValue >> pwallet->nWitnessCacheSize;
         }
+        else if (strType == "notewitness")
+        {
+            // Applied by LoadWallet once all records are read, if they are
+            // current (see CWalletDB::WriteBestBlock)
+            JSOutPoint jsop;
+            ssKey >> jsop;
+            ssValue >> wss.mapNoteWitnesses[jsop];
+        }
     } catch (...)
     {
         return false;
@@ -702,6 +738,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
+    bool fWitnessesCurrent = true;
     DBErrors result = DB_LOAD_OK;
 
     try {
@@ -757,6 +794,30 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // The notewitness records replace the witnesses from the "tx"
+        // records, unless an older binary has written the best block since;
+        // it then wrote its witnesses to the "tx" records along with it.
+        CBlockLocator locBest, locWitnesses;
+        fWitnessesCurrent = ReadBestBlock(locBest) &&
+            Read(std::string("witnessbestblock"), locWitnesses) &&
+            locWitnesses.vHave == locBest.vHave;
+        if (fWitnessesCurrent) {
+            for (const auto& item : wss.mapNoteWitnesses) {
+                auto it = pwallet->mapWallet.find(item.first.hash);
+                if (it != pwallet->mapWallet.end() && it->second.mapNoteData.count(item.first)) {
+                    CNoteData& nd = it->second.mapNoteData.at(item.first);
+                    nd.witnesses = item.second.first;
+                    nd.witnessHeight = item.second.second;
+                }
+            }
+        } else {
+            for (const std::pair<const uint256, CWalletTx>& wtxItem : pwallet->mapWallet) {
+                for (const mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
+                    pwallet->setDirtyWitnesses.insert(item.first);
+                }
+            }
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -785,6 +846,24 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     if ((wss.nKeys + wss.nCKeys) != wss.nKeyMeta)
         pwallet->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
+    // Move the witnesses loaded from the "tx" records to notewitness records
+    // now, before anything rewrites the transactions without them
+    if (!fWitnessesCurrent) {
+        LOCK(pwallet->cs_wallet);
+        CBlockLocator locator;
+        if (ReadBestBlock(locator) && TxnBegin()) {
+            bool fWritten = true;
+            for (const JSOutPoint& jsop : pwallet->setDirtyWitnesses) {
+                fWritten = fWritten && WriteNoteWitnesses(jsop, pwallet->mapWallet[jsop.hash].mapNoteData[jsop]);
+            }
+            if (fWritten && WriteBestBlock(locator) && TxnCommit()) {
+                pwallet->setDirtyWitnesses.clear();
+            } else {
+                TxnAbort();
+            }
+        }
+    }
+
     BOOST_FOREACH(uint256 hash, wss.vWalletUpgrade)
         WriteTx(hash, pwallet->mapWallet[hash]);
 
@@ -23,9 +23,11 @@ class CAccountingEntry;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
+class CNoteData;
 class CScript;
 class CWallet;
 class CWalletTx;
+class JSOutPoint;
 class uint160;
 class uint256;
 
@@ -107,6 +109,8 @@ public:
     bool WriteDefaultKey(const CPubKey& vchPubKey);
 
     bool WriteWitnessCacheSize(int64_t nWitnessCacheSize);
+    bool WriteNoteWitnesses(const JSOutPoint& jsop, const CNoteData& nd);
+    bool EraseNoteWitnesses(const JSOutPoint& jsop);
 
     bool ReadPool(int64_t nPool, CKeyPool& keypool);
     bool WritePool(int64_t nPool, const CKeyPool& keypool);
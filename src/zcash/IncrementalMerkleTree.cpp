@@ -20,21 +20,47 @@ SHA256Compress SHA256Compress::combine(const SHA256Compress& a, const SHA256Comp
     return res;
 }
 
+void SHA256Compress::combine_pairs(const SHA256Compress* in, SHA256Compress* out, size_t pairs)
+{
+    static_assert(sizeof(SHA256Compress) == 32, "pairs of hashes must be contiguous 64-byte blocks");
+    SHA256Compress64(out->begin(), in->begin(), pairs);
+}
+
+template<size_t Depth, typename Hash>
+MerkleSubtrees<Depth, Hash>::MerkleSubtrees(size_t start,
+                                            typename std::vector<Hash>::const_iterator begin,
+                                            typename std::vector<Hash>::const_iterator end)
+{
+    levels.push_back(std::vector<Hash>(begin, end));
+    offsets.push_back(start);
+
+    for (size_t d = 0; d < Depth; d++) {
+        const std::vector<Hash>& nodes = levels[d];
+        // Skip a first node whose left sibling is outside the run.
+        size_t skip = offsets[d] % 2;
+        if (nodes.size() < skip + 2) {
+            break;
+        }
+        size_t pairs = (nodes.size() - skip) / 2;
+        std::vector<Hash> parents(pairs);
+        Hash::combine_pairs(&nodes[skip], &parents[0], pairs);
+        levels.push_back(std::move(parents));
+        offsets.push_back((offsets[d] + skip) / 2);
+    }
+}
+
 template <size_t Depth, typename Hash>
 class PathFiller {
 private:
-    std::deque<Hash> queue;
+    const FillerHashes<Depth, Hash>& hashes;
+    size_t pos;
     static EmptyMerkleRoots<Depth, Hash> emptyroots;
 public:
-    PathFiller() : queue() { }
-    PathFiller(std::deque<Hash> queue) : queue(queue) { }
+    PathFiller(const FillerHashes<Depth, Hash>& hashes) : hashes(hashes), pos(0) { }
 
     Hash next(size_t depth) {
-        if (queue.size() > 0) {
-            Hash h = queue.front();
-            queue.pop_front();
-
-            return h;
+        if (pos < hashes.size()) {
+            return hashes[pos++];
         } else {
             return emptyroots.empty_root(depth);
         }
@@ -106,6 +132,8 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
         throw std::runtime_error("tree is full");
     }
 
+    cached_root.reset();
+
     if (!left) {
         // Set the left leaf
         left = obj;
@@ -137,6 +165,70 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalMerkleTree<Depth, Hash>::append_batch(typename std::vector<Hash>::const_iterator begin,
+                                                      typename std::vector<Hash>::const_iterator end) {
+    size_t count = end - begin;
+    if (count == 0) {
+        return;
+    }
+
+    size_t n = size();
+    if (count > ((size_t)1 << Depth) - n) {
+        throw std::runtime_error("tree is full");
+    }
+
+    cached_root.reset();
+
+    // The last one or two leaves are kept as left and right, and all those
+    // before them are collapsed into parents.
+    size_t collapsed = n > 0 ? (n - 1) & ~(size_t)1 : 0;
+    size_t total = n + count;
+    size_t newCollapsed = (total - 1) & ~(size_t)1;
+
+    std::vector<Hash> nodes;
+    nodes.reserve(total - collapsed);
+    if (left) {
+        nodes.push_back(*left);
+    }
+    if (right) {
+        nodes.push_back(*right);
+    }
+    nodes.insert(nodes.end(), begin, end);
+
+    left = nodes[newCollapsed - collapsed];
+    if (total - newCollapsed == 2) {
+        right = nodes[newCollapsed - collapsed + 1];
+    } else {
+        right = boost::none;
+    }
+    nodes.resize(newCollapsed - collapsed);
+
+    // Each level's nodes start with a left child; parents[d] holds a left
+    // child of depth d + 1 that was still waiting for its sibling.
+    for (size_t d = 0; !nodes.empty(); d++) {
+        bool waiting = d < parents.size() && parents[d];
+        size_t pairs = nodes.size() / 2;
+
+        std::vector<Hash> next(waiting + pairs);
+        if (waiting) {
+            next[0] = *parents[d];
+        }
+        Hash::combine_pairs(&nodes[0], &next[waiting], pairs);
+
+        if (next.size() % 2) {
+            if (parents.size() <= d) {
+                parents.resize(d + 1);
+            }
+            parents[d] = next.back();
+            next.pop_back();
+        } else if (d < parents.size()) {
+            parents[d] = boost::none;
+        }
+        nodes.swap(next);
+    }
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -196,10 +288,19 @@ size_t IncrementalMerkleTree<Depth, Hash>::next_depth(size_t skip) const {
     return d + skip;
 }
 
+// This calculates the root of the tree at the given depth, with empty
+// subtrees to the right, remembering it until the next append.
+template<size_t Depth, typename Hash>
+Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth) const {
+    return cached_root.get(depth, [this, depth]() {
+        return root(depth, FillerHashes<Depth, Hash>());
+    });
+}
+
 // This calculates the root of the tree.
 template<size_t Depth, typename Hash>
 Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth,
-                                              std::deque<Hash> filler_hashes) const {
+                                              const FillerHashes<Depth, Hash>& filler_hashes) const {
     PathFiller<Depth, Hash> filler(filler_hashes);
 
     Hash combine_left =  left  ? *left  : filler.next(0);
@@ -232,7 +333,7 @@ Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth,
 // This constructs an authentication path into the tree in the format that the circuit
 // wants. The caller provides `filler_hashes` to fill in the uncle subtrees.
 template<size_t Depth, typename Hash>
-MerklePath IncrementalMerkleTree<Depth, Hash>::path(std::deque<Hash> filler_hashes) const {
+MerklePath IncrementalMerkleTree<Depth, Hash>::path(const FillerHashes<Depth, Hash>& filler_hashes) const {
     if (!left) {
         throw std::runtime_error("can't create an authentication path for the beginning of the tree");
     }
@@ -285,8 +386,11 @@ MerklePath IncrementalMerkleTree<Depth, Hash>::path(std::deque<Hash> filler_hash
 }
 
 template<size_t Depth, typename Hash>
-std::deque<Hash> IncrementalWitness<Depth, Hash>::partial_path() const {
-    std::deque<Hash> uncles(filled.begin(), filled.end());
+FillerHashes<Depth, Hash> IncrementalWitness<Depth, Hash>::partial_path() const {
+    FillerHashes<Depth, Hash> uncles;
+    BOOST_FOREACH(const Hash& h, filled) {
+        uncles.push_back(h);
+    }
 
     if (cursor) {
         uncles.push_back(cursor->root(cursor_depth));
@@ -297,6 +401,8 @@ std::deque<Hash> IncrementalWitness<Depth, Hash>::partial_path() const {
 
 template<size_t Depth, typename Hash>
 void IncrementalWitness<Depth, Hash>::append(Hash obj) {
+    cached_root.reset();
+
     if (cursor) {
         cursor->append(obj);
 
@@ -320,6 +426,89 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+size_t IncrementalWitness<Depth, Hash>::size() const {
+    size_t ret = tree.size();
+    for (size_t i = 0; i < filled.size(); i++) {
+        ret += (size_t)1 << tree.next_depth(i);
+    }
+    if (cursor) {
+        ret += cursor->size();
+    }
+    return ret;
+}
+
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append_batch(typename std::vector<Hash>::const_iterator begin,
+                                                   typename std::vector<Hash>::const_iterator end) {
+    size_t pos = size();
+    append_batch(MerkleSubtrees<Depth, Hash>(pos, begin, end), pos);
+}
+
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append_batch(const MerkleSubtrees<Depth, Hash>& subtrees, size_t from) {
+    if (from < subtrees.start() || from > subtrees.end()) {
+        throw std::runtime_error("position is not within the appended leaves");
+    }
+
+    size_t pos = size();
+    if (pos != from) {
+        // The run's subtrees are not aligned with ours; hash the leaves afresh.
+        std::vector<Hash> leaves;
+        for (size_t i = from; i < subtrees.end(); i++) {
+            leaves.push_back(subtrees.leaf(i));
+        }
+        append_batch(leaves.begin(), leaves.end());
+        return;
+    }
+
+    cached_root.reset();
+
+    while (pos < subtrees.end()) {
+        size_t remaining = subtrees.end() - pos;
+
+        if (cursor) {
+            // Finish the subtree that was begun before this run.
+            size_t take = std::min(((size_t)1 << cursor_depth) - cursor->size(), remaining);
+            std::vector<Hash> leaves;
+            for (size_t i = 0; i < take; i++) {
+                leaves.push_back(subtrees.leaf(pos + i));
+            }
+            cursor->append_batch(leaves.begin(), leaves.end());
+            pos += take;
+
+            if (cursor->is_complete(cursor_depth)) {
+                filled.push_back(cursor->root(cursor_depth));
+                cursor = boost::none;
+            }
+            continue;
+        }
+
+        cursor_depth = tree.next_depth(filled.size());
+        if (cursor_depth >= Depth) {
+            throw std::runtime_error("tree is full");
+        }
+
+        size_t width = (size_t)1 << cursor_depth;
+        if (remaining >= width) {
+            // The whole subtree is in the run, and has been hashed already.
+            filled.push_back(subtrees.subtree_root(cursor_depth, pos >> cursor_depth));
+            pos += width;
+        } else {
+            std::vector<Hash> leaves;
+            for (size_t i = 0; i < remaining; i++) {
+                leaves.push_back(subtrees.leaf(pos + i));
+            }
+            cursor = IncrementalMerkleTree<Depth, Hash>();
+            cursor->append_batch(leaves.begin(), leaves.end());
+            pos += remaining;
+        }
+    }
+}
+
+template class MerkleSubtrees<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
+template class MerkleSubtrees<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
@@ -1,7 +1,9 @@
 #ifndef ZCINCREMENTALMERKLETREE_H_
 #define ZCINCREMENTALMERKLETREE_H_
 
-#include <deque>
+#include <mutex>
+#include <vector>
+#include <boost/array.hpp>
 #include <boost/optional.hpp>
 #include <boost/static_assert.hpp>
 
@@ -56,9 +58,114 @@ bool operator==(const EmptyMerkleRoots<Depth, Hash>& a,
     return a.empty_roots == b.empty_roots;
 }
 
+// The roots of the filled subtrees to the right of a witnessed leaf, in
+// order of depth. They take the place of the empty roots of those subtrees
+// when computing roots and paths. There is at most one per level, so this
+// has a fixed capacity and never allocates.
+template<size_t Depth, typename Hash>
+class FillerHashes {
+public:
+    FillerHashes() : count(0) { }
+
+    void push_back(const Hash& h) {
+        hashes.at(count++) = h;
+    }
+    size_t size() const {
+        return count;
+    }
+    const Hash& operator[](size_t i) const {
+        return hashes[i];
+    }
+
+private:
+    boost::array<Hash, Depth> hashes;
+    size_t count;
+};
+
 template<size_t Depth, typename Hash>
 class IncrementalWitness;
 
+// The roots of the complete subtrees of a run of leaves appended to a tree
+// of a given size, hashed a level at a time. Every witness of the tree takes
+// the roots of the subtrees it fills from here, so a block's commitments are
+// hashed once rather than once per witness.
+template<size_t Depth, typename Hash>
+class MerkleSubtrees {
+public:
+    MerkleSubtrees(size_t start,
+                   typename std::vector<Hash>::const_iterator begin,
+                   typename std::vector<Hash>::const_iterator end);
+
+    // The position in the tree of the first and one past the last leaf.
+    size_t start() const {
+        return offsets[0];
+    }
+    size_t end() const {
+        return offsets[0] + levels[0].size();
+    }
+
+    const Hash& leaf(size_t position) const {
+        return levels[0].at(position - offsets[0]);
+    }
+    // The root of the subtree of the given depth with the given index at that
+    // depth, which must be complete and lie within the run.
+    const Hash& subtree_root(size_t depth, size_t index) const {
+        return levels.at(depth).at(index - offsets[depth]);
+    }
+
+private:
+    // levels[d][i] is the node of depth d with index offsets[d] + i.
+    std::vector<std::vector<Hash>> levels;
+    std::vector<size_t> offsets;
+};
+
+// A root remembered until the next append. Trees and witnesses are read from
+// several threads at once (the validation notification queue keeps its own
+// references to them), so filling it in from a const root() is guarded by a
+// lock of its own; copies take the value under the source's lock.
+template<typename Hash>
+class CachedRoot {
+public:
+    CachedRoot() : depth(0) { }
+    CachedRoot(const CachedRoot& other) {
+        std::lock_guard<std::mutex> lock(other.mutex);
+        root = other.root;
+        depth = other.depth;
+    }
+    CachedRoot& operator=(const CachedRoot& other) {
+        if (this != &other) {
+            std::lock(mutex, other.mutex);
+            std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+            std::lock_guard<std::mutex> lockOther(other.mutex, std::adopt_lock);
+            root = other.root;
+            depth = other.depth;
+        }
+        return *this;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        root = boost::none;
+    }
+
+    // Return the root at the given depth, calling compute() for it if it
+    // isn't the one remembered.
+    template<typename Compute>
+    Hash get(size_t at_depth, Compute compute) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!root || depth != at_depth) {
+            root = compute();
+            depth = at_depth;
+        }
+        return *root;
+    }
+
+private:
+    mutable std::mutex mutex;
+    mutable boost::optional<Hash> root;
+    mutable size_t depth;
+};
+
 template<size_t Depth, typename Hash>
 class IncrementalMerkleTree {
 
@@ -78,8 +185,12 @@ public:
     size_t size() const;
 
     void append(Hash obj);
+    // Append several leaves, hashing the subtrees they complete a level at a
+    // time. Throws, leaving the tree unchanged, if they don't all fit.
+    void append_batch(typename std::vector<Hash>::const_iterator begin,
+                      typename std::vector<Hash>::const_iterator end);
     Hash root() const {
-        return root(Depth, std::deque<Hash>());
+        return root(Depth);
     }
     Hash last() const;
 
@@ -96,6 +207,10 @@ public:
         READWRITE(parents);
 
         wfcheck();
+
+        if (ser_action.ForRead()) {
+            cached_root.reset();
+        }
     }
 
     static Hash empty_root() {
@@ -113,8 +228,14 @@ private:
 
     // Collapsed "left" subtrees ordered toward the root of the tree.
     std::vector<boost::optional<Hash>> parents;
-    MerklePath path(std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
-    Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
+
+    // Memory only: the root with no filler hashes, which root() and witness
+    // cursors ask for repeatedly between appends.
+    CachedRoot<Hash> cached_root;
+
+    MerklePath path(const FillerHashes<Depth, Hash>& filler_hashes = FillerHashes<Depth, Hash>()) const;
+    Hash root(size_t depth) const;
+    Hash root(size_t depth, const FillerHashes<Depth, Hash>& filler_hashes) const;
     bool is_complete(size_t depth = Depth) const;
     size_t next_depth(size_t skip) const;
     void wfcheck() const;
@@ -148,10 +269,18 @@ public:
     }
 
     Hash root() const {
-        return tree.root(Depth, partial_path());
+        return cached_root.get(Depth, [this]() {
+            return tree.root(Depth, partial_path());
+        });
     }
 
     void append(Hash obj);
+    void append_batch(typename std::vector<Hash>::const_iterator begin,
+                      typename std::vector<Hash>::const_iterator end);
+    // Append the leaves of a run from the given position in the tree on,
+    // taking the roots of the subtrees they fill from the run when this
+    // witness ends at that position.
+    void append_batch(const MerkleSubtrees<Depth, Hash>& subtrees, size_t from);
 
     ADD_SERIALIZE_METHODS;
 
@@ -162,6 +291,10 @@ public:
         READWRITE(cursor);
 
         cursor_depth = tree.next_depth(filled.size());
+
+        if (ser_action.ForRead()) {
+            cached_root.reset();
+        }
     }
 
     template <size_t D, typename H>
@@ -173,7 +306,10 @@ private:
     std::vector<Hash> filled;
     boost::optional<IncrementalMerkleTree<Depth, Hash>> cursor;
     size_t cursor_depth = 0;
-    std::deque<Hash> partial_path() const;
+    // Memory only: the root, until the next append.
+    CachedRoot<Hash> cached_root;
+    FillerHashes<Depth, Hash> partial_path() const;
+    size_t size() const;
     IncrementalWitness(IncrementalMerkleTree<Depth, Hash> tree) : tree(tree) {}
 };
 
@@ -192,6 +328,8 @@ public:
     SHA256Compress(uint256 contents) : uint256(contents) { }
 
     static SHA256Compress combine(const SHA256Compress& a, const SHA256Compress& b);
+    // Combine the adjacent pairs in[2i], in[2i+1] into out[i].
+    static void combine_pairs(const SHA256Compress* in, SHA256Compress* out, size_t pairs);
 };
 
 } // end namespace `libzcash`
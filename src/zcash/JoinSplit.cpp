@@ -10,6 +10,12 @@
 #include <boost/format.hpp>
 #include <boost/optional.hpp>
 #include <fstream>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "libsnark/common/default_types/r1cs_ppzksnark_pp.hpp"
 #include "libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp"
 #include "libsnark/gadgetlib1/gadgets/hashes/sha256/sha256_gadget.hpp"
@@ -63,6 +69,76 @@ void loadFromFile(std::string path, boost::optional<T>& objIn) {
     objIn = std::move(obj);
 }
 
+#ifndef WIN32
+/**
+ * Read-only stream buffer over a memory-mapped parameter file.
+ *
+ * The proving key is close to a gigabyte on disk; reading it through a
+ * std::stringstream first doubles the peak resident size and copies every
+ * byte before libsnark sees it. Deserialising straight out of the mapping
+ * lets the kernel fault pages in on demand from the (shared) page cache,
+ * and drops them again once the mapping is released.
+ */
+class MappedParamsBuf : public std::streambuf {
+public:
+    MappedParamsBuf(const std::string& path) : data(nullptr), size(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error((boost::format("could not load param file at %s") % path).str());
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error((boost::format("could not stat param file at %s") % path).str());
+        }
+        size = st.st_size;
+
+        if (size > 0) {
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error((boost::format("could not map param file at %s") % path).str());
+            }
+            data = static_cast<char*>(addr);
+#ifdef MADV_SEQUENTIAL
+            madvise(addr, size, MADV_SEQUENTIAL);
+#endif
+        }
+        // The mapping keeps its own reference to the file.
+        close(fd);
+
+        setg(data, data, data + size);
+    }
+
+    ~MappedParamsBuf() {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+
+private:
+    char* data;
+    size_t size;
+
+    MappedParamsBuf(const MappedParamsBuf&) = delete;
+    MappedParamsBuf& operator=(const MappedParamsBuf&) = delete;
+};
+
+template<typename T>
+void loadFromMappedFile(std::string path, boost::optional<T>& objIn) {
+    LOCK(cs_ParamsIO);
+
+    MappedParamsBuf buf(path);
+    std::istream is(&buf);
+
+    T obj;
+    is >> obj;
+
+    objIn = std::move(obj);
+}
+#endif
+
 template<size_t NumInputs, size_t NumOutputs>
 class JoinSplitCircuit : public JoinSplit<NumInputs, NumOutputs> {
 public:
@@ -88,7 +164,11 @@ public:
             if (!pkPath) {
                 throw std::runtime_error("proving key path unknown");
             }
+#ifndef WIN32
+            loadFromMappedFile(*pkPath, pk);
+#else
             loadFromFile(*pkPath, pk);
+#endif
         }
     }
 
@@ -4,20 +4,34 @@
 #include <sys/time.h>
 #include <stdlib.h>
 
+struct ParameterLoadingStats {
+    double loadTime;
+    double firstProofTime;
+    size_t residentBytes;
+    size_t residentBytesAfterProof;
+};
+
 extern double benchmark_sleep();
-extern double benchmark_parameter_loading();
+extern ParameterLoadingStats benchmark_parameter_loading();
 extern double benchmark_create_joinsplit();
 extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads);
 extern double benchmark_solve_equihash();
 extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
 extern double benchmark_verify_equihash();
+extern double benchmark_verify_equihash_reference();
 extern double benchmark_large_tx();
 extern double benchmark_try_decrypt_notes(size_t nAddrs);
 extern double benchmark_increment_note_witnesses(size_t nTxs);
+extern double benchmark_flush_wallet(bool fAllDirty);
 extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();
+extern double benchmark_sha256(size_t nBytes);
+extern double benchmark_merkle_append(size_t nLeaves);
+extern double benchmark_merkle_root(size_t nLeaves);
+extern double benchmark_witness_update(size_t nLeaves);
+extern double benchmark_sha256d64(size_t nBlocks);
 
 #endif
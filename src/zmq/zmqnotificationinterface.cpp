@@ -40,6 +40,14 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
 
+    // A single high water mark applies to every notifier, as they may share a socket.
+    int outbound_message_high_water_mark = CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM;
+    std::map<std::string, std::string>::const_iterator hwm = args.find("-zmqpubhwm");
+    if (hwm != args.end())
+    {
+        outbound_message_high_water_mark = atoi(hwm->second);
+    }
+
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
         std::map<std::string, std::string>::const_iterator j = args.find("-zmq" + i->first);
@@ -50,6 +58,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetOutboundMessageHighWaterMark(outbound_message_high_water_mark);
             notifiers.push_back(notifier);
         }
     }
@@ -124,12 +133,12 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex, const CSerializedBlockRef &block)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (notifier->NotifyBlock(pindex, block))
         {
             i++;
         }